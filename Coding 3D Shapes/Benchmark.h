@@ -0,0 +1,29 @@
+#pragma once
+
+// Timing shared by the `--...-bench` modes. Each times its work with UBenchmarkMilliseconds and
+// draws its random data from BENCHMARK_SEED, so runs on different builds and machines compare.
+
+#include <chrono>
+#include <cstdint>
+
+const uint32_t BENCHMARK_SEED = 1234;
+// After one warm-up run, timing goes on until both of these are reached
+const int BENCHMARK_MIN_RUNS = 5;
+const double BENCHMARK_MIN_SECONDS = 0.25;
+
+// Average milliseconds per call of run()
+template <class Fn>
+double UBenchmarkMilliseconds(Fn run)
+{
+    run();
+    int runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    double seconds = 0.0;
+    while (runs < BENCHMARK_MIN_RUNS || seconds < BENCHMARK_MIN_SECONDS)
+    {
+        run();
+        runs++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return seconds * 1000.0 / runs;
+}
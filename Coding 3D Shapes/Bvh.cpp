@@ -0,0 +1,298 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+    // Traversal stack; far deeper than the trees the scene's few thousand triangles produce
+    const int BVH_STACK_SIZE = 64;
+    // Surface area costs are in units of one triangle test; stepping into a node costs about this much
+    const float BVH_TRAVERSAL_COST = 1.0f;
+
+    struct BuildTriangle
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+        glm::vec3 centroid;
+    };
+
+    struct Bin
+    {
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+        uint32_t count = 0;
+    };
+
+    float UHalfArea(const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 extent = glm::max(max - min, glm::vec3(0.0f));
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    int UBinIndex(float centroid, float lo, float scale)
+    {
+        return min(BVH_BINS - 1, max(0, static_cast<int>((centroid - lo) * scale)));
+    }
+
+    // Cheapest binned split of a node's triangles, or false if leaving them in one leaf costs less
+    bool UFindSplit(const vector<BuildTriangle>& build, const vector<uint32_t>& order, const BvhNode& node,
+        int& bestAxis, int& bestBin)
+    {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            lo = glm::min(lo, build[order[i]].centroid);
+            hi = glm::max(hi, build[order[i]].centroid);
+        }
+
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = hi[axis] - lo[axis];
+            if (extent <= 0.0f)
+                continue;
+
+            Bin bins[BVH_BINS];
+            float scale = BVH_BINS / extent;
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                const BuildTriangle& triangle = build[order[i]];
+                Bin& bin = bins[UBinIndex(triangle.centroid[axis], lo[axis], scale)];
+                bin.min = glm::min(bin.min, triangle.min);
+                bin.max = glm::max(bin.max, triangle.max);
+                bin.count++;
+            }
+
+            // Sweep from the right to get the cost of everything right of each plane, then from the left
+            float rightCost[BVH_BINS];
+            Bin right;
+            for (int b = BVH_BINS - 1; b > 0; b--)
+            {
+                right.min = glm::min(right.min, bins[b].min);
+                right.max = glm::max(right.max, bins[b].max);
+                right.count += bins[b].count;
+                rightCost[b] = right.count == 0 ? 0.0f : UHalfArea(right.min, right.max) * right.count;
+            }
+            Bin left;
+            for (int b = 0; b < BVH_BINS - 1; b++)
+            {
+                left.min = glm::min(left.min, bins[b].min);
+                left.max = glm::max(left.max, bins[b].max);
+                left.count += bins[b].count;
+                if (left.count == 0 || left.count == node.count)
+                    continue;
+                float cost = UHalfArea(left.min, left.max) * left.count + rightCost[b + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b + 1;
+                }
+            }
+        }
+
+        if (bestCost == FLT_MAX)
+            return false; // every centroid in the same place
+        float leafCost = static_cast<float>(node.count);
+        float splitCost = BVH_TRAVERSAL_COST + bestCost / max(UHalfArea(node.min, node.max), 1e-12f);
+        return splitCost < leafCost;
+    }
+
+    // Entry distance of the ray into a node, or FLT_MAX if it misses or enters past maxDistance
+    float UEnterNode(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+    {
+        glm::vec3 t0 = (node.min - origin) * inverseDirection;
+        glm::vec3 t1 = (node.max - origin) * inverseDirection;
+        glm::vec3 nearT = glm::min(t0, t1);
+        glm::vec3 farT = glm::max(t0, t1);
+        float enter = max(max(nearT.x, nearT.y), max(nearT.z, 0.0f));
+        float exit = min(min(farT.x, farT.y), min(farT.z, maxDistance));
+        return enter <= exit ? enter : FLT_MAX;
+    }
+
+    // Möller-Trumbore, both sides
+    bool UIntersectTriangle(const glm::vec3* v, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+        BvhHit& hit)
+    {
+        glm::vec3 e1 = v[1] - v[0];
+        glm::vec3 e2 = v[2] - v[0];
+        glm::vec3 p = glm::cross(direction, e2);
+        float determinant = glm::dot(e1, p);
+        if (fabs(determinant) < 1e-12f)
+            return false;
+
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - v[0];
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, e1);
+        float w = glm::dot(direction, q) * inverse;
+        if (w < 0.0f || u + w > 1.0f)
+            return false;
+        float t = glm::dot(e2, q) * inverse;
+        if (t <= 0.0f || t >= maxDistance)
+            return false;
+
+        hit.distance = t;
+        hit.u = u;
+        hit.v = w;
+        hit.backFace = determinant < 0.0f;
+        return true;
+    }
+
+    template <bool ANY_HIT>
+    bool UTraverse(const Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit)
+    {
+        if (bvh.nodes.empty())
+            return false;
+
+        glm::vec3 inverseDirection = 1.0f / glm::vec3(
+            fabs(direction.x) > 1e-20f ? direction.x : 1e-20f,
+            fabs(direction.y) > 1e-20f ? direction.y : 1e-20f,
+            fabs(direction.z) > 1e-20f ? direction.z : 1e-20f);
+
+        bool found = false;
+        hit.distance = maxDistance;
+        uint32_t stack[BVH_STACK_SIZE];
+        int top = 0;
+        if (UEnterNode(bvh.nodes[0], origin, inverseDirection, maxDistance) == FLT_MAX)
+            return false;
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            const BvhNode& node = bvh.nodes[stack[--top]];
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                {
+                    BvhHit candidate;
+                    if (!UIntersectTriangle(&bvh.vertices[i * 3], origin, direction, hit.distance, candidate))
+                        continue;
+                    candidate.triangle = bvh.triangles[i];
+                    hit = candidate;
+                    found = true;
+                    if (ANY_HIT)
+                        return true;
+                }
+                continue;
+            }
+
+            // Visit the nearer child first so the far one is often culled by the hit found there
+            float enterLeft = UEnterNode(bvh.nodes[node.first], origin, inverseDirection, hit.distance);
+            float enterRight = UEnterNode(bvh.nodes[node.first + 1], origin, inverseDirection, hit.distance);
+            uint32_t nearChild = enterLeft <= enterRight ? node.first : node.first + 1;
+            uint32_t farChild = enterLeft <= enterRight ? node.first + 1 : node.first;
+            if (max(enterLeft, enterRight) != FLT_MAX)
+                stack[top++] = farChild;
+            if (min(enterLeft, enterRight) != FLT_MAX)
+                stack[top++] = nearChild;
+        }
+        return found;
+    }
+}
+
+void UBuildBvh(const vector<glm::vec3>& vertices, Bvh& bvh)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(vertices.size() / 3);
+    bvh.nodes.clear();
+    bvh.vertices.clear();
+    bvh.triangles.clear();
+    if (triangleCount == 0)
+        return;
+
+    vector<BuildTriangle> build(triangleCount);
+    vector<uint32_t> order(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3* v = &vertices[t * 3];
+        build[t].min = glm::min(v[0], glm::min(v[1], v[2]));
+        build[t].max = glm::max(v[0], glm::max(v[1], v[2]));
+        build[t].centroid = (build[t].min + build[t].max) * 0.5f;
+        order[t] = t;
+    }
+
+    auto fitBounds = [&](BvhNode& node)
+    {
+        node.min = glm::vec3(FLT_MAX);
+        node.max = glm::vec3(-FLT_MAX);
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            node.min = glm::min(node.min, build[order[i]].min);
+            node.max = glm::max(node.max, build[order[i]].max);
+        }
+    };
+
+    bvh.nodes.reserve(triangleCount * 2);
+    BvhNode root;
+    root.first = 0;
+    root.count = triangleCount;
+    fitBounds(root);
+    bvh.nodes.push_back(root);
+
+    vector<uint32_t> pending = { 0 };
+    while (!pending.empty())
+    {
+        uint32_t nodeIndex = pending.back();
+        pending.pop_back();
+        BvhNode node = bvh.nodes[nodeIndex];
+        if (node.count <= static_cast<uint32_t>(BVH_LEAF_SIZE))
+            continue;
+
+        int axis = 0, bin = 0;
+        if (!UFindSplit(build, order, node, axis, bin))
+            continue;
+
+        // Same binning as UFindSplit, so the partition lands exactly on the chosen plane
+        float lo = FLT_MAX, hi = -FLT_MAX;
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            lo = min(lo, build[order[i]].centroid[axis]);
+            hi = max(hi, build[order[i]].centroid[axis]);
+        }
+        float scale = BVH_BINS / (hi - lo);
+        uint32_t* begin = &order[node.first];
+        uint32_t* middle = partition(begin, begin + node.count,
+            [&](uint32_t t) { return UBinIndex(build[t].centroid[axis], lo, scale) < bin; });
+        uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+        if (leftCount == 0 || leftCount == node.count)
+            continue;
+
+        BvhNode left, right;
+        left.first = node.first;
+        left.count = leftCount;
+        right.first = node.first + leftCount;
+        right.count = node.count - leftCount;
+        fitBounds(left);
+        fitBounds(right);
+
+        uint32_t leftIndex = static_cast<uint32_t>(bvh.nodes.size());
+        bvh.nodes.push_back(left);
+        bvh.nodes.push_back(right);
+        bvh.nodes[nodeIndex].first = leftIndex;
+        bvh.nodes[nodeIndex].count = 0;
+        pending.push_back(leftIndex);
+        pending.push_back(leftIndex + 1);
+    }
+
+    bvh.triangles = order;
+    bvh.vertices.resize(triangleCount * 3);
+    for (uint32_t i = 0; i < triangleCount; i++)
+        for (int corner = 0; corner < 3; corner++)
+            bvh.vertices[i * 3 + corner] = vertices[order[i] * 3 + corner];
+}
+
+bool UIntersectBvh(const Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit)
+{
+    return UTraverse<false>(bvh, origin, direction, maxDistance, hit);
+}
+
+bool UOccludedBvh(const Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance)
+{
+    BvhHit hit;
+    return UTraverse<true>(bvh, origin, direction, maxDistance, hit);
+}
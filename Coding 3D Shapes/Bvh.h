@@ -0,0 +1,45 @@
+#pragma once
+
+// Bounding volume hierarchy over a triangle soup, for tracing rays through the scene on the CPU
+// (the lightmap baker). Built top-down with binned surface area splits; nodes are stored flat,
+// with the two children of an inner node next to each other. Nothing in here touches GL.
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Triangles with at most this many in a node are never split further
+const int BVH_LEAF_SIZE = 4;
+// Candidate split planes tried per axis when building
+const int BVH_BINS = 16;
+
+struct BvhNode
+{
+    glm::vec3 min;
+    uint32_t first; // inner node: index of the left child (the right one follows it); leaf: first triangle slot
+    glm::vec3 max;
+    uint32_t count; // triangles in a leaf, 0 for an inner node
+};
+
+struct Bvh
+{
+    std::vector<BvhNode> nodes;          // nodes[0] is the root
+    std::vector<glm::vec3> vertices;     // three per triangle slot, in leaf order
+    std::vector<uint32_t> triangles;     // original triangle index of each slot
+};
+
+struct BvhHit
+{
+    float distance;
+    float u, v;        // barycentric weights of the triangle's second and third vertex
+    uint32_t triangle; // index into the triangles passed to UBuildBvh
+    bool backFace;     // the ray hit the side the triangle's winding faces away from
+};
+
+// Builds over `vertices`, three per triangle, counter-clockwise seen from the front
+void UBuildBvh(const std::vector<glm::vec3>& vertices, Bvh& bvh);
+// Nearest hit along origin + t * direction for t in (0, maxDistance)
+bool UIntersectBvh(const Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit);
+// Whether anything lies along the ray before maxDistance; stops at the first hit found
+bool UOccludedBvh(const Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance);
@@ -0,0 +1,279 @@
+#include "ClusteredLighting.h"
+#include "Lod.h"
+#include "Benchmark.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+namespace {
+    bool USphereTouchesBox(const glm::vec3& center, float radius, const ClusterBounds& box)
+    {
+        glm::vec3 closest = glm::clamp(center, box.min, box.max);
+        glm::vec3 offset = center - closest;
+        return glm::dot(offset, offset) <= radius * radius;
+    }
+
+    // View-space lights in structure-of-arrays form, padded to a multiple of four with
+    // lights so far away they never touch a box
+    struct LightSet
+    {
+        vector<float> x, y, z, radius;
+        vector<uint32_t> index; // into the frame's light list
+        size_t count = 0;
+
+        void Clear()
+        {
+            x.clear(); y.clear(); z.clear(); radius.clear(); index.clear();
+            count = 0;
+        }
+
+        void Push(float lightX, float lightY, float lightZ, float lightRadius, uint32_t lightIndex)
+        {
+            x.push_back(lightX); y.push_back(lightY); z.push_back(lightZ);
+            radius.push_back(lightRadius);
+            index.push_back(lightIndex);
+            count++;
+        }
+
+        void Pad()
+        {
+            while (x.size() % 4 != 0)
+            {
+                x.push_back(1e30f); y.push_back(0.0f); z.push_back(0.0f);
+                radius.push_back(0.0f);
+                index.push_back(0);
+            }
+        }
+    };
+
+    // Calls fn(i) for every light i in `set` whose sphere touches `box`, in order, four tests at a time
+    template <class Fn>
+    void UForEachLightTouching(const LightSet& set, const ClusterBounds& box, Fn fn)
+    {
+        const Float4 minX(box.min.x), minY(box.min.y), minZ(box.min.z);
+        const Float4 maxX(box.max.x), maxY(box.max.y), maxZ(box.max.z);
+        const Float4 zero(0.0f);
+        for (size_t i = 0; i < set.x.size(); i += 4)
+        {
+            // Distance from the center to the box along each axis, zero inside it
+            const Float4 x = ULoad4(&set.x[i]), y = ULoad4(&set.y[i]), z = ULoad4(&set.z[i]);
+            const Float4 dx = UMax(UMax(minX - x, x - maxX), zero);
+            const Float4 dy = UMax(UMax(minY - y, y - maxY), zero);
+            const Float4 dz = UMax(UMax(minZ - z, z - maxZ), zero);
+            const Float4 radius = ULoad4(&set.radius[i]);
+            int touching = ~UMoveMask(dx * dx + dy * dy + dz * dz > radius * radius) & 0xF;
+            for (int lane = 0; touching != 0; lane++, touching >>= 1)
+            {
+                if (touching & 1)
+                    fn(i + lane);
+            }
+        }
+    }
+
+    void UFilterLights(const LightSet& set, const ClusterBounds& box, LightSet& touching)
+    {
+        touching.Clear();
+        UForEachLightTouching(set, box, [&](size_t i)
+            {
+                touching.Push(set.x[i], set.y[i], set.z[i], set.radius[i], set.index[i]);
+            });
+        touching.Pad();
+    }
+
+    ClusterBounds UUnionBounds(const ClusterBounds* boxes, size_t count)
+    {
+        ClusterBounds result = boxes[0];
+        for (size_t i = 1; i < count; i++)
+        {
+            result.min = glm::min(result.min, boxes[i].min);
+            result.max = glm::max(result.max, boxes[i].max);
+        }
+        return result;
+    }
+
+    // One light and one box at a time with no narrowing; what the benchmark checks against
+    void UAssignLightsReference(const ClusterGrid& grid, const vector<PointLight>& lights, const glm::mat4& view,
+        ClusterLightLists& lists)
+    {
+        lists.ranges.assign(CLUSTER_COUNT * 2, 0);
+        lists.indices.clear();
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+        {
+            lists.ranges[cluster * 2] = uint32_t(lists.indices.size());
+            for (size_t i = 0; i < lights.size(); i++)
+            {
+                glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+                if (USphereTouchesBox(center, lights[i].radius, grid.bounds[cluster]))
+                    lists.indices.push_back(uint32_t(i));
+            }
+            lists.ranges[cluster * 2 + 1] = uint32_t(lists.indices.size()) - lists.ranges[cluster * 2];
+        }
+    }
+}
+
+float UClusterSliceDepth(int slice)
+{
+    return SCENE_NEAR_PLANE * pow(SCENE_FAR_PLANE / SCENE_NEAR_PLANE, float(slice) / CLUSTER_SLICES);
+}
+
+glm::vec2 UClusterSliceScaleBias()
+{
+    float scale = CLUSTER_SLICES / log(SCENE_FAR_PLANE / SCENE_NEAR_PLANE);
+    return glm::vec2(scale, -log(SCENE_NEAR_PLANE) * scale);
+}
+
+void UUpdateClusterGrid(const glm::mat4& projection, ClusterGrid& grid)
+{
+    if (!grid.bounds.empty() && grid.projection == projection)
+        return;
+
+    grid.projection = projection;
+    grid.bounds.resize(CLUSTER_COUNT);
+    const glm::mat4 inverseProjection = glm::inverse(projection);
+
+    for (int slice = 0; slice < CLUSTER_SLICES; slice++)
+    {
+        const float depths[2] = { UClusterSliceDepth(slice), UClusterSliceDepth(slice + 1) };
+        for (int tileY = 0; tileY < CLUSTER_TILES_Y; tileY++)
+        {
+            for (int tileX = 0; tileX < CLUSTER_TILES_X; tileX++)
+            {
+                const float x[2] = { -1.0f + 2.0f * tileX / CLUSTER_TILES_X, -1.0f + 2.0f * (tileX + 1) / CLUSTER_TILES_X };
+                const float y[2] = { -1.0f + 2.0f * tileY / CLUSTER_TILES_Y, -1.0f + 2.0f * (tileY + 1) / CLUSTER_TILES_Y };
+
+                // Box around the tile's four corner rays cut at the slice's near and far depth
+                ClusterBounds& box = grid.bounds[UClusterIndex(tileX, tileY, slice)];
+                box.min = glm::vec3(INFINITY);
+                box.max = glm::vec3(-INFINITY);
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    glm::vec3 p = UPointAtViewDepth(inverseProjection, x[corner & 1], y[(corner >> 1) & 1], depths[corner >> 2]);
+                    box.min = glm::min(box.min, p);
+                    box.max = glm::max(box.max, p);
+                }
+            }
+        }
+    }
+}
+
+void UAssignLightsToClusters(const ClusterGrid& grid, const vector<PointLight>& lights, const glm::mat4& view,
+    ClusterLightLists& lists)
+{
+    lists.ranges.resize(CLUSTER_COUNT * 2);
+    lists.sliceIndices.resize(CLUSTER_SLICES);
+
+    LightSet all;
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+        all.Push(center.x, center.y, center.z, lights[i].radius, uint32_t(i));
+    }
+    all.Pad();
+
+    // Each slice narrows the lights down to the slice, then to each row of tiles, then tests
+    // each cluster. Slices write disjoint ranges and their own index list, so no locking.
+    const size_t tilesPerSlice = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+    UParallelFor(CLUSTER_SLICES, [&](size_t slice)
+        {
+            const ClusterBounds* sliceBoxes = &grid.bounds[UClusterIndex(0, 0, int(slice))];
+            vector<uint32_t>& indices = lists.sliceIndices[slice];
+            indices.clear();
+
+            LightSet sliceLights, rowLights;
+            UFilterLights(all, UUnionBounds(sliceBoxes, tilesPerSlice), sliceLights);
+            for (int tileY = 0; tileY < CLUSTER_TILES_Y && sliceLights.count > 0; tileY++)
+            {
+                const ClusterBounds* rowBoxes = sliceBoxes + tileY * CLUSTER_TILES_X;
+                UFilterLights(sliceLights, UUnionBounds(rowBoxes, CLUSTER_TILES_X), rowLights);
+                for (int tileX = 0; tileX < CLUSTER_TILES_X; tileX++)
+                {
+                    const int cluster = UClusterIndex(tileX, tileY, int(slice));
+                    lists.ranges[cluster * 2] = uint32_t(indices.size());
+                    if (rowLights.count > 0)
+                        UForEachLightTouching(rowLights, rowBoxes[tileX], [&](size_t i) { indices.push_back(rowLights.index[i]); });
+                    lists.ranges[cluster * 2 + 1] = uint32_t(indices.size()) - lists.ranges[cluster * 2];
+                }
+            }
+
+            // Rows skipped above have no lights
+            if (sliceLights.count == 0)
+            {
+                for (size_t tile = 0; tile < tilesPerSlice; tile++)
+                {
+                    const size_t cluster = slice * tilesPerSlice + tile;
+                    lists.ranges[cluster * 2] = 0;
+                    lists.ranges[cluster * 2 + 1] = 0;
+                }
+            }
+        });
+
+    // Stitch the slices' lists together and move their offsets to match
+    vector<uint32_t> sliceStart(CLUSTER_SLICES + 1, 0);
+    for (int slice = 0; slice < CLUSTER_SLICES; slice++)
+        sliceStart[slice + 1] = sliceStart[slice] + uint32_t(lists.sliceIndices[slice].size());
+    lists.indices.resize(sliceStart[CLUSTER_SLICES]);
+
+    UParallelFor(CLUSTER_SLICES, [&](size_t slice)
+        {
+            const vector<uint32_t>& indices = lists.sliceIndices[slice];
+            copy(indices.begin(), indices.end(), lists.indices.begin() + sliceStart[slice]);
+            for (size_t tile = 0; tile < tilesPerSlice; tile++)
+                lists.ranges[(slice * tilesPerSlice + tile) * 2] += sliceStart[slice];
+        });
+}
+
+int UClusterBenchmarkMain(int argc, char* argv[])
+{
+    for (int i = 2; i < argc; i++)
+        UParseThreadsOption(argc, argv, i);
+
+    const SceneCamera camera = UDefaultSceneCamera();
+    const glm::mat4 view = USceneView(camera);
+    ClusterGrid grid;
+    UUpdateClusterGrid(USceneProjection(camera.isPerspective, 800.0f / 600.0f), grid);
+
+    cout << fixed << setprecision(3);
+    cout << "INFO: Binning into " << CLUSTER_COUNT << " clusters on " << UParallelThreadCount() << " threads" << endl;
+
+    // Lights scattered through the whole view volume
+    mt19937 random(BENCHMARK_SEED);
+    uniform_real_distribution<float> spreadX(-40.0f, 40.0f), spreadY(-30.0f, 30.0f), spreadZ(-95.0f, 5.0f);
+    uniform_real_distribution<float> spreadRadius(0.5f, 2.0f);
+    ClusterLightLists lists, reference;
+    for (size_t count = 1024; count <= 65536; count *= 2)
+    {
+        vector<PointLight> lights(count);
+        for (PointLight& light : lights)
+        {
+            light.position = glm::vec3(spreadX(random), spreadY(random), spreadZ(random));
+            light.radius = spreadRadius(random);
+            light.color = glm::vec3(1.0f);
+        }
+
+        double milliseconds = UBenchmarkMilliseconds([&]() { UAssignLightsToClusters(grid, lights, view, lists); });
+        double referenceMilliseconds = UBenchmarkMilliseconds([&]() { UAssignLightsReference(grid, lights, view, reference); });
+
+        if (lists.ranges != reference.ranges || lists.indices != reference.indices)
+        {
+            cout << "ERROR::CLUSTERS::MISMATCH with " << count << " lights" << endl;
+            return EXIT_FAILURE;
+        }
+
+        uint32_t busiest = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+            busiest = max(busiest, lists.ranges[cluster * 2 + 1]);
+        cout << "INFO: " << setw(5) << count << " lights: " << milliseconds << " ms (reference " << referenceMilliseconds
+            << " ms, " << setprecision(1) << referenceMilliseconds / milliseconds << "x), " << lists.indices.size()
+            << " entries, at most " << busiest << " per cluster" << setprecision(3) << endl;
+    }
+    return 0;
+}
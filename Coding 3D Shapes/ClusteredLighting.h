@@ -0,0 +1,61 @@
+#pragma once
+
+// Clustered forward lighting: the view frustum is cut into CLUSTER_TILES_X x CLUSTER_TILES_Y
+// screen tiles and CLUSTER_SLICES depth slices, and every frame each cluster gets the list of
+// lights whose sphere touches it. The fragment shader then only loops over its own cluster's
+// lights instead of every light in the scene. Nothing in here touches GL.
+
+#include "Scene.h"
+
+#include <cstdint>
+#include <vector>
+
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+// Slices are spaced exponentially between the near and far planes, so clusters stay
+// roughly cube-shaped instead of turning into long slivers far from the camera
+const int CLUSTER_SLICES = 24;
+const int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+// View-space box around one cluster
+struct ClusterBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Cluster boxes for one projection; they only change when the projection does
+struct ClusterGrid
+{
+    glm::mat4 projection = glm::mat4(0.0f);
+    std::vector<ClusterBounds> bounds; // CLUSTER_COUNT, indexed by UClusterIndex
+};
+
+// What the shader reads: an (offset, count) pair per cluster into `indices`
+struct ClusterLightLists
+{
+    std::vector<uint32_t> ranges;
+    std::vector<uint32_t> indices;
+    std::vector<std::vector<uint32_t>> sliceIndices; // per-slice scratch, kept to avoid reallocating every frame
+};
+
+inline int UClusterIndex(int tileX, int tileY, int slice)
+{
+    return tileX + CLUSTER_TILES_X * (tileY + CLUSTER_TILES_Y * slice);
+}
+
+// View-space depth (distance in front of the camera) where `slice` begins; slice CLUSTER_SLICES is the far plane
+float UClusterSliceDepth(int slice);
+// Maps log(depth) to a slice: slice = log(depth) * scale + bias. Matches UClusterSliceDepth.
+glm::vec2 UClusterSliceScaleBias();
+
+// Rebuilds the cluster boxes if `projection` differs from the one they were built for
+void UUpdateClusterGrid(const glm::mat4& projection, ClusterGrid& grid);
+// Bins `lights` (world space) into the grid's clusters as seen through `view`. Slices are binned
+// in parallel, four lights per sphere-vs-box test; each cluster's indices come out in ascending order.
+void UAssignLightsToClusters(const ClusterGrid& grid, const std::vector<PointLight>& lights, const glm::mat4& view,
+    ClusterLightLists& lists);
+
+// Entry point for `--cluster-bench`: times light binning for 1K to 64K random lights and checks
+// the result against a plain one-light-at-a-time version
+int UClusterBenchmarkMain(int argc, char* argv[]);
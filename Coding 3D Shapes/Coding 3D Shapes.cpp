@@ -6,16 +6,38 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <cmath>
+#include <cstring>
+#include <mutex>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-using namespace std;
+#include "Scene.h"
+#include "SoftwareRenderer.h"
+#include "GoldenImages.h"
+#include "Lod.h"
+#include "Shaders.h"
+#include "ShaderVariants.h"
+#include "ShaderHotReload.h"
+#include "FixedStep.h"
+#include "FramePacing.h"
+#include "TessellatedShapes.h"
+#include "SceneGraph.h"
+#include "Entities.h"
+#include "Jobs.h"
+#include "CommandBuffer.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+#include "ClusteredLighting.h"
+#include "ShadowMap.h"
+#include "Lightmap.h"
+#include "LightProbes.h"
 
-#ifndef GLSL
-#define GLSL(Version, Source) "#version " #Version " core \n" #Source
-#endif
+using namespace std;
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -30,34 +52,125 @@ namespace {
         GLuint vao;
         GLuint vbos[2];
         GLuint nIndices;
+        VertexQuantization quantization; // undoes packed positions in the vertex shader
     };
 
-    struct LightSource
+    // Per-draw values of the scene shaders, laid out as their DrawData block (shaders/draw_data.glsl)
+    struct SceneDrawData
     {
-        glm::vec3 position;
-        glm::vec3 color;
-        GLMesh mesh;
         glm::mat4 model;
+        glm::mat4 normalMatrix; // std140 pads a mat3's columns to vec4s, so a mat4 holds it
+        glm::vec4 positionScale;
+        glm::vec4 positionOffset;
+        glm::vec4 uniformColor;
+    };
+    // Uniform buffer binding the DrawData block is declared at
+    const GLuint DRAW_DATA_BINDING = 0;
+
+    // A tessellated shape recorded in URender, drawn by UReplayTessellatedDraw
+    struct TessellatedDraw
+    {
+        GLuint program;
+        SceneMeshId mesh;
+        glm::mat4 model;
+    };
+
+    // Everything that moves over time, advanced only in fixed steps (see FixedStep.h)
+    struct SimulationState
+    {
+        glm::vec3 cameraPosition;
+        double seconds = 0.0; // simulated time, drives the light field
+    };
+
+    // Components of the scene's entities (see Entities.h)
+    struct Transform
+    {
+        uint32_t node; // in gSceneGraph
+    };
+    struct MeshRef
+    {
+        int shape;         // SceneMeshId, or -1 for the light cube
+        uint32_t firstLod; // levels gMeshes[firstLod] to gMeshes[firstLod + lodCount - 1], finest first
+        uint32_t lodCount;
+        LodSelection lod;
+    };
+    struct Material
+    {
+        GLuint texture;
+        GLuint lightmap;   // 0 where the entity is lit per fragment (not lightmapped, or not baked yet)
+        unsigned features; // of the cheapest scene shader variant that draws it correctly
+        glm::vec3 color;   // flat color of SHADER_UNLIT
+        bool castsShadow;
+    };
+    struct Light
+    {
+        glm::vec3 color;
+        float radius;
+        float baked; // as PointLight::baked
+    };
+    struct Bounds
+    {
+        glm::vec3 center; // world-space sphere around the finest level, as of the last scene graph update
+        float radius;
     };
 
     GLFWwindow* gWindow = nullptr;
-    GLMesh gMeshPyramid;
-    GLMesh gMeshSphere;
-    GLMesh gMeshPlane;
-    GLMesh gMeshTorus;
-    GLMesh gMeshCube;
-    GLMesh gMeshCylinder;
-    GLuint gProgramId;
-    GLuint spongeTexture;
-    GLuint woodTexture;
-    GLuint bluecontainerTexture;
-    LightSource keyLight;
-    LightSource fillLight;
+    // Every mesh uploaded: SCENE_LOD_COUNT slots per SceneMeshId (only the sphere, torus and cylinder
+    // use more than level 0), then the light cube. MeshRef components point into it.
+    const uint32_t LIGHT_CUBE_SLOT = MESH_COUNT * SCENE_LOD_COUNT;
+    GLMesh gMeshes[LIGHT_CUBE_SLOT + 1];
+    SceneMeshData gMeshBounds[LIGHT_CUBE_SLOT + 1]; // CPU copy of each mesh's bounds and detail for LOD selection
+    GLuint gTextures[TEXTURE_COUNT];
+    // Scene objects first, in USceneObjects order, then the lights (key light first) and their cubes
+    EntityWorld gEntities;
+    Entity gKeyLight = ENTITY_NONE; // casts the shadow map
+    // Transform hierarchy: one top-level node per scene object and light, the light's cube below it
+    SceneGraph gSceneGraph;
+    // Every variant of the scene shaders drawn so far (see ShaderVariants.h)
+    ShaderVariants gSceneShaders;
+    // URender's draws, recorded on the job workers a block of DRAW_RECORD_GRAIN entities per buffer,
+    // and the uniform buffer that holds their draw data on replay
+    const size_t DRAW_RECORD_GRAIN = 256;
+    vector<CommandBuffer> gDrawCommands;
+    GLuint gDrawDataBuffer = 0;
+    // Shader variants a recording job needed before they were built: (tessellated, features)
+    mutex gMissingVariantsMutex;
+    vector<pair<bool, unsigned>> gMissingVariants;
+    // Every light drawn this frame (key and fill first) and their per-cluster lists
+    vector<PointLight> gLights;
+    ClusterGrid gClusterGrid;
+    ClusterLightLists gClusterLists;
+    GLuint gLightBuffers[3]; // lights, cluster ranges, cluster light indices
+    // Cascaded shadow map of the key light (light 0 in gLights); each cascade is re-rendered only when it goes stale
+    ShadowMap gKeyLightShadow;
+    bool gShadowsAvailable = false;
+    // Baked SH probe grid lighting everything else, 0 until baked (ambient light is flat then)
+    GLuint gProbeTexture = 0;
+    // The last two simulated states; each frame draws a blend of them
+    FixedStepClock gSimulationClock;
+    SimulationState gPreviousState;
+    SimulationState gCurrentState;
+    // Holds the loop to the target frame rate
+    FramePacer gFramePacer;
+
+    // Everything URender reads that changes at run time. A frame that would be drawn from the same
+    // values as the one on screen is skipped; changes not captured here set gFrameDirty instead.
+    struct FrameInputs
+    {
+        glm::vec3 cameraPosition;
+        glm::vec3 cameraFront;
+        bool perspective = true;
+        bool tessellation = false;
+        bool lightField = false;
+    };
+    FrameInputs gDrawnFrame;
+    bool gFrameDirty = true;     // resized, exposed, shaders or lights changed, or a camera move is due
+    bool gDrawEveryFrame = false; // --no-idle
 
 
     // Camera variables
     // could not figure out how to use camera.h from OpenGLsample code
-    glm::vec3 cameraPosition = glm::vec3(0.0f, 0.0f, 5.0f);
+    glm::vec3 cameraPosition = glm::vec3(0.0f, 0.0f, 5.0f); // as drawn: blended between the last two steps
     glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
     glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
     float cameraSpeed = 2.5f; // Adjust camera movement speed here
@@ -67,12 +180,6 @@ namespace {
     bool firstMouse = true;
     float lastMouseX = WINDOW_WIDTH / 2.0f;
     float lastMouseY = WINDOW_HEIGHT / 2.0f;
-
-    //lights and thier color
-    const glm::vec3 KEY_LIGHT_COLOR = glm::vec3(1.0f, 0.6f, 0.2f); //sunset yellow
-    const glm::vec3 FILL_LIGHT_COLOR = glm::vec3(0.9f, 0.9f, 0.9f);
-
-
 }
 
 void UMouseScrollCallback(GLFWwindow* window, double xOffset, double yOffset)
@@ -88,374 +195,87 @@ void UMouseScrollCallback(GLFWwindow* window, double xOffset, double yOffset)
 bool UInitialize(int, char* [], GLFWwindow** window);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
-void UCreateMesh(GLMesh& mesh, const vector<GLfloat>& vertices, const vector<GLushort>& indices);
+void UCreateMesh(GLMesh& mesh, const SceneMeshData& data, int sourceStride, const VertexFormat& format);
 void UDestroyMesh(GLMesh& mesh);
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
 void UMouseScrollCallback(GLFWwindow* window, double xOffset, double yOffset);
-void UpdateCameraPosition(GLFWwindow* window, float deltaTime);
+void UpdateCameraPosition(GLFWwindow* window, float deltaTime, glm::vec3& position);
+void USimulate();
+void UMarkFrameDirty();
+bool UTakeFrameChanges();
 bool isPerspective = true;  // Start with the perspective view
 bool pKeyLastState = false; // by default, key not pressed
-void UCreateLightSource(LightSource& light, const glm::vec3& position, const glm::vec3& color);
-void UDestroyLightSource(LightSource& light);
-
-
-// Vertex Shader Source Code
-const GLchar* vertexShaderSource = GLSL(440,
-    layout(location = 0) in vec3 position;
-layout(location = 1) in vec4 color;
-layout(location = 2) in vec2 texCoord; // Added texture coordinate
+bool gUseTessellation = false; // draw the sphere, torus and cylinder with tessellation shaders (T)
+bool gTessellationAvailable = false;
+bool tKeyLastState = false;
+bool gShowLightField = false; // add SCENE_LIGHT_FIELD_COUNT small lights around the floor (L)
+bool lKeyLastState = false;
+void UCreateSceneEntities(const vector<GLuint>& lightmaps);
+void UUpdateBounds();
+bool UTessellates(const MeshRef& mesh, const Material& material);
+GLenum UComponentGLType(VertexComponentType type);
+void USetSceneUniforms(GLuint programId, const glm::mat4& view, const glm::mat4& projection);
+unsigned USceneFeatures(GLuint lightmap);
+void URecordSceneDraws(const glm::mat4& view, const glm::mat4& projection);
+void UReplayTessellatedDraw(const void* args);
+void UUpdateLightBuffers(const glm::mat4& view, const glm::mat4& projection, float seconds);
+void URenderShadowMap(ShadowMap& map, const glm::mat4& view, const glm::mat4& projection);
+void ULoadLightmaps(const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], vector<GLuint>& lightmaps);
+void ULoadLightProbes();
 
-out vec4 vertexColor;
-out vec2 fragTexCoord; // Added fragment texture coordinate
-out vec3 fragPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    gl_Position = projection * view * model * vec4(position, 1.0f);
-    vertexColor = color;
-    fragTexCoord = texCoord; // Pass texture coordinate to fragment shader
-    fragPos = vec3(model * vec4(position, 1.0));
-}
-);
-
-// Fragment Shader Source Code
-const GLchar* fragmentShaderSource = GLSL(440,
-in vec4 vertexColor;
-in vec2 fragTexCoord;
-in vec3 fragPos;
-
-out vec4 fragmentColor;
-
-uniform sampler2D textureSampler; // Added texture
-
-uniform vec3 keyLightPosition;
-uniform vec3 keyLightColor;
-uniform vec3 fillLightPosition;
-uniform vec3 fillLightColor;
-uniform vec3 ambientLightColor;
-uniform bool useUniformColor;
-uniform vec3 uniformColor;
-uniform vec3 viewPosition;
-uniform float shininess;
-
-void main()
-{
-    if (useUniformColor) {
-        fragmentColor = vec4(uniformColor, 1.0);
-        return;
-    }
-
-    vec3 normal = normalize(-vec3(0.0, 1.0, 0.0));
-    vec3 viewDir = normalize(viewPosition - fragPos);
-
-    // Key Light
-    vec3 lightDir1 = normalize(keyLightPosition - fragPos);
-    float diff1 = max(dot(lightDir1, normal), 0.0);
-    vec3 diffuse1 = keyLightColor * diff1 * vertexColor.rgb;
-
-    vec3 reflectDir1 = reflect(-lightDir1, normal);
-    float spec1 = pow(max(dot(viewDir, reflectDir1), 0.0), shininess);
-    vec3 specular1 = keyLightColor * spec1 * vertexColor.rgb;
-
-    // Fill Light
-    vec3 lightDir2 = normalize(fillLightPosition - fragPos);
-    float diff2 = max(dot(lightDir2, normal), 0.0);
-    vec3 diffuse2 = fillLightColor * diff2 * vertexColor.rgb;
-
-    vec3 reflectDir2 = reflect(-lightDir2, normal);
-    float spec2 = pow(max(dot(viewDir, reflectDir2), 0.0), shininess);
-    vec3 specular2 = fillLightColor * spec2 * vertexColor.rgb;
-
-    vec3 ambient = ambientLightColor * vertexColor.rgb;
-
-    vec3 finalColor = ambient + diffuse1 + specular1 + diffuse2 + specular2;
-
-    fragmentColor = texture(textureSampler, fragTexCoord) * vec4(finalColor, 1.0);
-}
-);
 int main(int argc, char* argv[])
 {
-    if (!UInitialize(argc, argv, &gWindow))
+    // CPU-only rendering for machines without a GPU; never creates a window
+    if (argc > 1 && strcmp(argv[1], "--software") == 0)
+        return USoftwareMain(argc, argv);
+    // Golden-image and frame time regression suite, also CPU-only
+    if (argc > 1 && strcmp(argv[1], "--golden") == 0)
+        return UGoldenMain(argc, argv);
+    // Vertex cache statistics for the generated meshes
+    if (argc > 1 && strcmp(argv[1], "--mesh-stats") == 0)
+        return UMeshStatsMain(argc, argv);
+    // Light-to-cluster binning benchmark, CPU-only
+    if (argc > 1 && strcmp(argv[1], "--cluster-bench") == 0)
+        return UClusterBenchmarkMain(argc, argv);
+    // SoA world matrix composition benchmark, CPU-only
+    if (argc > 1 && strcmp(argv[1], "--transform-bench") == 0)
+        return UTransformBenchmarkMain(argc, argv);
+    // Scene graph updates against a recursive reference, CPU-only
+    if (argc > 1 && strcmp(argv[1], "--scene-graph-bench") == 0)
+        return USceneGraphBenchmarkMain(argc, argv);
+    // Scheduling cost of the job system behind every parallel loop
+    if (argc > 1 && strcmp(argv[1], "--job-bench") == 0)
+        return UJobBenchmarkMain(argc, argv);
+    // Path-traced lightmaps for the static objects, CPU-only
+    if (argc > 1 && strcmp(argv[1], "--bake-lightmaps") == 0)
+        return ULightmapBakeMain(argc, argv);
+
+    FramePacingOptions pacing;
+    if (!UParseFramePacingOptions(argc, argv, pacing))
         return EXIT_FAILURE;
 
-    // Create the key and fill light sources
-    UCreateLightSource(keyLight, glm::vec3(-5.0f, 1.5f, 1.0f), KEY_LIGHT_COLOR);
-    UCreateLightSource(fillLight, glm::vec3(5.5f, -1.0f, 0.0f), FILL_LIGHT_COLOR);
-
-    vector<GLfloat> pyramidVertices = {
-        // Vertex Positions    // Colors (r,g,b,a)
-       0.0f,  0.5f, 0.0f,    1.0f, 0.5f, 0.0f, 1.0f, // Top Vertex 0 (apex)
-      -0.5f, -1.2f, 0.5f,    1.0f, 0.5f, 0.0f, 1.0f, // Bottom-left Vertex 1
-       0.5f, -1.2f, 0.5f,    1.0f, 0.5f, 0.0f, 1.0f, // Bottom-right Vertex 2
-
-       0.0f,  0.5f, 0.0f,    1.0f, 0.5f, 0.0f, 1.0f, // Top Vertex 3 (apex)
-       0.5f, -1.2f, 0.5f,    1.0f, 0.5f, 0.0f, 1.0f, // Bottom-right Vertex 4
-       0.5f, -1.2f, -0.5f,   1.0f, 0.5f, 0.0f, 1.0f, // Bottom-left Vertex 5
-
-       0.0f,  0.5f, 0.0f,    1.0f, 0.5f, 0.0f, 1.0f, // Top Vertex 6 (apex)
-       0.5f, -1.2f, -0.5f,   1.0f, 0.5f, 0.0f, 1.0f, // Bottom-right Vertex 7
-      -0.5f, -1.2f, -0.5f,   1.0f, 0.5f, 0.0f, 1.0f, // Bottom-left Vertex 8
-
-       0.0f,  0.5f, 0.0f,    1.0f, 0.5f, 0.0f, 1.0f, // Top Vertex 9 (apex)
-      -0.5f, -1.2f, -0.5f,   1.0f, 0.5f, 0.0f, 1.0f, // Bottom-left Vertex 10
-      -0.5f, -1.2f, 0.5f,    1.0f, 0.5f, 0.0f, 1.0f  // Bottom-right Vertex 11
-    };
-
-    vector<GLushort> pyramidIndices = {
-        0, 1, 2, // Right face
-        3, 4, 5, // Back face
-        6, 7, 8, // Left face
-        9, 10, 11, // Front face
-
-        // Base of the pyramid (two triangles)
-        1, 2, 5,
-        2, 5, 8
-    };
-
-    vector<GLfloat> sphereVertices;
-    vector<GLushort> sphereIndices;
-    const int numStacks = 20;
-    const int numSlices = 20;
-    const float radius = 0.5f;
-
-    // Create sphere vertices and indices
-    for (int i = 0; i <= numStacks; ++i) {
-        float phi = glm::pi<float>() * static_cast<float>(i) / numStacks;
-        for (int j = 0; j <= numSlices; ++j) {
-            float theta = 2 * glm::pi<float>() * static_cast<float>(j) / numSlices;
-
-            float x = radius * sin(phi) * cos(theta);
-            float y = radius * cos(phi);
-            float z = radius * sin(phi) * sin(theta);
-
-            float r = 1.0f; // Orange color
-            float g = 0.5f; // Orange color
-            float b = 0.0f; // Orange color
-
-            sphereVertices.push_back(x);
-            sphereVertices.push_back(y);
-            sphereVertices.push_back(z);
-            sphereVertices.push_back(r);
-            sphereVertices.push_back(g);
-            sphereVertices.push_back(b);
-            sphereVertices.push_back(1.0f);
-        }
-    }
-
-    //NOTE: ALL MY TEXTURE MAPPING IS INCORRECT. I CANNOT FIGURE OUT HOW TO MAP IT WITHOUT STRETCHING. 
-
-    // Create sphere indices
-    for (int i = 0; i < numStacks; ++i) {
-        for (int j = 0; j < numSlices; ++j) {
-            int first = i * (numSlices + 1) + j;
-            int second = first + numSlices + 1;
-
-            sphereIndices.push_back(static_cast<GLushort>(first));
-            sphereIndices.push_back(static_cast<GLushort>(second));
-            sphereIndices.push_back(static_cast<GLushort>(first + 1));
-
-            sphereIndices.push_back(static_cast<GLushort>(second));
-            sphereIndices.push_back(static_cast<GLushort>(second + 1));
-            sphereIndices.push_back(static_cast<GLushort>(first + 1));
-        }
-    }
-
-    // Plane vertices
-    vector<GLfloat> planeVertices = {
-        // Positions          // Colors
-         5.0f,  0.0f,  5.0f,   1.0f, 1.0f, 1.0f, 1.0f,  // Top Right
-         5.0f,  0.0f, -5.0f,   1.0f, 1.0f, 1.0f, 1.0f,  // Bottom Right
-        -5.0f,  0.0f, -5.0f,   1.0f, 1.0f, 1.0f, 1.0f,  // Bottom Left
-        -5.0f,  0.0f,  5.0f,   1.0f, 1.0f, 1.0f, 1.0f   // Top Left 
-    };
-
-
-    vector<GLushort> planeIndices = {
-        0, 1, 3,  // First Triangle
-        1, 2, 3   // Second Triangle
-
-    };
-
-    // Torus vertices and indices
-    vector<GLfloat> torusVertices;
-    vector<GLushort> torusIndices;
-
-    const int numCirclePoints = 10;  // Number of points for the small circle
-    const int numCircles = 10;       // Number of circles
-    const GLfloat R = 1.0f;          // Big circle radius
-    const GLfloat r = 0.25f;          // Small circle radius
-
-    // Generate the torus
-    for (int i = 0; i < numCircles; ++i) {
-        GLfloat phi = 2.0f * M_PI * i / numCircles;
-        for (int j = 0; j < numCirclePoints; ++j) {
-            GLfloat theta = 2.0f * M_PI * j / numCirclePoints;
-
-            GLfloat x = (R + r * cos(theta)) * cos(phi);
-            GLfloat y = r * sin(theta);
-            GLfloat z = (R + r * cos(theta)) * sin(phi);
-
-            torusVertices.push_back(x);
-            torusVertices.push_back(y);
-            torusVertices.push_back(z);
-            torusVertices.push_back(0.3f);  // Color
-            torusVertices.push_back(0.3f);
-            torusVertices.push_back(0.3f);
-            torusVertices.push_back(1.0f);
-        }
-    }
-
-    // Generate the indices for the torus
-    for (int i = 0; i < numCircles; ++i) {
-        for (int j = 0; j < numCirclePoints; ++j) {
-            int nextCircle = (i + 1) % numCircles;
-            int nextPoint = (j + 1) % numCirclePoints;
-
-            int currentPoint = i * numCirclePoints + j;
-            int adjacentPoint = i * numCirclePoints + nextPoint;
-            int belowPoint = nextCircle * numCirclePoints + j;
-            int diagonalPoint = nextCircle * numCirclePoints + nextPoint;
-
-            // First triangle
-            torusIndices.push_back(currentPoint);
-            torusIndices.push_back(belowPoint);
-            torusIndices.push_back(adjacentPoint);
-
-            // Second triangle
-            torusIndices.push_back(adjacentPoint);
-            torusIndices.push_back(belowPoint);
-            torusIndices.push_back(diagonalPoint);
-        }
-    }
-
-
-    // add the cube
-    GLfloat l = 2.0f; // length
-    GLfloat w = 2.0f; // width
-    GLfloat h = 1.0f; // height (smaller than length and width)
-
-    vector<GLfloat> cubeVertices = {
-        // Positions          // Colors
-        l / 2, -h / 2,  w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  // Top Right Front
-        l / 2, -h / 2, -w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  // Top Right Back
-       -l / 2, -h / 2, -w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  // Top Left Back
-       -l / 2, -h / 2,  w / 2,   0.1f, 0.1f, 0.f, 1.0f,  // Top Left Front
-        l / 2,  h / 2,  w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  // Bottom Right Front
-        l / 2,  h / 2, -w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  // Bottom Right Back
-       -l / 2,  h / 2, -w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  // Bottom Left Back
-       -l / 2,  h / 2,  w / 2,   0.1f, 0.1f, 0.3f, 1.0f   // Bottom Left Front 
-    };
-
-    vector<GLushort> cubeIndices = {
-        0, 1, 5,  0, 5, 4,  // Front face
-        1, 2, 6,  1, 6, 5,  // Right face
-        2, 3, 7,  2, 7, 6,  // Back face
-        3, 0, 4,  3, 4, 7,  // Left face
-        4, 5, 6,  4, 6, 7,  // Bottom face
-        3, 2, 1,  3, 1, 0   // Top face
-    };
-
-    const int cylinderSegments = 32;
-    const float cylinderHeight = 1.0f;
-    const float cylinderRadius = 0.5f;
-
-    // Cylinder Vertices
-    vector<GLfloat> cylinderVertices;
-
-    // vertices for the top and bottom circles and the side
-    for (int i = 0; i < cylinderSegments; i++)
-    {
-        float theta = (float)i / cylinderSegments * 2.0f * M_PI;
-        float x = cylinderRadius * cos(theta);
-        float z = cylinderRadius * sin(theta);
-
-        // Top circle vertex
-        cylinderVertices.push_back(x);                          // x
-        cylinderVertices.push_back(cylinderHeight / 2);         // y
-        cylinderVertices.push_back(z);                          // z
-        // Color (Royal Blue)
-        cylinderVertices.push_back(0.254f);
-        cylinderVertices.push_back(0.412f);
-        cylinderVertices.push_back(0.882f);
-        cylinderVertices.push_back(1.0f);
-
-        // Bottom circle vertex
-        cylinderVertices.push_back(x);                          // x
-        cylinderVertices.push_back(-cylinderHeight / 2);        // y
-        cylinderVertices.push_back(z);                          // z
-        // Color (Royal Blue)
-        cylinderVertices.push_back(0.254f); 
-        cylinderVertices.push_back(0.412f); 
-        cylinderVertices.push_back(0.882f); 
-        cylinderVertices.push_back(1.0f); 
-    }
-
-    // Center vertex for top circle
-    cylinderVertices.push_back(0.0f);                  // x
-    cylinderVertices.push_back(cylinderHeight / 2);    // y
-    cylinderVertices.push_back(0.0f);                  // z
-    // Color
-    cylinderVertices.push_back(0.254f); 
-    cylinderVertices.push_back(0.412f); 
-    cylinderVertices.push_back(0.882f); 
-    cylinderVertices.push_back(1.0f); 
-
-    // Center vertex for bottom circle
-    cylinderVertices.push_back(0.0f);                  // x
-    cylinderVertices.push_back(-cylinderHeight / 2);   // y
-    cylinderVertices.push_back(0.0f);                  // z
-    // Color
-    cylinderVertices.push_back(0.254f); 
-    cylinderVertices.push_back(0.412f); 
-    cylinderVertices.push_back(0.882f); 
-    cylinderVertices.push_back(1.0f); 
-
-    // Cylinder Indices
-    std::vector<GLushort> cylinderIndices;
-
-    // Indices for the side of the cylinder
-    for (int i = 0; i < cylinderSegments; i++)
-    {
-        cylinderIndices.push_back(i * 2);
-        cylinderIndices.push_back((i * 2) + 1);
-        cylinderIndices.push_back(((i + 1) * 2) % (cylinderSegments * 2));
-
-        cylinderIndices.push_back(((i + 1) * 2) % (cylinderSegments * 2));
-        cylinderIndices.push_back((i * 2) + 1);
-        cylinderIndices.push_back(((i + 1) * 2 + 1) % (cylinderSegments * 2));
-    }
+    if (!UInitialize(argc, argv, &gWindow))
+        return EXIT_FAILURE;
 
-    // Indices for the top of the cylinder
-    GLushort topCenterIndex = cylinderSegments * 2;  // Index of the top center vertex
-    for (int i = 0; i < cylinderSegments; i++)
-    {
-        cylinderIndices.push_back(topCenterIndex);
-        cylinderIndices.push_back(i * 2);
-        cylinderIndices.push_back((i * 2 + 2) % (cylinderSegments * 2));
-    }
+    // Programs linked on an earlier run load as driver binaries instead of being compiled again,
+    // and the rest compile on the driver's own threads where it has them
+    double startupStart = glfwGetTime();
+    if (!UEnableShaderCache(SHADER_CACHE_DIRECTORY))
+        cout << "INFO: Program binaries unsupported, compiling every shader from source" << endl;
+    if (!UEnableParallelShaderCompile())
+        cout << "INFO: Parallel shader compilation unsupported, compiling one program at a time" << endl;
 
-    // Indices for the bottom of the cylinder
-    GLushort bottomCenterIndex = topCenterIndex + 1; // Index of the bottom center vertex
-    for (int i = 0; i < cylinderSegments; i++)
-    {
-        cylinderIndices.push_back(bottomCenterIndex);
-        cylinderIndices.push_back(i * 2 + 1);
-        cylinderIndices.push_back((i * 2 + 3) % (cylinderSegments * 2));
-    }
+    SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT];
+    UBuildSceneMeshes(meshes);
 
     // Load the texture
     int width, height, numComponents;
-    unsigned char* textureData = stbi_load("wood_texture.jpg", &width, &height, &numComponents, 0);
+    unsigned char* textureData = stbi_load(USceneTexturePath(TEXTURE_WOOD), &width, &height, &numComponents, 0);
 
     // Create and bind texture object
-    glGenTextures(1, &woodTexture);
-    glBindTexture(GL_TEXTURE_2D, woodTexture);
+    glGenTextures(1, &gTextures[TEXTURE_WOOD]);
+    glBindTexture(GL_TEXTURE_2D, gTextures[TEXTURE_WOOD]);
 
     // Set texture parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -476,11 +296,11 @@ int main(int argc, char* argv[])
     stbi_image_free(textureData);
 
     // Load the sponge texture
-    unsigned char* spongeData = stbi_load("sponge_texture.jpg", &width, &height, &numComponents, 0);
+    unsigned char* spongeData = stbi_load(USceneTexturePath(TEXTURE_SPONGE), &width, &height, &numComponents, 0);
 
     // Create and bind sponge texture object
-    glGenTextures(1, &spongeTexture); 
-    glBindTexture(GL_TEXTURE_2D, spongeTexture); 
+    glGenTextures(1, &gTextures[TEXTURE_SPONGE]); 
+    glBindTexture(GL_TEXTURE_2D, gTextures[TEXTURE_SPONGE]); 
 
     // Set sponge texture parameters
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); 
@@ -501,10 +321,10 @@ int main(int argc, char* argv[])
     stbi_image_free(spongeData);
 
     // load blue container
-    unsigned char* blueContainerData = stbi_load("bluecontainer_texture.jpg", &width, &height, &numComponents, 0);
+    unsigned char* blueContainerData = stbi_load(USceneTexturePath(TEXTURE_BLUECONTAINER), &width, &height, &numComponents, 0);
 
-    glGenTextures(1, &bluecontainerTexture);  
-    glBindTexture(GL_TEXTURE_2D, bluecontainerTexture);  
+    glGenTextures(1, &gTextures[TEXTURE_BLUECONTAINER]);  
+    glBindTexture(GL_TEXTURE_2D, gTextures[TEXTURE_BLUECONTAINER]);  
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); 
@@ -522,41 +342,133 @@ int main(int argc, char* argv[])
     }
     stbi_image_free(blueContainerData); 
 
-    // Create the pyramid mesh
-    UCreateMesh(gMeshPyramid, pyramidVertices, pyramidIndices);
+    vector<GLuint> lightmaps;
+    ULoadLightmaps(meshes, lightmaps);
+    ULoadLightProbes();
 
-    // Create the sphere mesh
-    UCreateMesh(gMeshSphere, sphereVertices, sphereIndices);
+    // Storage for the light buffers is (re)allocated every frame in UUpdateLightBuffers, and for the
+    // draw data on every replay
+    glGenBuffers(3, gLightBuffers);
+    glGenBuffers(1, &gDrawDataBuffer);
 
-    // Create the plane mesh
-    UCreateMesh(gMeshPlane, planeVertices, planeIndices);
+    // Shadows are optional too; without them the key light simply lights everything
+    gShadowsAvailable = UCreateShadowMap(gKeyLightShadow, SHADOW_MAP_SIZE);
+    if (!gShadowsAvailable)
+        cout << "INFO: Shadow maps unavailable, rendering without shadows" << endl;
 
-    // Create the torus mesh
-    UCreateMesh(gMeshTorus, torusVertices, torusIndices);
+    // Materials pick their shader variant from the lightmaps, probes and shadows, so the entities come after them
+    UCreateSceneEntities(lightmaps);
 
-    // Create the cube mesh
-    UCreateMesh(gMeshCube, cubeVertices, cubeIndices);
+    // Every shader variant the scene draws with is known now (lightmaps, probes and shadows decide
+    // them), so submit them all before waiting on any, and upload the meshes while they compile
+    if (!ULoadShaderVariants(gSceneShaders, "scene.vert", "scene.frag"))
+        return EXIT_FAILURE;
+    // The tessellation path is optional; the prebuilt meshes stand in for it
+    bool tessellationLoaded = UCreateTessellatedShapes("scene.frag", meshes);
+    UForEachEntity<MeshRef, Material>(gEntities, [tessellationLoaded](Entity, const MeshRef& mesh, const Material& material)
+        {
+            URequestShaderVariant(gSceneShaders, material.features);
+            if (tessellationLoaded && UTessellates(mesh, material))
+                URequestTessellationProgram(material.features);
+        });
 
-    // Create the cylinder mesh
-    UCreateMesh(gMeshCylinder, cylinderVertices, cylinderIndices);
+    // Create the pyramid, sphere, plane, torus, cube and cylinder meshes, every level of detail,
+    // then the light cube; keep only what culling and LOD selection need of each, not the vertex data
+    SceneMeshData lightCube;
+    UBuildLightSourceMesh(lightCube);
+    for (uint32_t slot = 0; slot <= LIGHT_CUBE_SLOT; slot++)
+    {
+        SceneMeshId id = static_cast<SceneMeshId>(slot / SCENE_LOD_COUNT);
+        int lod = slot % SCENE_LOD_COUNT;
+        if (slot < LIGHT_CUBE_SLOT && lod >= USceneLodCount(id))
+            continue;
+
+        const SceneMeshData& data = slot == LIGHT_CUBE_SLOT ? lightCube : meshes[id][lod];
+        if (slot == LIGHT_CUBE_SLOT)
+            UCreateMesh(gMeshes[slot], data, 3, UPositionVertexFormat());
+        else
+            UCreateMesh(gMeshes[slot], data, SCENE_VERTEX_FLOATS,
+                data.lightmapWidth > 0 ? ULightmappedVertexFormat() : UCompactVertexFormat());
+
+        gMeshBounds[slot].boundsCenter = data.boundsCenter;
+        gMeshBounds[slot].boundsRadius = data.boundsRadius;
+        gMeshBounds[slot].segments = data.segments;
+    }
 
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+    while (UPollShaderVariants(gSceneShaders) + UPollTessellationPrograms() > 0)
+        this_thread::sleep_for(chrono::milliseconds(1));
+
+    // The scene can't be drawn without its own programs
+    gTessellationAvailable = tessellationLoaded;
+    bool programsBuilt = true;
+    UForEachEntity<MeshRef, Material>(gEntities, [&programsBuilt](Entity, const MeshRef& mesh, const Material& material)
+        {
+            if (UShaderVariant(gSceneShaders, material.features) == 0)
+                programsBuilt = false;
+            if (UTessellates(mesh, material) && UTessellationProgram(material.features) == 0)
+                gTessellationAvailable = false;
+        });
+    if (!programsBuilt)
         return EXIT_FAILURE;
+    if (!gTessellationAvailable)
+        cout << "INFO: Tessellation shaders unavailable, using prebuilt meshes" << endl;
+
+    ShaderCacheStats shaderStats = UShaderCacheStats();
+    cout << "INFO: Scene ready in " << (glfwGetTime() - startupStart) * 1000.0 << " ms (shader programs: "
+        << shaderStats.loaded << " from cache, " << shaderStats.compiled << " compiled)" << endl;
 
+    // Editing a file under shaders/ rebuilds the programs that use it without stopping the frame loop
+    if (UStartShaderHotReload(gWindow))
+        cout << "INFO: Watching " << SHADER_DIRECTORY << "/ for changes" << endl;
+    else
+        cout << "INFO: Shader hot reload unavailable, restart to pick up shader changes" << endl;
+
+    gCurrentState.cameraPosition = cameraPosition;
+    gPreviousState = gCurrentState;
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    UStartFramePacing(pacing, gFramePacer);
+    gDrawEveryFrame = !pacing.idle;
     while (!glfwWindowShouldClose(gWindow))
     {
+        UWaitForNextFrame(gFramePacer);
+        glfwPollEvents();
+        if (UApplyShaderReloads())
+            UMarkFrameDirty();
         UProcessInput(gWindow);
+        USimulate();
+
+        // The frame on screen still shows the scene: sleep until an event arrives (a finished shader
+        // reload posts one) or the shader files are due to be checked again
+        if (!UTakeFrameChanges())
+        {
+            glfwWaitEventsTimeout(FRAME_IDLE_TIMEOUT);
+            UPauseFixedStep(gSimulationClock); // the simulation isn't owed the time spent waiting
+            continue;
+        }
         URender();
-        glfwPollEvents();
     }
 
-    UDestroyMesh(gMeshPyramid);
-    UDestroyMesh(gMeshSphere);
-    UDestroyMesh(gMeshPlane);
-    UDestroyMesh(gMeshTorus);
-    UDestroyShaderProgram(gProgramId);
+    UStopFramePacing(gFramePacer);
+    UStopShaderHotReload();
+    for (GLMesh& mesh : gMeshes)
+    {
+        if (mesh.vao != 0)
+            UDestroyMesh(mesh);
+    }
+    UDestroyTessellatedShapes();
+    UDestroyShaderVariants(gSceneShaders);
+    glDeleteBuffers(3, gLightBuffers);
+    glDeleteBuffers(1, &gDrawDataBuffer);
+    if (gShadowsAvailable)
+        UDestroyShadowMap(gKeyLightShadow);
+    UForEachEntity<Material>(gEntities, [](Entity, const Material& material)
+        {
+            if (material.lightmap != 0)
+                glDeleteTextures(1, &material.lightmap);
+        });
+    if (gProbeTexture != 0)
+        glDeleteTextures(1, &gProbeTexture);
 
     exit(EXIT_SUCCESS);
 }
@@ -581,6 +493,8 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     }
     glfwMakeContextCurrent(*window);
     glfwSetFramebufferSizeCallback(*window, UResizeWindow);
+    // Exposed or damaged windows need drawing again even in idle mode
+    glfwSetWindowRefreshCallback(*window, [](GLFWwindow*) { UMarkFrameDirty(); });
 
     glewExperimental = GL_TRUE;
     GLenum GlewInitResult = glewInit();
@@ -641,133 +555,190 @@ void UProcessInput(GLFWwindow* window)
     if (pKeyPressed && !pKeyLastState)  // If P is currently pressed and was not pressed last frame 
         isPerspective = !isPerspective;  // Toggle the projection mode 
     pKeyLastState = pKeyPressed; // Update the last state 
-}
 
-void UCreateLightSource(LightSource& light, const glm::vec3& position, const glm::vec3& color)
-{
-    light.position = position;
-    light.color = color;
-
-    float size = 1.0f;
-    GLfloat verts[] = {
-        // front
-        -size, -size, size,
-        size, -size, size,
-        size, size, size,
-        -size, size, size,
-
-        // back
-        size, -size, -size,
-        -size, -size, -size,
-        -size, size, -size,
-         size, size, -size,
-
-         // right
-         size, -size, size,
-         size, -size, -size,
-         size, size, -size,
-         size, size, size,
-
-         // left
-         -size, -size, -size,
-         -size, -size, size,
-         -size, size, size,
-         -size, size, -size,
-
-         // top
-         -size, size, size,
-         size, size, size,
-         size, size, -size,
-         -size, size, -size,
-
-         // bottom
-         -size, -size, -size,
-         size, -size, -size,
-         size, -size, size,
-         -size, -size, size
-    };
+    bool tKeyPressed = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (tKeyPressed && !tKeyLastState && gTessellationAvailable)
+        gUseTessellation = !gUseTessellation;
+    tKeyLastState = tKeyPressed;
 
-    GLushort indices[] = {
-        0, 1, 2, 2, 3, 0, // Front
-        4, 5, 6, 6, 7, 4, // Back
-        8, 9, 10, 10, 11, 8, // Right
-        12, 13, 14, 14, 15, 12, // Left
-        16, 17, 18, 18, 19, 16, // Top
-        20, 21, 22, 22, 23, 20 // Bottom
-    };
-
-    glGenVertexArrays(1, &light.mesh.vao);
-    glBindVertexArray(light.mesh.vao);
-
-    glGenBuffers(2, light.mesh.vbos);
-    glBindBuffer(GL_ARRAY_BUFFER, light.mesh.vbos[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-
-    light.mesh.nIndices = sizeof(indices) / sizeof(indices[0]);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, light.mesh.vbos[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-    GLint stride = sizeof(float) * 3;
+    bool lKeyPressed = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    if (lKeyPressed && !lKeyLastState)
+    {
+        gShowLightField = !gShowLightField;
+        cout << "INFO: Light field " << (gShowLightField ? "on" : "off") << endl;
+    }
+    lKeyLastState = lKeyPressed;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+    // A held movement key moves the camera on the next simulation step, which may not be this frame's
+    const int movementKeys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_Q, GLFW_KEY_E };
+    for (int key : movementKeys)
+    {
+        if (glfwGetKey(window, key) == GLFW_PRESS)
+            UMarkFrameDirty();
+    }
+}
 
-    light.model = glm::translate(position) * glm::scale(glm::vec3(0.2f));
+void UMarkFrameDirty()
+{
+    gFrameDirty = true;
 }
 
-void UDestroyLightSource(LightSource& light)
+// Whether this frame needs drawing; if so, its inputs become the ones on screen
+bool UTakeFrameChanges()
 {
-    glDeleteVertexArrays(1, &light.mesh.vao);
-    glDeleteBuffers(2, light.mesh.vbos);
+    FrameInputs inputs;
+    inputs.cameraPosition = cameraPosition;
+    inputs.cameraFront = cameraFront;
+    inputs.perspective = isPerspective;
+    inputs.tessellation = gUseTessellation;
+    inputs.lightField = gShowLightField;
+
+    // The light field moves every frame it is shown
+    bool changed = gFrameDirty || gDrawEveryFrame || inputs.lightField
+        || inputs.cameraPosition != gDrawnFrame.cameraPosition || inputs.cameraFront != gDrawnFrame.cameraFront
+        || inputs.perspective != gDrawnFrame.perspective || inputs.tessellation != gDrawnFrame.tessellation
+        || inputs.lightField != gDrawnFrame.lightField;
+    if (changed)
+    {
+        gDrawnFrame = inputs;
+        gFrameDirty = false;
+    }
+    return changed;
 }
 
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
+    UMarkFrameDirty();
     glViewport(0, 0, width, height);
 }
 
-void UpdateCameraPosition(GLFWwindow* window, float deltaTime)
+void UpdateCameraPosition(GLFWwindow* window, float deltaTime, glm::vec3& position)
 {
     const float cameraSpeed = 2.5f * deltaTime;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        cameraPosition += cameraSpeed * cameraFront;
+        position += cameraSpeed * cameraFront;
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        cameraPosition -= cameraSpeed * cameraFront;
+        position -= cameraSpeed * cameraFront;
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        cameraPosition -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+        position -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        cameraPosition += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+        position += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        cameraPosition += cameraSpeed * cameraUp;
+        position += cameraSpeed * cameraUp;
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        cameraPosition -= cameraSpeed * cameraUp;
+        position -= cameraSpeed * cameraUp;
+}
+
+// Runs the fixed steps this frame owes, then blends the last two states into what gets drawn.
+// Mouse look stays outside the simulation: it is applied as events arrive, for the least latency.
+void USimulate()
+{
+    const float step = float(gSimulationClock.step);
+    int steps = UAdvanceFixedStep(gSimulationClock, glfwGetTime());
+    for (int i = 0; i < steps; i++)
+    {
+        gPreviousState = gCurrentState;
+        UpdateCameraPosition(gWindow, step, gCurrentState.cameraPosition);
+        gCurrentState.seconds += gSimulationClock.step;
+    }
+
+    float alpha = UFixedStepAlpha(gSimulationClock);
+    cameraPosition = glm::mix(gPreviousState.cameraPosition, gCurrentState.cameraPosition, alpha);
+
+    // Nodes moved this frame, and everything below them, get their world matrices updated and the frame redrawn
+    if (UUpdateSceneGraph(gSceneGraph) > 0)
+    {
+        UUpdateBounds();
+        UMarkFrameDirty();
+    }
 }
 
+// Creates an entity for each scene object, then one for each light and one for the cube drawn at it
+void UCreateSceneEntities(const vector<GLuint>& lightmaps)
+{
+    const vector<SceneObject>& objects = USceneObjects();
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const SceneObject& object = objects[i];
+        Transform transform = { UAddSceneNode(gSceneGraph, object.transform) };
+        MeshRef mesh = { object.mesh, uint32_t(object.mesh) * SCENE_LOD_COUNT, uint32_t(USceneLodCount(object.mesh)), LodSelection() };
+        Material material = { gTextures[object.texture], lightmaps[i], USceneFeatures(lightmaps[i]), glm::vec3(1.0f), true };
+        UCreateEntity(gEntities, transform, mesh, material, Bounds());
+    }
 
-void UCreateMesh(GLMesh& mesh, const vector<GLfloat>& vertices, const vector<GLushort>& indices)
+    SceneTransform cubeSize;
+    cubeSize.scale = glm::vec3(LIGHT_SOURCE_SCALE);
+    const MeshRef cubeMesh = { -1, LIGHT_CUBE_SLOT, 1, LodSelection() };
+    const Material cubeMaterial = { 0, 0, SHADER_UNLIT, LIGHT_SOURCE_COLOR, false };
+    for (const PointLight& light : USceneLights())
+    {
+        SceneTransform placement;
+        placement.position = light.position;
+        Transform transform = { UAddSceneNode(gSceneGraph, placement) };
+        Light source = { light.color, light.radius, light.baked };
+        Entity entity = UCreateEntity(gEntities, transform, source);
+        if (gKeyLight == ENTITY_NONE)
+            gKeyLight = entity;
+
+        Transform cube = { UAddSceneNode(gSceneGraph, cubeSize, transform.node) };
+        UCreateEntity(gEntities, cube, cubeMesh, cubeMaterial, Bounds());
+    }
+}
+
+// Moves every bounding sphere to its node's world matrix; run after the scene graph changes
+void UUpdateBounds()
 {
+    UParallelForEachEntity<Transform, MeshRef, Bounds>(gEntities, [](Entity, const Transform& transform, const MeshRef& mesh, Bounds& bounds)
+        {
+            UWorldBounds(gMeshBounds[mesh.firstLod], USceneNodeWorld(gSceneGraph, transform.node), bounds.center, bounds.radius);
+        });
+}
+
+// Whether the entity is drawn by the tessellation programs when they are on. Lightmap coordinates
+// only exist on the finest prebuilt level, so a lightmapped shape stays on the prebuilt meshes.
+bool UTessellates(const MeshRef& mesh, const Material& material)
+{
+    return mesh.shape >= 0 && UIsTessellatedMesh(static_cast<SceneMeshId>(mesh.shape)) && material.lightmap == 0;
+}
+
+
+// Packs `data` into `format` and uploads it; the attribute pointers come straight from the format
+void UCreateMesh(GLMesh& mesh, const SceneMeshData& data, int sourceStride, const VertexFormat& format)
+{
+    vector<uint8_t> packed;
+    UPackVertices(data, sourceStride, format, packed, mesh.quantization);
+
     glGenVertexArrays(1, &mesh.vao);
     glBindVertexArray(mesh.vao);
 
     glGenBuffers(2, mesh.vbos);
 
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbos[0]);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
 
-    mesh.nIndices = static_cast<GLuint>(indices.size());
+    mesh.nIndices = static_cast<GLuint>(data.indices.size());
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbos[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(GLushort), data.indices.data(), GL_STATIC_DRAW);
 
-    GLint stride = sizeof(float) * 7;
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 3));
-    glEnableVertexAttribArray(1);
+    for (const VertexAttribute& attribute : format.attributes)
+    {
+        VertexEncodingInfo info = UEncodingInfo(attribute.encoding);
+        glVertexAttribPointer(attribute.location, info.components, UComponentGLType(info.type),
+            info.normalized ? GL_TRUE : GL_FALSE, format.stride, (char*)(size_t)attribute.offset);
+        glEnableVertexAttribArray(attribute.location);
+    }
+}
 
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 6)); // Set up texture coordinate attribute
-    glEnableVertexAttribArray(2);
+GLenum UComponentGLType(VertexComponentType type)
+{
+    switch (type)
+    {
+    case COMPONENT_HALF: return GL_HALF_FLOAT;
+    case COMPONENT_SNORM16: return GL_SHORT;
+    case COMPONENT_UNORM8: return GL_UNSIGNED_BYTE;
+    case COMPONENT_SNORM8: return GL_BYTE;
+    default: return GL_FLOAT;
+    }
 }
 
 void UDestroyMesh(GLMesh& mesh)
@@ -778,224 +749,328 @@ void UDestroyMesh(GLMesh& mesh)
 
 void URender()
 {
-    static double lastTime = glfwGetTime();
-    double currentTime = glfwGetTime();
-    float deltaTime = float(currentTime - lastTime);
-    lastTime = currentTime;
-
     glEnable(GL_DEPTH_TEST);
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    UpdateCameraPosition(gWindow, deltaTime);
+    SceneCamera camera = { cameraPosition, cameraFront, cameraUp, isPerspective };
+    glm::mat4 view = USceneView(camera);
+    glm::mat4 projection = USceneProjection(isPerspective, (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT);
 
-    glm::mat4 scale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
-    glm::mat4 rotation = glm::rotate(90.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    glm::mat4 translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    glm::mat4 model = translation * rotation * scale;
+    double seconds = gPreviousState.seconds + (gCurrentState.seconds - gPreviousState.seconds) * UFixedStepAlpha(gSimulationClock);
+    UUpdateLightBuffers(view, projection, float(seconds));
 
-    glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + cameraFront, cameraUp);
-    //glm::mat4 projection = glm::perspective(45.0f, (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-
-    glm::mat4 projection;
-    if (isPerspective)
+    // The shadow pass draws into its own framebuffer, so the main viewport is restored afterwards
+    if (gShadowsAvailable)
     {
-        projection = glm::perspective(45.0f, (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        URenderShadowMap(gKeyLightShadow, view, projection);
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+        glViewport(0, 0, framebufferWidth, framebufferHeight);
     }
-    else
-    {
-        float orthoScale = 5.0f;  // This controls how "zoomed out" your orthographic view is
-        projection = glm::ortho(-orthoScale * ((GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT),
-            orthoScale * ((GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT),
-            -orthoScale,
-            orthoScale,
-            0.1f,
-            100.0f);
 
+    // The draws are recorded on the job workers without touching GL. A variant nobody had used
+    // yet can only be built here, so the frame is recorded again once it has been.
+    URecordSceneDraws(view, projection);
+    if (!gMissingVariants.empty())
+    {
+        for (const pair<bool, unsigned>& variant : gMissingVariants)
+        {
+            if (variant.first)
+                UTessellationProgram(variant.second);
+            else
+                UShaderVariant(gSceneShaders, variant.second);
+        }
+        URecordSceneDraws(view, projection);
     }
 
-    // Update the position of the key and fill lights based on their current model matrix
-    keyLight.position = glm::vec3(keyLight.model[3][0], keyLight.model[3][1], keyLight.model[3][2]);
-    fillLight.position = glm::vec3(fillLight.model[3][0], fillLight.model[3][1], fillLight.model[3][2]);
-
-    glUseProgram(gProgramId);
-
-    GLint viewPosLoc = glGetUniformLocation(gProgramId, "viewPosition"); 
-    glUniform3fv(viewPosLoc, 1, glm::value_ptr(cameraPosition)); 
-
-    GLint shininessLoc = glGetUniformLocation(gProgramId, "shininess"); 
-    glUniform1f(shininessLoc, 32.0f);  // Adjust this value as desired, higher values mean smaller, sharper highlights
-
-    // Set uniforms for using a uniform color
-    GLint useUniformColorLoc = glGetUniformLocation(gProgramId, "useUniformColor"); 
-    GLint uniformColorLoc = glGetUniformLocation(gProgramId, "uniformColor"); 
-    glUniform1i(useUniformColorLoc, GL_FALSE);  // Perform lighting calculations  
-
-    glm::vec3 ambientLight = glm::vec3(0.3, 0.3, 0.3);  // Soft general light
-    GLint ambientLightColorLoc = glGetUniformLocation(gProgramId, "ambientLightColor");
-    glUniform3fv(ambientLightColorLoc, 1, glm::value_ptr(ambientLight));
-
-
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    GLint keyLightPosLoc = glGetUniformLocation(gProgramId, "keyLightPosition");
-    GLint keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    GLint fillLightPosLoc = glGetUniformLocation(gProgramId, "fillLightPosition");
-    GLint fillLightColorLoc = glGetUniformLocation(gProgramId, "fillLightColor");
+    // Every program drawn with gets the shared scene uniforms once, then the commands replay in
+    // the order the entities were walked
+    vector<GLuint> preparedPrograms;
+    for (const CommandBuffer& commands : gDrawCommands)
+    {
+        for (GLuint programId : commands.programs)
+        {
+            if (find(preparedPrograms.begin(), preparedPrograms.end(), programId) != preparedPrograms.end())
+                continue;
+            glUseProgram(programId);
+            USetSceneUniforms(programId, view, projection);
+            preparedPrograms.push_back(programId);
+        }
+    }
+    UReplayCommandBuffers(gDrawCommands.data(), gDrawCommands.size(), gDrawDataBuffer, DRAW_DATA_BINDING);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    // Set the uniform values for the key and fill lights' positions and colors
-    glUniform3fv(glGetUniformLocation(gProgramId, "keyLightPosition"), 1, glm::value_ptr(keyLight.position));
-    glUniform3fv(glGetUniformLocation(gProgramId, "keyLightColor"), 1, glm::value_ptr(keyLight.color));
-    glUniform3fv(glGetUniformLocation(gProgramId, "fillLightPosition"), 1, glm::value_ptr(fillLight.position));
-    glUniform3fv(glGetUniformLocation(gProgramId, "fillLightColor"), 1, glm::value_ptr(fillLight.color));
+    glfwSwapBuffers(gWindow);
+}
 
-    glUniform1i(useUniformColorLoc, GL_FALSE);
+// Camera, material and light uniforms shared by the scene programs; `programId` must be current
+void USetSceneUniforms(GLuint programId, const glm::mat4& view, const glm::mat4& projection)
+{
+    glUniform3fv(glGetUniformLocation(programId, "viewPosition"), 1, glm::value_ptr(cameraPosition));
+    glUniform1f(glGetUniformLocation(programId, "shininess"), SHININESS);
+    glUniform3fv(glGetUniformLocation(programId, "ambientLightColor"), 1, glm::value_ptr(AMBIENT_LIGHT_COLOR));
 
-    // Bind Wood texture
-    glActiveTexture(GL_TEXTURE0); 
-    glBindTexture(GL_TEXTURE_2D, woodTexture);
+    glUniformMatrix4fv(glGetUniformLocation(programId, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(programId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
-    // Render Plane
-    glm::mat4 planeModel = glm::translate(glm::vec3(0.0f, -2.1f, 0.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(planeModel));
-    glBindVertexArray(gMeshPlane.vao);
-    glDrawElements(GL_TRIANGLES, gMeshPlane.nIndices, GL_UNSIGNED_SHORT, NULL);
-    //glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture
-    glBindVertexArray(0);
+    // Where the fragment shader finds its cluster; the lights themselves are in the light buffers
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+    glm::vec2 sliceScaleBias = UClusterSliceScaleBias();
+    glUniform3ui(glGetUniformLocation(programId, "clusterGrid"), CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+    glUniform2f(glGetUniformLocation(programId, "clusterTileSize"),
+        float(framebufferWidth) / CLUSTER_TILES_X, float(framebufferHeight) / CLUSTER_TILES_Y);
+    glUniform2fv(glGetUniformLocation(programId, "clusterSliceScaleBias"), 1, glm::value_ptr(sliceScaleBias));
 
-    // unbind wood
-    glBindTexture(GL_TEXTURE_2D, 0); 
+    USetShadowUniforms(programId, gShadowsAvailable ? &gKeyLightShadow : nullptr, 0);
 
-    // Bind Sponge texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, spongeTexture);
-
-    // Render Pyramid
-    glm::mat4 pyramidModel = glm::translate(glm::vec3(-2.5f, 0.1f, 0.3f)) *
-        glm::rotate(180.0f, glm::vec3(0.5, 1.0f, 0.0f)) *
-        glm::scale(glm::vec3(1.2f, 1.2f, 1.2f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(pyramidModel));
-    glBindVertexArray(gMeshPyramid.vao);
-    glDrawElements(GL_TRIANGLES, gMeshPyramid.nIndices, GL_UNSIGNED_SHORT, NULL);
-    glBindVertexArray(0);
-
-    // Render Sphere
-    glm::mat4 sphereModel = glm::translate(glm::vec3(-3.6f, -1.1f, 1.0f)) * 
-        glm::rotate(90.0f, glm::vec3(0.0, -1.2f, 1.0f)) *
-        glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(sphereModel)); 
-    glBindVertexArray(gMeshSphere.vao); 
-    glDrawElements(GL_TRIANGLES, gMeshSphere.nIndices, GL_UNSIGNED_SHORT, NULL); 
-    glBindVertexArray(0); 
-
-    glBindTexture(GL_TEXTURE_2D, 0); 
-    // Bind Wood texture
-    glActiveTexture(GL_TEXTURE0); 
-    glBindTexture(GL_TEXTURE_2D, woodTexture); 
-
-    // Render Torus
-    glm::mat4 torusModel = glm::translate(glm::vec3(-0.5f, -1.8f, 4.0f)) *  
-    glm::scale(glm::vec3(0.7f, 0.7f, 0.7f)); 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(torusModel)); 
-    glBindVertexArray(gMeshTorus.vao); 
-    glDrawElements(GL_TRIANGLES, gMeshTorus.nIndices, GL_UNSIGNED_SHORT, NULL); 
-    glBindVertexArray(0); 
-
-    // Render Cube
-    glm::mat4 prismModel = 
-        glm::rotate(glm::radians(0.0f), glm::vec3(1.0f, 0.0f, 0.0f)) *
-        glm::translate(glm::vec3(3.0f, -1.8f, 2.0f)) *
-        glm::scale(glm::vec3(1.5f, 0.5f, 1.5f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(prismModel));
-    glBindVertexArray(gMeshCube.vao);
-    glDrawElements(GL_TRIANGLES, gMeshCube.nIndices, GL_UNSIGNED_SHORT, NULL);
-    glBindVertexArray(0); 
+    glUniform1i(glGetUniformLocation(programId, "lightmap"), LIGHTMAP_TEXTURE_UNIT);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0 + PROBE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_3D, gProbeTexture);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, bluecontainerTexture);
-
-    // Render the cylinder 
-    glm::mat4 cylinderModel = glm::translate(glm::vec3(-1.0f, -0.8f, -1.5f)) *
-    glm::scale(glm::vec3(3.5f, 2.5f, 3.5f));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(cylinderModel)); 
-    glBindVertexArray(gMeshCylinder.vao);   
-    glDrawElements(GL_TRIANGLES, gMeshCylinder.nIndices, GL_UNSIGNED_SHORT, 0);  
-    glBindVertexArray(0);  
-
-    glUniform1i(useUniformColorLoc, GL_TRUE);  // Use the uniform color FOR LIGHTS
-    glm::vec3 whiteColor(1.0f, 1.0f, 1.0f);
-    glUniform3fv(uniformColorLoc, 1, glm::value_ptr(whiteColor));
+    glUniform1i(glGetUniformLocation(programId, "probeTexture"), PROBE_TEXTURE_UNIT);
+    glUniform3fv(glGetUniformLocation(programId, "probeGridMin"), 1, glm::value_ptr(PROBE_GRID_MIN));
+    glUniform3fv(glGetUniformLocation(programId, "probeGridMax"), 1, glm::value_ptr(PROBE_GRID_MAX));
+    glUniform3i(glGetUniformLocation(programId, "probeGridSize"), PROBE_GRID_X, PROBE_GRID_Y, PROBE_GRID_Z);
+}
 
-    // Draw the key light and fill light sources
-    glBindVertexArray(keyLight.mesh.vao);
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(keyLight.model));
-    glDrawElements(GL_TRIANGLES, keyLight.mesh.nIndices, GL_UNSIGNED_SHORT, 0);
+// Feature keys of the cheapest scene shader variant that draws a textured object with `lightmap`
+// (0 for none) correctly
+unsigned USceneFeatures(GLuint lightmap)
+{
+    unsigned features = SHADER_TEXTURED;
+    bool lightmapped = lightmap != 0;
+    if (lightmapped)
+        features |= SHADER_LIGHTMAP;
+    else if (gProbeTexture != 0)
+        features |= SHADER_PROBES;
+
+    // The shadowed key light (light 0) is already in the lightmap when it is baked
+    if (gShadowsAvailable && !(lightmapped && USceneLights()[0].baked > 0.0f))
+        features |= SHADER_SHADOWS;
+    return features;
+}
 
-    glBindVertexArray(fillLight.mesh.vao);
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(fillLight.model));
-    glDrawElements(GL_TRIANGLES, fillLight.mesh.nIndices, GL_UNSIGNED_SHORT, 0);
+// Records the plane, pyramid, sphere, torus, cube and cylinder, then the light cubes in the flat
+// light color, into gDrawCommands a block of entities at a time, skipping anything outside the view
+// and picking each one's level of detail from its size on screen. Each object draws with the
+// smallest shader variant its material needs; variants not built yet are left out and listed in
+// gMissingVariants.
+void URecordSceneDraws(const glm::mat4& view, const glm::mat4& projection)
+{
+    gMissingVariants.clear();
+    gDrawCommands.resize(UEntityBlockCount<Transform, MeshRef, Material, Bounds>(gEntities, DRAW_RECORD_GRAIN));
+    for (CommandBuffer& commands : gDrawCommands)
+        UResetCommandBuffer(commands);
+
+    const ViewFrustum frustum = UExtractFrustum(projection * view);
+    UParallelForEachEntityBlock<Transform, MeshRef, Material, Bounds>(gEntities, [&](size_t block, Entity,
+        const Transform& transform, MeshRef& mesh, const Material& material, const Bounds& bounds)
+        {
+            if (!USphereInFrustum(frustum, bounds.center, bounds.radius))
+                return;
+
+            CommandBuffer& commands = gDrawCommands[block];
+            const glm::mat4& model = USceneNodeWorld(gSceneGraph, transform.node);
+            bool lightmapped = material.lightmap != 0;
+
+            // Tessellated shapes pick their own detail per edge, so they skip LOD selection; if their
+            // variant failed to build they fall back to the prebuilt meshes
+            GLuint programId = 0;
+            bool tessellated = gUseTessellation && UTessellates(mesh, material);
+            if (tessellated && !UFindTessellationProgram(material.features, programId))
+            {
+                lock_guard<mutex> lock(gMissingVariantsMutex);
+                gMissingVariants.push_back(make_pair(true, material.features));
+                return;
+            }
+            tessellated = tessellated && programId != 0;
+            if (!tessellated && !UFindShaderVariant(gSceneShaders, material.features, programId))
+            {
+                lock_guard<mutex> lock(gMissingVariantsMutex);
+                gMissingVariants.push_back(make_pair(false, material.features));
+                return;
+            }
+            if (programId == 0)
+                return;
+
+            URecordBindTexture(commands, 0, GL_TEXTURE_2D, material.texture);
+            if (lightmapped)
+                URecordBindTexture(commands, LIGHTMAP_TEXTURE_UNIT, GL_TEXTURE_2D, material.lightmap);
+            URecordBindProgram(commands, programId);
+            if (tessellated)
+            {
+                TessellatedDraw draw = { programId, static_cast<SceneMeshId>(mesh.shape), model };
+                URecordCall(commands, UReplayTessellatedDraw, &draw, sizeof(draw));
+                return;
+            }
 
-    glUniform1i(useUniformColorLoc, GL_FALSE);
+            // Lightmap coordinates only exist on the finest prebuilt level, so a lightmapped object stays on it
+            float diameter = UProjectedDiameter(bounds.center, bounds.radius, view, projection, isPerspective, (GLfloat)WINDOW_HEIGHT);
+            int lod = lightmapped ? 0 : USelectLod(&gMeshBounds[mesh.firstLod], int(mesh.lodCount), diameter, mesh.lod);
+            const GLMesh& glMesh = gMeshes[mesh.firstLod + lod];
+            SceneDrawData* data = static_cast<SceneDrawData*>(URecordDrawData(commands, sizeof(SceneDrawData)));
+            data->model = model;
+            data->normalMatrix = glm::mat4(UNormalMatrix(model));
+            data->positionScale = glm::vec4(glMesh.quantization.scale, 0.0f);
+            data->positionOffset = glm::vec4(glMesh.quantization.offset, 0.0f);
+            data->uniformColor = glm::vec4(material.color, 1.0f);
+            URecordBindVertexArray(commands, glMesh.vao);
+            URecordDrawElements(commands, GL_TRIANGLES, glMesh.nIndices, GL_UNSIGNED_SHORT);
+        }, DRAW_RECORD_GRAIN);
+}
 
-    glfwSwapBuffers(gWindow);
+// Replays a TessellatedDraw; its program is already current with the scene uniforms set
+void UReplayTessellatedDraw(const void* args)
+{
+    TessellatedDraw draw;
+    memcpy(&draw, args, sizeof(draw));
+    UDrawTessellated(draw.program, draw.mesh, draw.model, (GLfloat)WINDOW_HEIGHT);
 }
 
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+// Fits the key light's cascades to the camera, then redraws each cascade whose matrix or casters
+// changed; the others keep their depth from an earlier frame and only cost the hash
+void URenderShadowMap(ShadowMap& map, const glm::mat4& view, const glm::mat4& projection)
 {
-    int success = 0;
-    char infoLog[512];
+    glm::mat4 lightView, lightProjection;
+    const Transform* keyLight = UGetComponent<Transform>(gEntities, gKeyLight);
+    USpotShadowView(glm::vec3(USceneNodeWorld(gSceneGraph, keyLight->node)[3]), KEY_LIGHT_TARGET, lightView, lightProjection);
+    UFitShadowCascades(lightView, lightProjection, view, projection, map);
+
+    // World matrix and finest mesh of each caster in the cascade
+    vector<pair<const glm::mat4*, const GLMesh*>> casters;
+    for (int c = 0; c < SHADOW_CASCADE_COUNT; c++)
+    {
+        const glm::mat4& cascadeViewProjection = map.cascades[c].viewProjection;
+        const ViewFrustum frustum = UExtractFrustum(cascadeViewProjection);
+
+        casters.clear();
+        uint64_t hash = SHADOW_HASH_SEED;
+        UShadowHash(hash, &cascadeViewProjection, sizeof(cascadeViewProjection));
+        UForEachEntity<Transform, MeshRef, Material, Bounds>(gEntities, [&](Entity entity, const Transform& transform,
+            const MeshRef& mesh, const Material& material, const Bounds& bounds)
+            {
+                if (!material.castsShadow || !USphereInFrustum(frustum, bounds.center, bounds.radius))
+                    return;
 
-    programId = glCreateProgram();
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+                const glm::mat4& model = USceneNodeWorld(gSceneGraph, transform.node);
+                casters.push_back(make_pair(&model, &gMeshes[mesh.firstLod]));
+                UShadowHash(hash, &entity, sizeof(entity));
+                UShadowHash(hash, &mesh.firstLod, sizeof(mesh.firstLod));
+                UShadowHash(hash, &model, sizeof(model));
+            });
 
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+        if (!UBeginShadowPass(map, c, hash))
+            continue;
 
-    glCompileShader(vertexShaderId);
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-        return false;
+        // Finest level so the shadow matches the surface it falls on
+        for (const pair<const glm::mat4*, const GLMesh*>& caster : casters)
+        {
+            const GLMesh& mesh = *caster.second;
+            USetShadowCasterUniforms(*caster.first, mesh.quantization);
+            glBindVertexArray(mesh.vao);
+            glDrawElements(GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_SHORT, NULL);
+        }
+        glBindVertexArray(0);
+        UEndShadowPass();
     }
+}
 
-    glCompileShader(fragmentShaderId);
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
+// Gathers this frame's lights, bins them into clusters and uploads everything the fragment shader reads
+void UUpdateLightBuffers(const glm::mat4& view, const glm::mat4& projection, float seconds)
+{
+    gLights.clear();
+    UForEachEntity<Transform, Light>(gEntities, [](Entity, const Transform& transform, const Light& light)
+        {
+            gLights.push_back({ glm::vec3(USceneNodeWorld(gSceneGraph, transform.node)[3]), light.radius, light.color, light.baked });
+        });
+    if (gShowLightField)
+        USceneLightField(SCENE_LIGHT_FIELD_COUNT, seconds, gLights);
+
+    UUpdateClusterGrid(projection, gClusterGrid);
+    UAssignLightsToClusters(gClusterGrid, gLights, view, gClusterLists);
+
+    // An empty buffer can't be bound, so the index list always has at least one entry
+    if (gClusterLists.indices.empty())
+        gClusterLists.indices.push_back(0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gLightBuffers[0]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gLights.size() * sizeof(PointLight), gLights.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gLightBuffers[1]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gClusterLists.ranges.size() * sizeof(uint32_t), gClusterLists.ranges.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gLightBuffers[2]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gClusterLists.indices.size() * sizeof(uint32_t), gClusterLists.indices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    for (GLuint binding = 0; binding < 3; binding++)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, gLightBuffers[binding]);
+}
+
+// Loads the lightmaps written by --bake-lightmaps, one per scene object. Objects whose lightmap is
+// missing, or was baked for a different chart layout, get 0 and keep being lit per fragment.
+void ULoadLightmaps(const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], vector<GLuint>& lightmaps)
+{
+    const vector<SceneObject>& objects = USceneObjects();
+    lightmaps.assign(objects.size(), 0);
+    for (size_t i = 0; i < objects.size(); i++)
     {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-        return false;
-    }
+        const SceneMeshData& mesh = meshes[objects[i].mesh][0];
+        if (!objects[i].lightmapped || mesh.lightmapWidth == 0)
+            continue;
 
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
+        string path = ULightmapPath(LIGHTMAP_DIRECTORY, i);
+        ImageHdr image;
+        if (!ULoadImageHdr(path.c_str(), image))
+        {
+            cout << "INFO: No lightmap at " << path << ", lighting the " << USceneMeshName(objects[i].mesh)
+                 << " per fragment (bake with --bake-lightmaps)" << endl;
+            continue;
+        }
+        if (image.width != mesh.lightmapWidth || image.height != mesh.lightmapHeight)
+        {
+            cout << "ERROR::LIGHTMAP::SIZE_MISMATCH\n" << path << " is " << image.width << "x" << image.height
+                 << ", expected " << mesh.lightmapWidth << "x" << mesh.lightmapHeight << endl;
+            continue;
+        }
 
-    glLinkProgram(programId);
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-        return false;
+        glGenTextures(1, &lightmaps[i]);
+        glBindTexture(GL_TEXTURE_2D, lightmaps[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, image.width, image.height, 0, GL_RGB, GL_FLOAT, image.pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     }
-
-    glUseProgram(programId);
-    return true;
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void UDestroyShaderProgram(GLuint programId)
+// Loads the probe grid written by --bake-lightmaps into a half-float 3D texture; without one the
+// objects that aren't lightmapped keep the flat ambient light
+void ULoadLightProbes()
 {
-    glDeleteProgram(programId);
-}
\ No newline at end of file
+    ProbeGrid grid;
+    string path = UProbeGridPath(LIGHTMAP_DIRECTORY);
+    if (!ULoadProbeGrid(path.c_str(), grid))
+    {
+        cout << "INFO: No light probes at " << path << ", using flat ambient light (bake with --bake-lightmaps)" << endl;
+        return;
+    }
+
+    vector<float> texels;
+    UPackProbeTexels(grid, texels);
+    glGenTextures(1, &gProbeTexture);
+    glBindTexture(GL_TEXTURE_3D, gProbeTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, grid.size[0], grid.size[1], grid.size[2] * PROBE_TEXTURE_SLOTS, 0,
+        GL_RGBA, GL_FLOAT, texels.data());
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
@@ -0,0 +1,210 @@
+#include "CommandBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+    enum CommandType : uint32_t
+    {
+        COMMAND_BIND_PROGRAM,
+        COMMAND_BIND_VERTEX_ARRAY,
+        COMMAND_BIND_TEXTURE,
+        COMMAND_DRAW_DATA,
+        COMMAND_DRAW_ELEMENTS,
+        COMMAND_CALL,
+    };
+
+    // Each command is its type followed by one of these; COMMAND_CALL's is followed by `size` bytes of arguments
+    struct BindTextureCommand
+    {
+        GLint unit;
+        GLenum target;
+        GLuint texture;
+    };
+    struct DrawDataCommand
+    {
+        uint32_t offset; // into the buffer's drawData
+        uint32_t size;
+    };
+    struct DrawElementsCommand
+    {
+        GLenum mode;
+        GLsizei count;
+        GLenum indexType;
+    };
+    struct CallCommand
+    {
+        void (*fn)(const void* args);
+        uint32_t size;
+    };
+
+    void UPushBytes(CommandBuffer& buffer, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        buffer.commands.insert(buffer.commands.end(), bytes, bytes + size);
+    }
+
+    template <class T>
+    void UPushCommand(CommandBuffer& buffer, CommandType type, const T& command)
+    {
+        UPushBytes(buffer, &type, sizeof(type));
+        UPushBytes(buffer, &command, sizeof(command));
+    }
+
+    // Commands are packed without padding, so they are copied out rather than read in place
+    template <class T>
+    T UReadCommand(const uint8_t*& at)
+    {
+        T value;
+        memcpy(&value, at, sizeof(T));
+        at += sizeof(T);
+        return value;
+    }
+}
+
+void UResetCommandBuffer(CommandBuffer& buffer)
+{
+    buffer.commands.clear();
+    buffer.drawData.clear();
+    buffer.programs.clear();
+    buffer.program = COMMAND_UNKNOWN_BINDING;
+    buffer.vertexArray = COMMAND_UNKNOWN_BINDING;
+    buffer.knownTextures = 0;
+}
+
+void URecordBindProgram(CommandBuffer& buffer, GLuint programId)
+{
+    if (buffer.program == programId)
+        return;
+    buffer.program = programId;
+    if (find(buffer.programs.begin(), buffer.programs.end(), programId) == buffer.programs.end())
+        buffer.programs.push_back(programId);
+    UPushCommand(buffer, COMMAND_BIND_PROGRAM, programId);
+}
+
+void URecordBindVertexArray(CommandBuffer& buffer, GLuint vertexArray)
+{
+    if (buffer.vertexArray == vertexArray)
+        return;
+    buffer.vertexArray = vertexArray;
+    UPushCommand(buffer, COMMAND_BIND_VERTEX_ARRAY, vertexArray);
+}
+
+void URecordBindTexture(CommandBuffer& buffer, int unit, GLenum target, GLuint texture)
+{
+    if (unit < COMMAND_TEXTURE_UNITS)
+    {
+        const uint32_t bit = 1u << unit;
+        if ((buffer.knownTextures & bit) && buffer.textures[unit] == texture)
+            return;
+        buffer.knownTextures |= bit;
+        buffer.textures[unit] = texture;
+    }
+    BindTextureCommand command = { unit, target, texture };
+    UPushCommand(buffer, COMMAND_BIND_TEXTURE, command);
+}
+
+void* URecordDrawData(CommandBuffer& buffer, size_t size)
+{
+    DrawDataCommand command = { uint32_t(buffer.drawData.size()), uint32_t(size) };
+    UPushCommand(buffer, COMMAND_DRAW_DATA, command);
+    const size_t slot = (size + COMMAND_DRAW_DATA_ALIGNMENT - 1) / COMMAND_DRAW_DATA_ALIGNMENT * COMMAND_DRAW_DATA_ALIGNMENT;
+    buffer.drawData.resize(buffer.drawData.size() + slot, 0);
+    return &buffer.drawData[command.offset];
+}
+
+void URecordDrawElements(CommandBuffer& buffer, GLenum mode, GLsizei count, GLenum indexType)
+{
+    DrawElementsCommand command = { mode, count, indexType };
+    UPushCommand(buffer, COMMAND_DRAW_ELEMENTS, command);
+}
+
+void URecordCall(CommandBuffer& buffer, void (*fn)(const void* args), const void* args, size_t size)
+{
+    CallCommand command = { fn, uint32_t(size) };
+    UPushCommand(buffer, COMMAND_CALL, command);
+    UPushBytes(buffer, args, size);
+    buffer.program = COMMAND_UNKNOWN_BINDING;
+    buffer.vertexArray = COMMAND_UNKNOWN_BINDING;
+    buffer.knownTextures = 0;
+}
+
+void UReplayCommandBuffers(const CommandBuffer* buffers, size_t count, GLuint drawDataBuffer, GLuint binding)
+{
+    // All the draw data goes up in one upload, each buffer's slots after the last buffer's. The
+    // store is orphaned first so the driver needn't wait on last frame's draws still reading it.
+    size_t drawDataSize = 0;
+    for (size_t i = 0; i < count; i++)
+        drawDataSize += buffers[i].drawData.size();
+    if (drawDataSize > 0)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, drawDataBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(drawDataSize), nullptr, GL_STREAM_DRAW);
+        size_t base = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            const vector<uint8_t>& data = buffers[i].drawData;
+            if (!data.empty())
+                glBufferSubData(GL_UNIFORM_BUFFER, GLintptr(base), GLsizeiptr(data.size()), data.data());
+            base += data.size();
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    int activeUnit = -1;
+    size_t base = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t* at = buffers[i].commands.data();
+        const uint8_t* end = at + buffers[i].commands.size();
+        while (at < end)
+        {
+            switch (UReadCommand<CommandType>(at))
+            {
+            case COMMAND_BIND_PROGRAM:
+                glUseProgram(UReadCommand<GLuint>(at));
+                break;
+            case COMMAND_BIND_VERTEX_ARRAY:
+                glBindVertexArray(UReadCommand<GLuint>(at));
+                break;
+            case COMMAND_BIND_TEXTURE:
+            {
+                BindTextureCommand command = UReadCommand<BindTextureCommand>(at);
+                if (command.unit != activeUnit)
+                {
+                    glActiveTexture(GL_TEXTURE0 + command.unit);
+                    activeUnit = command.unit;
+                }
+                glBindTexture(command.target, command.texture);
+                break;
+            }
+            case COMMAND_DRAW_DATA:
+            {
+                DrawDataCommand command = UReadCommand<DrawDataCommand>(at);
+                glBindBufferRange(GL_UNIFORM_BUFFER, binding, drawDataBuffer, GLintptr(base + command.offset), GLsizeiptr(command.size));
+                break;
+            }
+            case COMMAND_DRAW_ELEMENTS:
+            {
+                DrawElementsCommand command = UReadCommand<DrawElementsCommand>(at);
+                glDrawElements(command.mode, command.count, command.indexType, NULL);
+                break;
+            }
+            case COMMAND_CALL:
+            {
+                CallCommand command = UReadCommand<CallCommand>(at);
+                command.fn(at);
+                at += command.size;
+                activeUnit = -1;
+                break;
+            }
+            }
+        }
+        base += buffers[i].drawData.size();
+    }
+
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
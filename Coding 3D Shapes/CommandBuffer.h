@@ -0,0 +1,53 @@
+#pragma once
+
+// Draw commands recorded on any thread and replayed on the GL thread. A CommandBuffer is a linear
+// run of small commands (bind a program, vertex array or texture, point the draw data block at a
+// slot, draw) and the draw data they refer to. Recording makes no GL calls, so several threads can
+// each fill their own buffer at once. UReplayCommandBuffers then uploads the draw data of every
+// buffer in one go and issues the commands, buffer after buffer, on the thread that owns the
+// context. A bind that repeats what the buffer last bound is dropped as it is recorded.
+//
+// Draw data is a uniform block per draw: URecordDrawData reserves a slot for the caller to fill,
+// and the draws that follow read it through glBindBufferRange at the binding given to the replay.
+
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bytes from one draw data slot to the next: the largest GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT GL
+// allows, so the offsets suit every driver
+const size_t COMMAND_DRAW_DATA_ALIGNMENT = 256;
+// Texture units whose bindings a buffer keeps track of; binds to higher units are always recorded
+const int COMMAND_TEXTURE_UNITS = 8;
+// A program or vertex array binding the buffer knows nothing about
+const GLuint COMMAND_UNKNOWN_BINDING = ~GLuint(0);
+
+struct CommandBuffer
+{
+    std::vector<uint8_t> commands;
+    std::vector<uint8_t> drawData; // slots of a multiple of COMMAND_DRAW_DATA_ALIGNMENT bytes
+    std::vector<GLuint> programs;  // every program the commands bind, once each
+    // Bindings as of the last command, to drop binds that change nothing
+    GLuint program = COMMAND_UNKNOWN_BINDING;
+    GLuint vertexArray = COMMAND_UNKNOWN_BINDING;
+    GLuint textures[COMMAND_TEXTURE_UNITS];
+    uint32_t knownTextures = 0; // a bit per unit whose entry in `textures` is current
+};
+
+// Empties the buffer, keeping its memory
+void UResetCommandBuffer(CommandBuffer& buffer);
+void URecordBindProgram(CommandBuffer& buffer, GLuint programId);
+void URecordBindVertexArray(CommandBuffer& buffer, GLuint vertexArray);
+void URecordBindTexture(CommandBuffer& buffer, int unit, GLenum target, GLuint texture);
+// A zeroed slot of `size` bytes that the draws recorded after it read; the pointer stays valid
+// until the next command is recorded into the buffer
+void* URecordDrawData(CommandBuffer& buffer, size_t size);
+void URecordDrawElements(CommandBuffer& buffer, GLenum mode, GLsizei count, GLenum indexType);
+// A call to fn(args) at this point of the replay, for draws that set their own state. `args` is
+// copied unaligned, so fn should memcpy it out rather than cast it. The bindings are unknown after it.
+void URecordCall(CommandBuffer& buffer, void (*fn)(const void* args), const void* args, size_t size);
+
+// Uploads the draw data of `count` buffers into `drawDataBuffer` and issues their commands in
+// order, with draw data at uniform block `binding`. Leaves no vertex array bound and unit 0 active.
+void UReplayCommandBuffers(const CommandBuffer* buffers, size_t count, GLuint drawDataBuffer, GLuint binding);
@@ -0,0 +1,111 @@
+#include "Entities.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+    // Archetypes are few next to the entities in them, so a scan finds one quickly enough
+    uint32_t UFindArchetype(EntityWorld& world, ComponentMask mask)
+    {
+        for (size_t i = 0; i < world.archetypes.size(); i++)
+        {
+            if (world.archetypes[i].mask == mask)
+                return uint32_t(i);
+        }
+
+        Archetype archetype;
+        archetype.mask = mask;
+        world.archetypes.push_back(archetype);
+        return uint32_t(world.archetypes.size() - 1);
+    }
+
+    // Fills the row's hole with the archetype's last row
+    void URemoveRow(EntityWorld& world, uint32_t archetypeIndex, uint32_t row)
+    {
+        Archetype& archetype = world.archetypes[archetypeIndex];
+        const size_t last = archetype.entities.size() - 1;
+        for (int type = 0; type < ENTITY_MAX_COMPONENTS; type++)
+        {
+            if (!(archetype.mask & (ComponentMask(1) << type)))
+                continue;
+            const size_t size = world.componentSizes[type];
+            vector<uint8_t>& column = archetype.columns[type];
+            if (row != last)
+                memcpy(&column[row * size], &column[last * size], size);
+            column.resize(last * size);
+        }
+        if (row != last)
+        {
+            archetype.entities[row] = archetype.entities[last];
+            world.locations[archetype.entities[row]].row = row;
+        }
+        archetype.entities.pop_back();
+    }
+}
+
+int UNextComponentType()
+{
+    static atomic<int> next(0);
+    int type = next++;
+    if (type >= ENTITY_MAX_COMPONENTS)
+    {
+        cout << "ERROR::ENTITIES::TOO_MANY_COMPONENT_TYPES\n" << "at most " << ENTITY_MAX_COMPONENTS << " are supported" << endl;
+        abort();
+    }
+    return type;
+}
+
+Entity UCreateEntity(EntityWorld& world)
+{
+    Entity entity = Entity(world.locations.size());
+    world.locations.push_back(EntityLocation());
+
+    EntityLocation& location = world.locations[entity];
+    location.archetype = UFindArchetype(world, 0);
+    Archetype& archetype = world.archetypes[location.archetype];
+    location.row = uint32_t(archetype.entities.size());
+    archetype.entities.push_back(entity);
+    return entity;
+}
+
+Archetype& UMoveEntity(EntityWorld& world, Entity entity, ComponentMask mask)
+{
+    const EntityLocation from = world.locations[entity];
+    if (world.archetypes[from.archetype].mask == mask)
+        return world.archetypes[from.archetype];
+
+    // Finding the archetype may add one, so references into the list are taken after
+    const uint32_t toIndex = UFindArchetype(world, mask);
+    Archetype& source = world.archetypes[from.archetype];
+    Archetype& target = world.archetypes[toIndex];
+    const uint32_t row = uint32_t(target.entities.size());
+    for (int type = 0; type < ENTITY_MAX_COMPONENTS; type++)
+    {
+        const ComponentMask bit = ComponentMask(1) << type;
+        if (!(mask & bit))
+            continue;
+        const size_t size = world.componentSizes[type];
+        vector<uint8_t>& column = target.columns[type];
+        column.resize((row + 1) * size, 0);
+        if (source.mask & bit)
+            memcpy(&column[row * size], &source.columns[type][from.row * size], size);
+    }
+    target.entities.push_back(entity);
+
+    URemoveRow(world, from.archetype, from.row);
+    world.locations[entity].archetype = toIndex;
+    world.locations[entity].row = row;
+    return world.archetypes[toIndex];
+}
+
+void* UComponentData(EntityWorld& world, Entity entity, int type)
+{
+    const EntityLocation location = world.locations[entity];
+    Archetype& archetype = world.archetypes[location.archetype];
+    if (!(archetype.mask & (ComponentMask(1) << type)))
+        return nullptr;
+    return &archetype.columns[type][location.row * world.componentSizes[type]];
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+// Entity-component storage grouped by archetype. An entity is only an id; its components live in
+// the archetype for its exact set of component types, one contiguous array per type, with a row per
+// entity. UForEachEntity walks the archetypes holding every type it asks for and hands each row to
+// the callback straight from those arrays, so a system touches only the components it reads, in
+// order. An entity is created with all its components at once (UCreateEntity with components),
+// straight into its archetype.
+//
+// Components must be trivially copyable (UComponentType checks): rows are copied with memcpy. Rows
+// keep the order their entities arrived in, and archetypes the order they were first needed.
+
+#include "Parallel.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+typedef uint32_t Entity;
+const Entity ENTITY_NONE = UINT32_MAX;
+
+// Rows per job in UParallelForEachEntity unless the caller picks another grain
+const size_t ENTITY_PARALLEL_GRAIN = 1024;
+// Component types a program can have; one bit each in a ComponentMask
+const int ENTITY_MAX_COMPONENTS = 32;
+typedef uint32_t ComponentMask;
+
+struct Archetype
+{
+    ComponentMask mask = 0;
+    std::vector<Entity> entities;                         // entity in each row
+    std::vector<uint8_t> columns[ENTITY_MAX_COMPONENTS];  // by component type; empty outside the mask
+};
+
+struct EntityLocation
+{
+    uint32_t archetype = UINT32_MAX;
+    uint32_t row = 0;
+};
+
+struct EntityWorld
+{
+    std::vector<Archetype> archetypes;
+    std::vector<EntityLocation> locations;  // by entity
+    size_t componentSizes[ENTITY_MAX_COMPONENTS] = {};
+};
+
+// Hands out the next component type; use UComponentType<T>() instead
+int UNextComponentType();
+
+template <class T>
+int UComponentType()
+{
+    static_assert(std::is_trivially_copyable<T>::value, "components are copied with memcpy, so they must be trivially copyable");
+    static const int type = UNextComponentType();
+    return type;
+}
+
+template <class... Ts>
+ComponentMask UComponentMask()
+{
+    ComponentMask mask = 0;
+    int expand[] = { 0, (mask |= ComponentMask(1) << UComponentType<Ts>(), 0)... };
+    (void)expand;
+    return mask;
+}
+
+// A new entity with no components
+Entity UCreateEntity(EntityWorld& world);
+// Moves the entity's row into the archetype for `mask`, keeping the components both have; the
+// others start zeroed. Returns the new row's archetype.
+Archetype& UMoveEntity(EntityWorld& world, Entity entity, ComponentMask mask);
+// Address of the entity's component of `type`, nullptr if it has none
+void* UComponentData(EntityWorld& world, Entity entity, int type);
+
+template <class T>
+T* UColumn(Archetype& archetype)
+{
+    return reinterpret_cast<T*>(archetype.columns[UComponentType<T>()].data());
+}
+
+template <class T>
+T* UGetComponent(EntityWorld& world, Entity entity)
+{
+    return static_cast<T*>(UComponentData(world, entity, UComponentType<T>()));
+}
+
+// A new entity with the given components, placed straight in their archetype
+template <class... Ts>
+Entity UCreateEntity(EntityWorld& world, const Ts&... components)
+{
+    Entity entity = UCreateEntity(world);
+    int expand[] = { 0, (world.componentSizes[UComponentType<Ts>()] = sizeof(Ts), 0)... };
+    Archetype& archetype = UMoveEntity(world, entity, UComponentMask<Ts...>());
+    const uint32_t row = world.locations[entity].row;
+    int copy[] = { 0, (memcpy(UColumn<Ts>(archetype) + row, &components, sizeof(Ts)), 0)... };
+    (void)expand;
+    (void)copy;
+    return entity;
+}
+
+template <class Fn, class... Ts>
+void UForEachRow(const Archetype& archetype, Fn& fn, Ts*... columns)
+{
+    const size_t rows = archetype.entities.size();
+    for (size_t row = 0; row < rows; row++)
+        fn(archetype.entities[row], columns[row]...);
+}
+
+// Calls fn(entity, Ts&...) for every entity that has all of Ts. The callback must not create,
+// destroy or move entities.
+template <class... Ts, class Fn>
+void UForEachEntity(EntityWorld& world, Fn fn)
+{
+    const ComponentMask mask = UComponentMask<Ts...>();
+    for (Archetype& archetype : world.archetypes)
+    {
+        if ((archetype.mask & mask) == mask && !archetype.entities.empty())
+            UForEachRow(archetype, fn, UColumn<Ts>(archetype)...);
+    }
+}
+
+template <class Fn, class... Ts>
+void UForEachBlockRow(const Archetype& archetype, Fn& fn, size_t block, size_t first, size_t grain, Ts*... columns)
+{
+    const size_t end = std::min(archetype.entities.size(), first + grain);
+    for (size_t row = first; row < end; row++)
+        fn(block, archetype.entities[row], columns[row]...);
+}
+
+// Blocks of up to `grain` rows that UParallelForEachEntityBlock splits the entities with all of Ts into
+template <class... Ts>
+size_t UEntityBlockCount(const EntityWorld& world, size_t grain = ENTITY_PARALLEL_GRAIN)
+{
+    const ComponentMask mask = UComponentMask<Ts...>();
+    size_t blocks = 0;
+    for (const Archetype& archetype : world.archetypes)
+    {
+        if ((archetype.mask & mask) == mask)
+            blocks += (archetype.entities.size() + grain - 1) / grain;
+    }
+    return blocks;
+}
+
+// UForEachEntity with the rows split into blocks of `grain` and the blocks spread over the job
+// scheduler; calls fn(block, entity, Ts&...). Blocks are numbered in UForEachEntity order, from 0
+// to UEntityBlockCount<Ts...>() - 1, so a callback that writes to a per-block output keeps the
+// serial order when the outputs are read back in turn. Blocks never span two archetypes. The
+// callback must only write to its own entity's components and its block's outputs.
+template <class... Ts, class Fn>
+void UParallelForEachEntityBlock(EntityWorld& world, Fn fn, size_t grain = ENTITY_PARALLEL_GRAIN)
+{
+    const ComponentMask mask = UComponentMask<Ts...>();
+    // First block of each matching archetype
+    std::vector<std::pair<size_t, Archetype*>> firstBlocks;
+    size_t blocks = 0;
+    for (Archetype& archetype : world.archetypes)
+    {
+        if ((archetype.mask & mask) != mask || archetype.entities.empty())
+            continue;
+        firstBlocks.push_back(std::make_pair(blocks, &archetype));
+        blocks += (archetype.entities.size() + grain - 1) / grain;
+    }
+
+    UParallelFor(blocks, [&](size_t block)
+        {
+            size_t i = firstBlocks.size() - 1;
+            while (firstBlocks[i].first > block)
+                i--;
+            Archetype& archetype = *firstBlocks[i].second;
+            UForEachBlockRow(archetype, fn, block, (block - firstBlocks[i].first) * grain, grain, UColumn<Ts>(archetype)...);
+        });
+}
+
+// UParallelForEachEntityBlock without the block index
+template <class... Ts, class Fn>
+void UParallelForEachEntity(EntityWorld& world, Fn fn, size_t grain = ENTITY_PARALLEL_GRAIN)
+{
+    UParallelForEachEntityBlock<Ts...>(world, [&fn](size_t, Entity entity, Ts&... components)
+        {
+            fn(entity, components...);
+        }, grain);
+}
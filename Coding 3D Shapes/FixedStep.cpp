@@ -0,0 +1,34 @@
+#include "FixedStep.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+int UAdvanceFixedStep(FixedStepClock& clock, double now)
+{
+    if (clock.lastTime < 0.0)
+        clock.lastTime = now;
+    clock.accumulator += max(now - clock.lastTime, 0.0);
+    clock.lastTime = now;
+
+    int steps = static_cast<int>(clock.accumulator / clock.step);
+    if (steps > clock.maxSteps)
+    {
+        // Keep the fraction so interpolation stays smooth, forget the whole steps we can't afford
+        steps = clock.maxSteps;
+        clock.accumulator = fmod(clock.accumulator, clock.step) + steps * clock.step;
+    }
+    clock.accumulator -= steps * clock.step;
+    return steps;
+}
+
+void UPauseFixedStep(FixedStepClock& clock)
+{
+    clock.lastTime = -1.0;
+}
+
+float UFixedStepAlpha(const FixedStepClock& clock)
+{
+    return static_cast<float>(min(clock.accumulator / clock.step, 1.0));
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// Fixed-timestep clock for the simulation. Real time is fed in every frame and paid out in steps
+// of exactly `step` seconds, whatever the frame rate; what is left over (less than a step) tells
+// the renderer how far to blend from the previous simulated state to the current one. A frame
+// that falls far behind drops the excess instead of running ever more steps to catch up.
+
+// Simulated steps per second
+const double SIMULATION_RATE = 120.0;
+// Most steps one frame may run; beyond that the simulation slows down instead of the frame rate
+const int SIMULATION_MAX_STEPS = 8;
+
+struct FixedStepClock
+{
+    double step = 1.0 / SIMULATION_RATE;
+    int maxSteps = SIMULATION_MAX_STEPS;
+    double accumulator = 0.0; // real time not yet simulated, in seconds
+    double lastTime = -1.0;   // negative until the first UAdvanceFixedStep
+};
+
+// Adds the time since the last call (`now` in seconds) and returns how many steps to run now
+int UAdvanceFixedStep(FixedStepClock& clock, double now);
+// Stops the clock until the next UAdvanceFixedStep, which then restarts it from its own `now`: the
+// time in between is never simulated. The leftover fraction of a step, and so the blend, is kept.
+void UPauseFixedStep(FixedStepClock& clock);
+// Where the frame falls between the previous step and the current one, from 0 to 1
+float UFixedStepAlpha(const FixedStepClock& clock);
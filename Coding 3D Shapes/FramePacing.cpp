@@ -0,0 +1,158 @@
+#include "FramePacing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+using namespace std;
+
+namespace {
+    // A refresh rate this close to a whole multiple of the target, in Hz, is left to vsync
+    const double FRAME_RATE_TOLERANCE = 1.0;
+    // The sleep statistics stop growing their history here, so they follow a change in the timer
+    const long long FRAME_SLEEP_HISTORY = 1000;
+
+    const char* USwapModeName(SwapMode mode)
+    {
+        switch (mode)
+        {
+        case SWAP_OFF: return "off";
+        case SWAP_VSYNC: return "on";
+        default: return "adaptive";
+        }
+    }
+}
+
+bool UParseFramePacingOptions(int argc, char* argv[], FramePacingOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+            options.targetRate = max(0.0, atof(argv[++i]));
+        else if (strcmp(argv[i], "--no-idle") == 0)
+            options.idle = false;
+        else if (strcmp(argv[i], "--vsync") == 0 && i + 1 < argc)
+        {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "off") == 0)
+                options.swapMode = SWAP_OFF;
+            else if (strcmp(mode, "on") == 0)
+                options.swapMode = SWAP_VSYNC;
+            else if (strcmp(mode, "adaptive") == 0)
+                options.swapMode = SWAP_ADAPTIVE;
+            else
+            {
+                cout << "ERROR::FRAME_PACING::UNKNOWN_SWAP_MODE\n" << mode << " (expected off, on or adaptive)" << endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void UStartFramePacing(const FramePacingOptions& options, FramePacer& pacer)
+{
+#ifdef _WIN32
+    // Sleeps round up to the 15.6 ms scheduler tick otherwise, which would leave long spins
+    timeBeginPeriod(1);
+#endif
+
+    SwapMode mode = options.swapMode;
+    if (mode == SWAP_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+        && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+    {
+        mode = SWAP_VSYNC;
+    }
+
+    int swapInterval = mode == SWAP_OFF ? 0 : 1;
+    pacer.interval = options.targetRate > 0.0 ? 1.0 / options.targetRate : 0.0;
+    pacer.deadline = -1.0;
+
+    // Showing each frame for a whole number of refreshes paces it exactly, with no CPU timer at all.
+    // The window is assumed to be on the primary monitor.
+    GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+    const GLFWvidmode* video = monitor ? glfwGetVideoMode(monitor) : nullptr;
+    if (mode != SWAP_OFF && options.targetRate > 0.0 && video && video->refreshRate > 0)
+    {
+        int refreshes = max(1, int(round(video->refreshRate / options.targetRate)));
+        if (fabs(video->refreshRate / double(refreshes) - options.targetRate) < FRAME_RATE_TOLERANCE)
+        {
+            swapInterval = refreshes;
+            pacer.interval = 0.0;
+        }
+    }
+    // A negative interval asks for the same wait, but lets a late frame tear instead of waiting a whole refresh
+    glfwSwapInterval(mode == SWAP_ADAPTIVE ? -swapInterval : swapInterval);
+
+    cout << "INFO: Frame pacing: vsync " << USwapModeName(mode);
+    if (options.swapMode != mode)
+        cout << " (" << USwapModeName(options.swapMode) << " unsupported)";
+    if (swapInterval > 1)
+        cout << ", every " << swapInterval << " refreshes";
+    if (pacer.interval > 0.0)
+        cout << ", limited to " << options.targetRate << " Hz";
+    cout << (options.idle ? ", idle when nothing changes" : "") << endl;
+}
+
+void UStopFramePacing(FramePacer& pacer)
+{
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+    pacer.interval = 0.0;
+    pacer.deadline = -1.0;
+}
+
+double UPacingTime()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void USleepUntil(FramePacer& pacer, double deadline)
+{
+    for (;;)
+    {
+        // Sleep again only if even a slow sleep would wake before the deadline
+        double variance = pacer.sleepCount > 1 ? pacer.sleepM2 / double(pacer.sleepCount - 1) : 0.0;
+        double now = UPacingTime();
+        if (deadline - now <= pacer.sleepMean + sqrt(variance))
+            break;
+
+        this_thread::sleep_for(chrono::milliseconds(1));
+        double observed = UPacingTime() - now;
+        pacer.sleepCount = min(pacer.sleepCount + 1, FRAME_SLEEP_HISTORY);
+        double delta = observed - pacer.sleepMean;
+        pacer.sleepMean += delta / double(pacer.sleepCount);
+        pacer.sleepM2 += delta * (observed - pacer.sleepMean);
+        if (pacer.sleepCount == FRAME_SLEEP_HISTORY)
+            pacer.sleepM2 *= double(FRAME_SLEEP_HISTORY - 1) / double(FRAME_SLEEP_HISTORY);
+    }
+
+    while (UPacingTime() < deadline)
+        this_thread::yield();
+}
+
+void UWaitForNextFrame(FramePacer& pacer)
+{
+    if (pacer.interval <= 0.0)
+        return;
+
+    double now = UPacingTime();
+    if (pacer.deadline < 0.0 || now - pacer.deadline > pacer.interval)
+        pacer.deadline = now; // first frame, or a whole frame behind: start over rather than rush to catch up
+    else
+        USleepUntil(pacer, pacer.deadline);
+    pacer.deadline += pacer.interval;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Frame pacing for the window loop. A FramePacer holds frames to a target rate: it sleeps in
+// short slices while the deadline is further away than a sleep tends to overshoot, then spins
+// for the rest, so frames land on time without a core busy-waiting through the whole gap. The
+// overshoot is measured as the pacer runs, which keeps the spin short on any OS timer. The swap
+// interval is chosen to match: where the display's refresh rate is a whole multiple of the target,
+// vsync paces the frames by itself and the CPU timer stays out of the way.
+
+#include <GLFW/glfw3.h>
+
+// Sleeps are cut this short of the deadline until the pacer has measured its own overshoot, in seconds
+const double FRAME_SPIN_MARGIN = 0.002;
+// Longest an idle window loop blocks waiting for events, in seconds; shader file changes are
+// noticed no later than this
+const double FRAME_IDLE_TIMEOUT = 0.25;
+
+enum SwapMode
+{
+    SWAP_OFF,      // present at once, tearing if need be
+    SWAP_VSYNC,    // wait for vertical blank
+    SWAP_ADAPTIVE, // wait for vertical blank unless the frame is already late (EXT_swap_control_tear)
+};
+
+struct FramePacingOptions
+{
+    double targetRate = 0.0; // frames per second; 0 leaves the rate to the swap interval
+    SwapMode swapMode = SWAP_ADAPTIVE;
+    bool idle = true;        // draw only frames that differ from the last one, and block on events in between
+};
+
+struct FramePacer
+{
+    double interval = 0.0;  // seconds per frame; 0 when not limiting
+    double deadline = -1.0; // when the next frame may start; negative until the first frame
+    // Running mean and variance of how long a 1 ms sleep really takes (Welford's method)
+    double sleepMean = FRAME_SPIN_MARGIN;
+    double sleepM2 = 0.0;
+    long long sleepCount = 0;
+};
+
+// Reads --fps N, --vsync off|on|adaptive and --no-idle from the command line; other arguments are
+// ignored. Returns false (the error is printed) on an unknown swap mode.
+bool UParseFramePacingOptions(int argc, char* argv[], FramePacingOptions& options);
+// Sets the swap interval for `options` on the current context and the pacer's rate to go with it.
+// Prints the resulting pacing.
+void UStartFramePacing(const FramePacingOptions& options, FramePacer& pacer);
+// Undoes what UStartFramePacing changed outside the pacer (the system timer resolution on Windows);
+// call once the window loop has ended
+void UStopFramePacing(FramePacer& pacer);
+// Waits until the next frame is due; returns at once when not limiting
+void UWaitForNextFrame(FramePacer& pacer);
+// Sleeps and then spins until `deadline` (steady clock seconds, see UPacingTime)
+void USleepUntil(FramePacer& pacer, double deadline);
+// Seconds on a steady clock
+double UPacingTime();
@@ -0,0 +1,257 @@
+#include "GoldenImages.h"
+#include "Parallel.h"
+#include "Scene.h"
+#include "SoftwareRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const int GOLDEN_WIDTH = 320;
+    const int GOLDEN_HEIGHT = 240;
+    const int TIMED_FRAMES = 7;
+
+    // Tolerances for a match; small enough to catch a moved object or a lighting change,
+    // loose enough to ignore rounding differences between compilers and SIMD paths
+    const double MIN_SSIM = 0.98;
+    const double DELTA_E_TOLERANCE = 8.0;
+    const double MAX_BAD_PIXEL_FRACTION = 0.002;
+
+    struct GoldenPose
+    {
+        const char* name;
+        glm::vec3 position;
+        float yaw;   // degrees, same convention as the mouse look in UInitialize
+        float pitch;
+        bool isPerspective;
+        double budgetMs; // median frame time allowed at GOLDEN_WIDTH x GOLDEN_HEIGHT
+    };
+
+    const GoldenPose GOLDEN_POSES[] = {
+        { "default",     glm::vec3(0.0f, 0.0f, 5.0f),   -90.0f,   0.0f, true,  40.0 },
+        { "ortho",       glm::vec3(0.0f, 0.0f, 5.0f),   -90.0f,   0.0f, false, 40.0 },
+        { "overhead",    glm::vec3(0.0f, 6.0f, 6.0f),   -90.0f, -45.0f, true,  40.0 },
+        { "sphere_close", glm::vec3(-2.0f, -0.5f, 3.5f), -120.0f, -10.0f, true,  40.0 },
+        { "right_side",  glm::vec3(7.0f, 0.5f, 2.0f),   180.0f, -10.0f, true,  40.0 },
+        { "low_behind",  glm::vec3(0.5f, -1.5f, -6.0f),  90.0f,   5.0f, true,  40.0 },
+    };
+
+    SceneCamera UPoseCamera(const GoldenPose& pose)
+    {
+        SceneCamera camera = UDefaultSceneCamera();
+        camera.position = pose.position;
+        camera.front = glm::normalize(glm::vec3(
+            cos(glm::radians(pose.yaw)) * cos(glm::radians(pose.pitch)),
+            sin(glm::radians(pose.pitch)),
+            sin(glm::radians(pose.yaw)) * cos(glm::radians(pose.pitch))));
+        camera.isPerspective = pose.isPerspective;
+        return camera;
+    }
+
+    double USrgbToLinear(double c)
+    {
+        c /= 255.0;
+        return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+    }
+
+    double ULabF(double t)
+    {
+        return t > 0.008856 ? cbrt(t) : 7.787 * t + 16.0 / 116.0;
+    }
+
+    // sRGB -> CIELAB (D65), so distances roughly match what a person would notice
+    void UToLab(const unsigned char* rgb, double lab[3])
+    {
+        double r = USrgbToLinear(rgb[0]), g = USrgbToLinear(rgb[1]), b = USrgbToLinear(rgb[2]);
+        double x = (0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047;
+        double y = (0.2126 * r + 0.7152 * g + 0.0722 * b);
+        double z = (0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883;
+        double fx = ULabF(x), fy = ULabF(y), fz = ULabF(z);
+        lab[0] = 116.0 * fy - 16.0;
+        lab[1] = 500.0 * (fx - fy);
+        lab[2] = 200.0 * (fy - fz);
+    }
+
+    double ULuminance(const unsigned char* rgb)
+    {
+        return 0.299 * rgb[0] + 0.587 * rgb[1] + 0.114 * rgb[2];
+    }
+}
+
+bool UCompareImages(const ImageRgb& actual, const ImageRgb& expected, ImageDiff& diff, ImageRgb* diffImage)
+{
+    if (actual.width != expected.width || actual.height != expected.height)
+        return false;
+
+    const int width = actual.width;
+    const int height = actual.height;
+    if (diffImage)
+    {
+        diffImage->width = width;
+        diffImage->height = height;
+        diffImage->pixels.assign(static_cast<size_t>(width) * height * 3, 0);
+    }
+
+    // Per-pixel color difference (CIE76 delta E)
+    size_t badPixels = 0;
+    diff.maxDeltaE = 0.0;
+    for (int i = 0; i < width * height; i++)
+    {
+        double a[3], b[3];
+        UToLab(&actual.pixels[i * 3], a);
+        UToLab(&expected.pixels[i * 3], b);
+        double deltaE = sqrt((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+        diff.maxDeltaE = max(diff.maxDeltaE, deltaE);
+        if (deltaE > DELTA_E_TOLERANCE)
+            badPixels++;
+
+        if (diffImage)
+        {
+            // Gray copy of the reference with differences painted red
+            unsigned char gray = static_cast<unsigned char>(ULuminance(&expected.pixels[i * 3]) * 0.3);
+            unsigned char heat = static_cast<unsigned char>(min(255.0, deltaE * 8.0));
+            diffImage->pixels[i * 3 + 0] = max(gray, heat);
+            diffImage->pixels[i * 3 + 1] = gray;
+            diffImage->pixels[i * 3 + 2] = gray;
+        }
+    }
+    diff.badPixelFraction = width * height > 0 ? static_cast<double>(badPixels) / (width * height) : 0.0;
+
+    // Mean SSIM over 8x8 luminance windows, stepping 4 pixels
+    const double C1 = (0.01 * 255.0) * (0.01 * 255.0);
+    const double C2 = (0.03 * 255.0) * (0.03 * 255.0);
+    const int WINDOW = 8;
+    const int STEP = 4;
+    double ssimSum = 0.0;
+    int windows = 0;
+    for (int y = 0; y + WINDOW <= height; y += STEP)
+    {
+        for (int x = 0; x + WINDOW <= width; x += STEP)
+        {
+            double sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+            for (int wy = 0; wy < WINDOW; wy++)
+            {
+                for (int wx = 0; wx < WINDOW; wx++)
+                {
+                    size_t p = (static_cast<size_t>(y + wy) * width + x + wx) * 3;
+                    double la = ULuminance(&actual.pixels[p]);
+                    double lb = ULuminance(&expected.pixels[p]);
+                    sumA += la;
+                    sumB += lb;
+                    sumAA += la * la;
+                    sumBB += lb * lb;
+                    sumAB += la * lb;
+                }
+            }
+            const double n = WINDOW * WINDOW;
+            double meanA = sumA / n, meanB = sumB / n;
+            double varA = sumAA / n - meanA * meanA;
+            double varB = sumBB / n - meanB * meanB;
+            double covariance = sumAB / n - meanA * meanB;
+            ssimSum += ((2.0 * meanA * meanB + C1) * (2.0 * covariance + C2)) /
+                ((meanA * meanA + meanB * meanB + C1) * (varA + varB + C2));
+            windows++;
+        }
+    }
+    diff.meanSsim = windows > 0 ? ssimSum / windows : 1.0;
+    return true;
+}
+
+int UGoldenMain(int argc, char* argv[])
+{
+    string goldenDir = "golden";
+    string outputDir = ".";
+    bool bless = false;
+    double budgetScale = 1.0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (UParseThreadsOption(argc, argv, i))
+            continue;
+        if (strcmp(argv[i], "--bless") == 0)
+            bless = true;
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+            goldenDir = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            outputDir = argv[++i];
+        else if (strcmp(argv[i], "--budget-scale") == 0 && i + 1 < argc)
+            budgetScale = atof(argv[++i]);
+    }
+
+    if (!USoftwareInitialize())
+        return EXIT_FAILURE;
+
+    int failures = 0;
+    for (const GoldenPose& pose : GOLDEN_POSES)
+    {
+        const SceneCamera camera = UPoseCamera(pose);
+        ImageRgb frame;
+        frame.width = GOLDEN_WIDTH;
+        frame.height = GOLDEN_HEIGHT;
+
+        // One warm-up frame, then the median of the timed frames so one hiccup doesn't fail the run
+        SoftwareRenderStats stats;
+        USoftwareRender(camera, frame, stats);
+        vector<double> times;
+        for (int i = 0; i < TIMED_FRAMES; i++)
+        {
+            USoftwareRender(camera, frame, stats);
+            times.push_back(stats.milliseconds);
+        }
+        sort(times.begin(), times.end());
+        const double medianMs = times[times.size() / 2];
+        const double budgetMs = pose.budgetMs * budgetScale;
+
+        const string referencePath = goldenDir + "/" + pose.name + ".png";
+        if (bless)
+        {
+            if (!UWritePng(referencePath.c_str(), frame))
+            {
+                cout << "ERROR::GOLDEN::WRITE_FAILED " << referencePath << endl;
+                return EXIT_FAILURE;
+            }
+            cout << "BLESS " << pose.name << " -> " << referencePath << " (" << medianMs << " ms)" << endl;
+            continue;
+        }
+
+        ImageRgb reference;
+        ImageRgb diffImage;
+        ImageDiff diff;
+        bool imageOk = false;
+        if (!ULoadImageRgb(referencePath.c_str(), reference))
+            cout << "ERROR::GOLDEN::MISSING_REFERENCE " << referencePath << endl;
+        else if (!UCompareImages(frame, reference, diff, &diffImage))
+            cout << "ERROR::GOLDEN::SIZE_MISMATCH " << referencePath << endl;
+        else
+            imageOk = diff.meanSsim >= MIN_SSIM && diff.badPixelFraction <= MAX_BAD_PIXEL_FRACTION;
+
+        bool timeOk = medianMs <= budgetMs;
+        cout << (imageOk && timeOk ? "PASS " : "FAIL ") << pose.name
+            << "  ssim " << diff.meanSsim << " (min " << MIN_SSIM << ")"
+            << "  changed pixels " << diff.badPixelFraction * 100.0 << "% (max " << MAX_BAD_PIXEL_FRACTION * 100.0 << "%)"
+            << "  time " << medianMs << " ms (budget " << budgetMs << " ms, " << stats.trianglesSubmitted << " triangles)" << endl;
+
+        if (!imageOk || !timeOk)
+        {
+            failures++;
+            // Leave the evidence behind for whoever has to look at the failure
+            UWritePng((outputDir + "/" + pose.name + "_actual.png").c_str(), frame);
+            if (!diffImage.pixels.empty())
+                UWritePng((outputDir + "/" + pose.name + "_diff.png").c_str(), diffImage);
+        }
+    }
+
+    if (bless)
+        return EXIT_SUCCESS;
+
+    int total = static_cast<int>(sizeof(GOLDEN_POSES) / sizeof(GOLDEN_POSES[0]));
+    cout << (failures == 0 ? "INFO: " : "ERROR::GOLDEN::FAILED ") << total - failures << "/" << total << " poses passed" << endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Golden-image regression suite: renders fixed camera poses with the software renderer,
+// compares them against the reference PNGs in golden/ and checks per-frame time budgets.
+
+#include "ImageIO.h"
+
+struct ImageDiff
+{
+    double meanSsim = 0.0;        // structural similarity of luminance, 1.0 = identical
+    double badPixelFraction = 0.0; // pixels whose CIELAB color difference exceeds the tolerance
+    double maxDeltaE = 0.0;
+};
+
+// Perceptual comparison; when `diffImage` is given it gets a heat map of the per-pixel differences
+bool UCompareImages(const ImageRgb& actual, const ImageRgb& expected, ImageDiff& diff, ImageRgb* diffImage);
+// Entry point for `--golden`; returns EXIT_SUCCESS only when every pose matches and is within budget
+int UGoldenMain(int argc, char* argv[]);
@@ -0,0 +1,376 @@
+#include "ImageIO.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+namespace {
+    struct CrcTable
+    {
+        unsigned long entries[256];
+
+        CrcTable()
+        {
+            for (unsigned long n = 0; n < 256; n++)
+            {
+                unsigned long c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+        }
+    };
+
+    unsigned long UCrc32(const unsigned char* data, size_t length, unsigned long crc = 0)
+    {
+        // Built on first use; a function-local static is initialised once even with several
+        // threads writing images at the same time
+        static const CrcTable table;
+
+        crc ^= 0xFFFFFFFFUL;
+        for (size_t i = 0; i < length; i++)
+            crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFUL;
+    }
+
+    // Bit writer for the deflate stream (bits go in least significant first)
+    struct BitWriter
+    {
+        vector<unsigned char>& out;
+        unsigned int buffer = 0;
+        int count = 0;
+
+        explicit BitWriter(vector<unsigned char>& output) : out(output) {}
+
+        void Write(unsigned int bits, int length)
+        {
+            buffer |= bits << count;
+            count += length;
+            while (count >= 8)
+            {
+                out.push_back(static_cast<unsigned char>(buffer & 0xFF));
+                buffer >>= 8;
+                count -= 8;
+            }
+        }
+
+        // Huffman codes are packed most significant bit first
+        void WriteCode(unsigned int code, int length)
+        {
+            unsigned int reversed = 0;
+            for (int i = 0; i < length; i++)
+                reversed |= ((code >> i) & 1) << (length - 1 - i);
+            Write(reversed, length);
+        }
+
+        void Flush()
+        {
+            if (count > 0)
+                out.push_back(static_cast<unsigned char>(buffer & 0xFF));
+            buffer = 0;
+            count = 0;
+        }
+    };
+
+    const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const int DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const int DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    // Fixed Huffman table from the deflate spec (RFC 1951, 3.2.6)
+    void UWriteLiteral(BitWriter& bits, int symbol)
+    {
+        if (symbol < 144)
+            bits.WriteCode(0x30 + symbol, 8);
+        else if (symbol < 256)
+            bits.WriteCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            bits.WriteCode(symbol - 256, 7);
+        else
+            bits.WriteCode(0xC0 + symbol - 280, 8);
+    }
+
+    void UWriteMatch(BitWriter& bits, int length, int distance)
+    {
+        int code = 28;
+        while (LENGTH_BASE[code] > length)
+            code--;
+        UWriteLiteral(bits, 257 + code);
+        bits.Write(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+
+        code = 29;
+        while (DIST_BASE[code] > distance)
+            code--;
+        bits.WriteCode(code, 5);
+        bits.Write(distance - DIST_BASE[code], DIST_EXTRA[code]);
+    }
+
+    // zlib stream with a single fixed-Huffman block and greedy LZ77 matching.
+    // Not as tight as zlib itself, but rendered frames are mostly flat color so it goes a long way.
+    void UDeflate(const vector<unsigned char>& data, vector<unsigned char>& out)
+    {
+        const int WINDOW = 32768;
+        const int HASH_SIZE = 1 << 15;
+        const int MAX_CHAIN = 32;
+        const int MAX_MATCH = 258;
+
+        out.push_back(0x78); // 32K window, deflate
+        out.push_back(0x01);
+
+        BitWriter bits(out);
+        bits.Write(1, 1); // final block
+        bits.Write(1, 2); // fixed Huffman
+
+        vector<int> head(HASH_SIZE, -1);
+        vector<int> prev(data.size(), -1);
+        const int size = static_cast<int>(data.size());
+
+        auto hashAt = [&](int i)
+        {
+            return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & (HASH_SIZE - 1);
+        };
+        auto insert = [&](int i)
+        {
+            if (i + 2 >= size)
+                return;
+            int h = hashAt(i);
+            prev[i] = head[h];
+            head[h] = i;
+        };
+
+        int i = 0;
+        while (i < size)
+        {
+            int bestLength = 0;
+            int bestDistance = 0;
+            if (i + 2 < size)
+            {
+                int candidate = head[hashAt(i)];
+                int maxLength = min(MAX_MATCH, size - i);
+                for (int chain = 0; candidate >= 0 && i - candidate <= WINDOW && chain < MAX_CHAIN; chain++)
+                {
+                    int length = 0;
+                    while (length < maxLength && data[candidate + length] == data[i + length])
+                        length++;
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = i - candidate;
+                        if (length == maxLength)
+                            break;
+                    }
+                    candidate = prev[candidate];
+                }
+            }
+
+            if (bestLength >= 3)
+            {
+                UWriteMatch(bits, bestLength, bestDistance);
+                for (int k = 0; k < bestLength; k++)
+                    insert(i + k);
+                i += bestLength;
+            }
+            else
+            {
+                UWriteLiteral(bits, data[i]);
+                insert(i);
+                i++;
+            }
+        }
+        UWriteLiteral(bits, 256); // end of block
+        bits.Flush();
+
+        unsigned long a = 1, b = 0;
+        for (unsigned char byte : data)
+        {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        unsigned long adler = (b << 16) | a;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<unsigned char>((adler >> shift) & 0xFF));
+    }
+
+    void UPutBigEndian(vector<unsigned char>& out, unsigned long value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<unsigned char>((value >> shift) & 0xFF));
+    }
+
+    void UWriteChunk(FILE* file, const char* type, const vector<unsigned char>& payload)
+    {
+        vector<unsigned char> chunk;
+        UPutBigEndian(chunk, static_cast<unsigned long>(payload.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), payload.begin(), payload.end());
+        UPutBigEndian(chunk, UCrc32(chunk.data() + 4, chunk.size() - 4));
+        fwrite(chunk.data(), 1, chunk.size(), file);
+    }
+
+    int UPaeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return a;
+        return pb <= pc ? b : c;
+    }
+}
+
+bool UWritePng(const char* path, const ImageRgb& image)
+{
+    const int rowBytes = image.width * 3;
+
+    // Pick the PNG row filter with the smallest sum of absolute residuals
+    vector<unsigned char> filtered;
+    filtered.reserve((rowBytes + 1) * image.height);
+    vector<unsigned char> candidate(rowBytes);
+    vector<unsigned char> best(rowBytes);
+    for (int y = 0; y < image.height; y++)
+    {
+        const unsigned char* row = &image.pixels[y * rowBytes];
+        const unsigned char* up = y > 0 ? row - rowBytes : nullptr;
+        long bestScore = -1;
+        int bestFilter = 0;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            long score = 0;
+            for (int x = 0; x < rowBytes; x++)
+            {
+                int a = x >= 3 ? row[x - 3] : 0;
+                int b = up ? up[x] : 0;
+                int c = (up && x >= 3) ? up[x - 3] : 0;
+                int predicted = 0;
+                switch (filter)
+                {
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) / 2; break;
+                case 4: predicted = UPaeth(a, b, c); break;
+                }
+                candidate[x] = static_cast<unsigned char>(row[x] - predicted);
+                score += candidate[x] < 128 ? candidate[x] : 256 - candidate[x];
+            }
+            if (bestScore < 0 || score < bestScore)
+            {
+                bestScore = score;
+                bestFilter = filter;
+                best.swap(candidate);
+            }
+        }
+        filtered.push_back(static_cast<unsigned char>(bestFilter));
+        filtered.insert(filtered.end(), best.begin(), best.end());
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    fwrite(signature, 1, sizeof(signature), file);
+
+    vector<unsigned char> header;
+    UPutBigEndian(header, image.width);
+    UPutBigEndian(header, image.height);
+    header.push_back(8); // bit depth
+    header.push_back(2); // truecolor RGB
+    header.push_back(0); // deflate
+    header.push_back(0); // adaptive filtering
+    header.push_back(0); // no interlace
+    UWriteChunk(file, "IHDR", header);
+
+    vector<unsigned char> compressed;
+    UDeflate(filtered, compressed);
+    UWriteChunk(file, "IDAT", compressed);
+    UWriteChunk(file, "IEND", vector<unsigned char>());
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+bool ULoadImageRgb(const char* path, ImageRgb& image)
+{
+    int numComponents = 0;
+    unsigned char* data = stbi_load(path, &image.width, &image.height, &numComponents, 3);
+    if (!data)
+        return false;
+
+    image.pixels.assign(data, data + image.width * image.height * 3);
+    stbi_image_free(data);
+    return true;
+}
+
+bool UWriteHdr(const char* path, const ImageHdr& image)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", image.height, image.width);
+
+    // Shared exponent: the largest channel keeps 8 bits of mantissa, the others are scaled to match
+    vector<unsigned char> row(image.width * 4);
+    for (int y = 0; y < image.height; y++)
+    {
+        for (int x = 0; x < image.width; x++)
+        {
+            const float* rgb = &image.pixels[(y * image.width + x) * 3];
+            unsigned char* rgbe = &row[x * 4];
+            float largest = max(rgb[0], max(rgb[1], rgb[2]));
+            if (largest < 1e-32f)
+            {
+                rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+                continue;
+            }
+            int exponent;
+            float scale = frexp(largest, &exponent) * 256.0f / largest;
+            for (int c = 0; c < 3; c++)
+                rgbe[c] = static_cast<unsigned char>(max(rgb[c], 0.0f) * scale);
+            rgbe[3] = static_cast<unsigned char>(exponent + 128);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+bool ULoadImageHdr(const char* path, ImageHdr& image)
+{
+    int numComponents = 0;
+    float* data = stbi_loadf(path, &image.width, &image.height, &numComponents, 3);
+    if (!data)
+        return false;
+
+    image.pixels.assign(data, data + image.width * image.height * 3);
+    stbi_image_free(data);
+    return true;
+}
+
+bool UMakeDirectory(const char* path)
+{
+#ifdef _WIN32
+    return _mkdir(path) == 0 || errno == EEXIST;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
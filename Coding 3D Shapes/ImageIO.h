@@ -0,0 +1,31 @@
+#pragma once
+
+// Reading and writing 8-bit RGB images for the software renderer and its frame dumps,
+// and floating-point RGB images (Radiance .hdr) for baked lighting, plus creating the
+// directories the bakers and caches write into.
+
+#include <vector>
+
+struct ImageRgb
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels; // width * height * 3, top row first
+};
+
+bool UWritePng(const char* path, const ImageRgb& image);
+bool ULoadImageRgb(const char* path, ImageRgb& image);
+
+struct ImageHdr
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels; // width * height * 3, linear, top row first
+};
+
+// Radiance RGBE, uncompressed scanlines
+bool UWriteHdr(const char* path, const ImageHdr& image);
+bool ULoadImageHdr(const char* path, ImageHdr& image);
+
+// Succeeds if `path` was created or already exists; parent directories must exist
+bool UMakeDirectory(const char* path);
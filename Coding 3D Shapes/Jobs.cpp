@@ -0,0 +1,420 @@
+#include "Jobs.h"
+#include "Benchmark.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // Jobs a deque holds; a push past this runs the job straight away instead. A power of two.
+    const int64_t JOB_DEQUE_SIZE = 4096;
+    // Failed looks for work before an idle worker goes to sleep
+    const int JOB_IDLE_SPINS = 256;
+    // Benchmark sizes
+    const size_t JOB_BENCH_JOBS = 100000;
+    const size_t JOB_BENCH_BATCH = 1024;
+    const size_t JOB_BENCH_ITEMS = 1048576;
+    const size_t JOB_BENCH_SMALL_ITEMS = 24; // as the cluster slices binned each frame
+    const size_t JOB_BENCH_FAN = 64;
+
+    // Chase and Lev's deque with the memory orderings of Le et al., "Correct and Efficient
+    // Work-Stealing for Weak Memory Models" (2013), on a fixed ring
+    struct JobDeque
+    {
+        atomic<int64_t> top{ 0 };     // thieves take from here
+        char padding[64];             // keeps the owner's and the thieves' ends on separate cache lines
+        atomic<int64_t> bottom{ 0 };  // the owner pushes and pops here
+        atomic<Job*> slots[JOB_DEQUE_SIZE];
+    };
+
+    struct Worker
+    {
+        JobDeque deque;
+        unique_ptr<Job[]> pool{ new Job[JOB_POOL_SIZE] };
+        size_t nextJob = 0;
+        uint32_t random = 1; // picks whom to steal from
+    };
+
+    struct JobSystem
+    {
+        vector<unique_ptr<Worker>> workers;
+        vector<thread> threads;
+        mutex sleepLock;
+        condition_variable wake;
+        atomic<int> sleepers{ 0 };
+        atomic<bool> stopping{ false };
+
+        ~JobSystem()
+        {
+            stopping = true;
+            {
+                lock_guard<mutex> guard(sleepLock);
+                wake.notify_all();
+            }
+            for (thread& worker : threads)
+                worker.join();
+        }
+    };
+
+    JobSystem gJobs;
+    once_flag gJobsStarted;
+    thread_local Worker* tWorker = nullptr;
+
+    bool UPushJob(JobDeque& deque, Job* job)
+    {
+        int64_t b = deque.bottom.load(memory_order_relaxed);
+        int64_t t = deque.top.load(memory_order_acquire);
+        if (b - t >= JOB_DEQUE_SIZE)
+            return false;
+        deque.slots[b & (JOB_DEQUE_SIZE - 1)].store(job, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        deque.bottom.store(b + 1, memory_order_relaxed);
+        return true;
+    }
+
+    Job* UPopJob(JobDeque& deque)
+    {
+        int64_t b = deque.bottom.load(memory_order_relaxed) - 1;
+        deque.bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = deque.top.load(memory_order_relaxed);
+        if (t > b)
+        {
+            deque.bottom.store(b + 1, memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job* job = deque.slots[b & (JOB_DEQUE_SIZE - 1)].load(memory_order_relaxed);
+        if (t == b)
+        {
+            // Last job: race the thieves for it
+            if (!deque.top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+                job = nullptr;
+            deque.bottom.store(b + 1, memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* UStealJob(JobDeque& deque)
+    {
+        int64_t t = deque.top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = deque.bottom.load(memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        Job* job = deque.slots[t & (JOB_DEQUE_SIZE - 1)].load(memory_order_relaxed);
+        if (!deque.top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+            return nullptr;
+        return job;
+    }
+
+    bool UAnyJobQueued()
+    {
+        for (const unique_ptr<Worker>& worker : gJobs.workers)
+        {
+            if (worker->deque.bottom.load() > worker->deque.top.load())
+                return true;
+        }
+        return false;
+    }
+
+    void UExecuteJob(Job* job);
+
+    // Queues a job whose dependencies have all finished, waking a sleeping worker for it
+    void UEnqueueJob(Job* job)
+    {
+        if (!UPushJob(tWorker->deque, job))
+        {
+            UExecuteJob(job);
+            return;
+        }
+        // Pairs with the sleeper's count of itself before it checks the deques one last time
+        atomic_thread_fence(memory_order_seq_cst);
+        if (gJobs.sleepers.load(memory_order_relaxed) > 0)
+        {
+            lock_guard<mutex> guard(gJobs.sleepLock);
+            gJobs.wake.notify_one();
+        }
+    }
+
+    void UExecuteJob(Job* job)
+    {
+        job->run(*job);
+        for (int i = 0; i < job->dependentCount; i++)
+        {
+            if (job->dependents[i]->dependencies.fetch_sub(1, memory_order_acq_rel) == 1)
+                UEnqueueJob(job->dependents[i]);
+        }
+        // The slot may be reused as soon as it is free, and the counter's owner may return as soon
+        // as it reaches zero, so neither is touched after
+        JobCounter* counter = job->counter;
+        job->free.store(true, memory_order_release);
+        if (counter)
+            counter->unfinished.fetch_sub(1, memory_order_release);
+    }
+
+    Job* UStealAnyJob(Worker& self)
+    {
+        const size_t count = gJobs.workers.size();
+        self.random ^= self.random << 13;
+        self.random ^= self.random >> 17;
+        self.random ^= self.random << 5;
+        size_t start = self.random % count;
+        for (size_t i = 0; i < count; i++)
+        {
+            Worker& victim = *gJobs.workers[(start + i) % count];
+            if (&victim == &self)
+                continue;
+            if (Job* job = UStealJob(victim.deque))
+                return job;
+        }
+        return nullptr;
+    }
+
+    bool URunOneJob(Worker& self)
+    {
+        Job* job = UPopJob(self.deque);
+        if (!job)
+            job = UStealAnyJob(self);
+        if (!job)
+            return false;
+        UExecuteJob(job);
+        return true;
+    }
+
+    void UWorkerLoop(size_t index)
+    {
+        Worker& self = *gJobs.workers[index];
+        tWorker = &self;
+        int idle = 0;
+        while (!gJobs.stopping.load(memory_order_relaxed))
+        {
+            if (URunOneJob(self))
+            {
+                idle = 0;
+                continue;
+            }
+            if (++idle < JOB_IDLE_SPINS)
+            {
+                this_thread::yield();
+                continue;
+            }
+
+            unique_lock<mutex> lock(gJobs.sleepLock);
+            gJobs.sleepers.fetch_add(1);
+            gJobs.wake.wait(lock, [] { return gJobs.stopping.load() || UAnyJobQueued(); });
+            gJobs.sleepers.fetch_sub(1);
+            idle = 0;
+        }
+    }
+
+    void UStartJobs()
+    {
+        const unsigned count = UParallelThreadCount();
+        for (unsigned i = 0; i < count; i++)
+        {
+            gJobs.workers.emplace_back(new Worker());
+            gJobs.workers.back()->random = 2654435761u * (i + 1);
+        }
+        tWorker = gJobs.workers[0].get();
+        for (unsigned i = 1; i < count; i++)
+            gJobs.threads.emplace_back(UWorkerLoop, i);
+    }
+
+    // Reference: the loop UParallelFor used to run, starting and joining its threads every call
+    template <class Fn>
+    void UThreadPerCallFor(size_t count, Fn fn)
+    {
+        size_t workerCount = min<size_t>(UParallelThreadCount(), count);
+        atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < count; i = next++)
+                fn(i);
+        };
+        vector<thread> threads;
+        for (size_t i = 1; i < workerCount; ++i)
+            threads.emplace_back(worker);
+        worker();
+        for (thread& thread : threads)
+            thread.join();
+    }
+}
+
+bool UJobsAvailable()
+{
+    call_once(gJobsStarted, UStartJobs);
+    return tWorker != nullptr;
+}
+
+size_t UJobWorkerCount()
+{
+    return gJobs.workers.size();
+}
+
+Job* UAllocateJob(JobCounter* counter)
+{
+    Worker& self = *tWorker;
+    // Old jobs can stay queued at the top of the deque while newer ones come and go, so busy slots
+    // are skipped rather than waited on; only with every slot busy does the thread help until one frees
+    Job* slot = nullptr;
+    while (!slot)
+    {
+        for (size_t tries = 0; tries < JOB_POOL_SIZE && !slot; tries++)
+        {
+            Job& candidate = self.pool[self.nextJob++ % JOB_POOL_SIZE];
+            if (candidate.free.load(memory_order_acquire))
+                slot = &candidate;
+        }
+        if (slot)
+            break;
+
+        // The newest job queued here is most likely from this thread's own pool: run it and take its slot
+        Job* queued = UPopJob(self.deque);
+        if (queued)
+        {
+            UExecuteJob(queued);
+            if (queued >= &self.pool[0] && queued < &self.pool[0] + JOB_POOL_SIZE)
+                self.nextJob = size_t(queued - &self.pool[0]);
+        }
+        else if (!URunOneJob(self))
+            this_thread::yield();
+    }
+
+    Job& job = *slot;
+    job.free.store(false, memory_order_relaxed);
+    job.counter = counter;
+    job.dependencies.store(1, memory_order_relaxed);
+    job.dependentCount = 0;
+    if (counter)
+        counter->unfinished.fetch_add(1, memory_order_relaxed);
+    return &job;
+}
+
+void UAddJobDependency(Job* job, Job* before)
+{
+    if (before->dependentCount == JOB_MAX_DEPENDENTS)
+    {
+        cout << "ERROR::JOBS::TOO_MANY_DEPENDENTS\n" << "a job can have at most " << JOB_MAX_DEPENDENTS
+             << " dependents; make them depend on a join job instead" << endl;
+        abort();
+    }
+    before->dependents[before->dependentCount++] = job;
+    job->dependencies.fetch_add(1, memory_order_relaxed);
+}
+
+void USubmitJob(Job* job)
+{
+    if (job->dependencies.fetch_sub(1, memory_order_acq_rel) == 1)
+        UEnqueueJob(job);
+}
+
+void UWaitForJobs(JobCounter& counter)
+{
+    while (counter.unfinished.load(memory_order_acquire) > 0)
+    {
+        if (!URunOneJob(*tWorker))
+            this_thread::yield();
+    }
+}
+
+int UJobBenchmarkMain(int argc, char* argv[])
+{
+    for (int i = 2; i < argc; i++)
+        UParseThreadsOption(argc, argv, i);
+
+    UJobsAvailable();
+    cout << fixed << setprecision(3);
+    cout << "INFO: Job scheduler on " << UJobWorkerCount() << " workers" << endl;
+
+    // Every item of a parallel loop runs exactly once
+    vector<int> visits(JOB_BENCH_ITEMS, 0);
+    UParallelFor(visits.size(), [&visits](size_t i) { visits[i]++; });
+    for (size_t i = 0; i < visits.size(); i++)
+    {
+        if (visits[i] != 1)
+        {
+            cout << "ERROR::JOBS::ITEM_COUNT\n" << "item " << i << " ran " << visits[i] << " times" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // A job that depends on a fan of others sees all of their results, and so does the one after it
+    for (int round = 0; round < 100; round++)
+    {
+        vector<size_t> values(JOB_BENCH_FAN, 0);
+        size_t sum = 0, total = 0;
+        JobCounter counter;
+        Job* gather = UCreateJob([&values, &sum]()
+            {
+                for (size_t value : values)
+                    sum += value;
+            }, &counter);
+        Job* check = UCreateJob([&sum, &total]() { total = sum * 2; }, &counter);
+        UAddJobDependency(check, gather);
+        for (size_t i = 0; i < JOB_BENCH_FAN; i++)
+        {
+            Job* job = UCreateJob([&values, i]() { values[i] = i + 1; }, &counter);
+            UAddJobDependency(gather, job);
+            USubmitJob(job);
+        }
+        USubmitJob(check);
+        USubmitJob(gather);
+        UWaitForJobs(counter);
+
+        size_t expected = JOB_BENCH_FAN * (JOB_BENCH_FAN + 1);
+        if (total != expected)
+        {
+            cout << "ERROR::JOBS::DEPENDENCY_ORDER\n" << "round " << round << " got " << total << ", expected " << expected << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // In batches the pool holds, waiting on each
+    double jobMilliseconds = UBenchmarkMilliseconds([]()
+        {
+            for (size_t batch = 0; batch < JOB_BENCH_JOBS; batch += JOB_BENCH_BATCH)
+            {
+                JobCounter counter;
+                for (size_t i = batch; i < min(batch + JOB_BENCH_BATCH, JOB_BENCH_JOBS); i++)
+                    USubmitJob(UCreateJob([]() {}, &counter));
+                UWaitForJobs(counter);
+            }
+        });
+    cout << "INFO: " << JOB_BENCH_JOBS << " empty jobs: " << jobMilliseconds << " ms, "
+         << jobMilliseconds * 1e6 / JOB_BENCH_JOBS << " ns per job" << endl;
+
+    for (size_t grain : { size_t(1), size_t(256) })
+    {
+        double loopMilliseconds = UBenchmarkMilliseconds([&visits, grain]()
+            {
+                UParallelFor(visits.size(), [&visits](size_t i) { visits[i] = int(i); }, grain);
+            });
+        cout << "INFO: Parallel loop over " << visits.size() << " items, grain " << grain << ": " << loopMilliseconds
+             << " ms, " << loopMilliseconds * 1e6 / visits.size() << " ns per item" << endl;
+    }
+
+    double smallMilliseconds = UBenchmarkMilliseconds([&visits]()
+        {
+            UParallelFor(JOB_BENCH_SMALL_ITEMS, [&visits](size_t i) { visits[i] = int(i); });
+        });
+    double threadMilliseconds = UBenchmarkMilliseconds([&visits]()
+        {
+            UThreadPerCallFor(JOB_BENCH_SMALL_ITEMS, [&visits](size_t i) { visits[i] = int(i); });
+        });
+    cout << "INFO: Parallel loop over " << JOB_BENCH_SMALL_ITEMS << " items: " << smallMilliseconds * 1000.0
+         << " us per loop (threads started per loop " << threadMilliseconds * 1000.0 << " us, "
+         << setprecision(1) << threadMilliseconds / smallMilliseconds << "x)" << endl;
+    return 0;
+}
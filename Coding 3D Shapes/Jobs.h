@@ -0,0 +1,79 @@
+#pragma once
+
+// Work-stealing job scheduler. Each worker thread owns a Chase-Lev deque. The owner pushes and pops
+// jobs at the bottom, newest first, so it carries on with the piece it just split off while that
+// is still in cache. Idle workers steal from the top, taking the oldest and usually largest
+// pieces. A job is a small callable stored inline in a slot from its creating thread's ring of
+// JOB_POOL_SIZE, so creating one allocates nothing.
+//
+// A JobCounter counts unfinished jobs: each job may name one, and UWaitForJobs runs queued jobs
+// until it reaches zero. Each job also counts its dependencies: it starts once it has been
+// submitted and every job it was made to depend on (UAddJobDependency) has finished.
+//
+// The thread that first uses the scheduler becomes worker 0, and UParallelThreadCount() - 1 more
+// workers start then. Other threads can't create jobs; UJobsAvailable() tells them so, and
+// UParallelFor falls back to a plain loop on them. Workers with nothing to do spin briefly, then
+// sleep until a job is pushed.
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Bytes of captured state a job can carry; capture a pointer to anything larger
+const size_t JOB_PAYLOAD_SIZE = 64;
+// Jobs that can depend on one job; depend on a join job to fan out further
+const int JOB_MAX_DEPENDENTS = 8;
+// Job slots per thread; a thread may have at most this many jobs not yet finished
+const size_t JOB_POOL_SIZE = 4096;
+
+struct JobCounter
+{
+    std::atomic<int> unfinished{ 0 };
+};
+
+struct Job
+{
+    void (*run)(Job& job) = nullptr;     // calls and destroys the callable in `payload`
+    JobCounter* counter = nullptr;       // counted down when the job finishes
+    std::atomic<int> dependencies{ 0 };  // unfinished jobs it waits on, plus one until submitted
+    int dependentCount = 0;
+    Job* dependents[JOB_MAX_DEPENDENTS];
+    std::atomic<bool> free{ true };      // the slot can be handed out again
+    alignas(16) unsigned char payload[JOB_PAYLOAD_SIZE];
+};
+
+// Whether the calling thread can create jobs; starts the scheduler on first use
+bool UJobsAvailable();
+// Workers, the first one included; 0 until the scheduler starts
+size_t UJobWorkerCount();
+
+// A free slot from the calling thread's ring, counted on `counter`; use UCreateJob instead
+Job* UAllocateJob(JobCounter* counter);
+// A job that will call fn() once submitted and its dependencies have finished
+template <class Fn>
+Job* UCreateJob(Fn fn, JobCounter* counter = nullptr)
+{
+    static_assert(sizeof(Fn) <= JOB_PAYLOAD_SIZE, "job captures too much; capture a pointer to the state instead");
+    static_assert(alignof(Fn) <= 16, "job callable is over-aligned");
+    Job* job = UAllocateJob(counter);
+    new (job->payload) Fn(std::move(fn));
+    job->run = [](Job& self)
+    {
+        Fn& callable = *reinterpret_cast<Fn*>(self.payload);
+        callable();
+        callable.~Fn();
+    };
+    return job;
+}
+
+// `job` starts only after `before` has finished; both must not have been submitted yet
+void UAddJobDependency(Job* job, Job* before);
+// Lets the job run once its dependencies have finished
+void USubmitJob(Job* job);
+// Runs queued jobs on the calling thread until `counter` reaches zero
+void UWaitForJobs(JobCounter& counter);
+
+// Entry point for `--job-bench`: times creating, running and waiting on empty jobs and parallel
+// loops against starting threads per loop, and checks items and dependencies run as they should
+int UJobBenchmarkMain(int argc, char* argv[]);
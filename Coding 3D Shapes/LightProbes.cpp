@@ -0,0 +1,206 @@
+#include "LightProbes.h"
+#include "Parallel.h"
+#include "PathTracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+    const char PROBE_FILE_MAGIC[8] = { 'S', 'H', 'P', 'R', 'O', 'B', 'E', '1' };
+    // A probe is inside a shape when more than this share of its rays hit the back of a surface
+    const float PROBE_INSIDE_FRACTION = 0.25f;
+    // Convolution with the cosine lobe scales each band by pi, 2 pi / 3 and pi / 4; the shaders'
+    // irradiance is that over pi (a surface reflects its color times it)
+    const float PROBE_BAND_SCALE[PROBE_SH_COEFFICIENTS] = {
+        1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+    // Real L2 spherical harmonics at unit direction d, in the order the shader evaluates them
+    void UShBasis(const glm::vec3& d, float basis[PROBE_SH_COEFFICIENTS])
+    {
+        basis[0] = 0.282095f;
+        basis[1] = 0.488603f * d.y;
+        basis[2] = 0.488603f * d.z;
+        basis[3] = 0.488603f * d.x;
+        basis[4] = 1.092548f * d.x * d.y;
+        basis[5] = 1.092548f * d.y * d.z;
+        basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+        basis[7] = 1.092548f * d.x * d.z;
+        basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+    }
+
+    size_t UProbeCount(const ProbeGrid& grid)
+    {
+        return size_t(grid.size[0]) * grid.size[1] * grid.size[2];
+    }
+
+    glm::vec3 UProbePosition(const ProbeGrid& grid, int x, int y, int z)
+    {
+        glm::vec3 t(float(x) / max(grid.size[0] - 1, 1), float(y) / max(grid.size[1] - 1, 1), float(z) / max(grid.size[2] - 1, 1));
+        return grid.min + (grid.max - grid.min) * t;
+    }
+}
+
+int UBakeLightProbes(const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], int samples, int bounces, ProbeGrid& grid)
+{
+    BakeScene scene;
+    UBuildBakeScene(meshes, true, scene);
+
+    const size_t count = UProbeCount(grid);
+    grid.coefficients.assign(count * PROBE_FLOATS, 0.0f);
+    vector<unsigned char> valid(count, 1);
+    samples = max(samples, 1);
+
+    UParallelFor(count, [&](size_t p)
+        {
+            int x = int(p % grid.size[0]);
+            int y = int(p / grid.size[0] % grid.size[1]);
+            int z = int(p / (size_t(grid.size[0]) * grid.size[1]));
+            glm::vec3 position = UProbePosition(grid, x, y, z);
+            uint32_t random = URandomSeed(x, y, z);
+
+            float* out = &grid.coefficients[p * PROBE_FLOATS];
+            int backFaces = 0;
+            for (int s = 0; s < samples; s++)
+            {
+                glm::vec3 direction = USphereDirection(random);
+                bool backFace = false;
+                glm::vec3 radiance = UTraceRadiance(scene, position, direction, bounces, random, &backFace);
+                backFaces += backFace ? 1 : 0;
+
+                float basis[PROBE_SH_COEFFICIENTS];
+                UShBasis(direction, basis);
+                for (int k = 0; k < PROBE_SH_COEFFICIENTS; k++)
+                    for (int c = 0; c < 3; c++)
+                        out[k * 3 + c] += radiance[c] * basis[k];
+            }
+
+            // Each sample stands for 4 pi / samples of the sphere
+            const float weight = 4.0f * glm::pi<float>() / samples;
+            for (int k = 0; k < PROBE_SH_COEFFICIENTS; k++)
+                for (int c = 0; c < 3; c++)
+                    out[k * 3 + c] *= weight * PROBE_BAND_SCALE[k];
+            valid[p] = backFaces <= samples * PROBE_INSIDE_FRACTION;
+        });
+
+    // Probes inside a shape only saw its inside; fill them from their neighbours, a layer at a time
+    int insideCount = static_cast<int>(count_if(valid.begin(), valid.end(), [](unsigned char v) { return v == 0; }));
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        vector<unsigned char> next = valid;
+        for (size_t p = 0; p < count; p++)
+        {
+            if (valid[p])
+                continue;
+
+            int x = int(p % grid.size[0]);
+            int y = int(p / grid.size[0] % grid.size[1]);
+            int z = int(p / (size_t(grid.size[0]) * grid.size[1]));
+            const int offsets[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+            float sum[PROBE_FLOATS] = {};
+            int neighbours = 0;
+            for (const int* offset : offsets)
+            {
+                int nx = x + offset[0], ny = y + offset[1], nz = z + offset[2];
+                if (nx < 0 || ny < 0 || nz < 0 || nx >= grid.size[0] || ny >= grid.size[1] || nz >= grid.size[2])
+                    continue;
+                size_t n = nx + size_t(grid.size[0]) * (ny + size_t(grid.size[1]) * nz);
+                if (!valid[n])
+                    continue;
+                for (int f = 0; f < PROBE_FLOATS; f++)
+                    sum[f] += grid.coefficients[n * PROBE_FLOATS + f];
+                neighbours++;
+            }
+            if (neighbours == 0)
+                continue;
+
+            for (int f = 0; f < PROBE_FLOATS; f++)
+                grid.coefficients[p * PROBE_FLOATS + f] = sum[f] / neighbours;
+            next[p] = 1;
+            changed = true;
+        }
+        valid.swap(next);
+    }
+
+    // Only possible if every probe is inside something: fall back to the flat ambient light
+    for (size_t p = 0; p < count; p++)
+    {
+        if (valid[p])
+            continue;
+        for (int c = 0; c < 3; c++)
+            grid.coefficients[p * PROBE_FLOATS + c] = AMBIENT_LIGHT_COLOR[c] / 0.282095f;
+    }
+    return insideCount;
+}
+
+string UProbeGridPath(const char* directory)
+{
+    return string(directory) + "/probes.bin";
+}
+
+bool UWriteProbeGrid(const char* path, const ProbeGrid& grid)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    fwrite(PROBE_FILE_MAGIC, 1, sizeof(PROBE_FILE_MAGIC), file);
+    fwrite(grid.size, sizeof(int), 3, file);
+    fwrite(&grid.min[0], sizeof(float), 3, file);
+    fwrite(&grid.max[0], sizeof(float), 3, file);
+    fwrite(grid.coefficients.data(), sizeof(float), grid.coefficients.size(), file);
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+bool ULoadProbeGrid(const char* path, ProbeGrid& grid)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    char magic[sizeof(PROBE_FILE_MAGIC)];
+    int size[3];
+    glm::vec3 lo, hi;
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, PROBE_FILE_MAGIC, sizeof(magic)) == 0 &&
+        fread(size, sizeof(int), 3, file) == 3 && fread(&lo[0], sizeof(float), 3, file) == 3 && fread(&hi[0], sizeof(float), 3, file) == 3;
+
+    // A grid baked for another box or resolution would put the light in the wrong places
+    ok = ok && memcmp(size, grid.size, sizeof(size)) == 0 && lo == grid.min && hi == grid.max;
+    if (ok)
+    {
+        grid.coefficients.resize(UProbeCount(grid) * PROBE_FLOATS);
+        ok = fread(grid.coefficients.data(), sizeof(float), grid.coefficients.size(), file) == grid.coefficients.size();
+    }
+    fclose(file);
+    return ok;
+}
+
+void UPackProbeTexels(const ProbeGrid& grid, vector<float>& texels)
+{
+    const size_t count = UProbeCount(grid);
+    texels.assign(count * PROBE_TEXTURE_SLOTS * 4, 0.0f);
+    for (size_t p = 0; p < count; p++)
+    {
+        size_t x = p % grid.size[0];
+        size_t y = p / grid.size[0] % grid.size[1];
+        size_t z = p / (size_t(grid.size[0]) * grid.size[1]);
+        for (int slot = 0; slot < PROBE_TEXTURE_SLOTS; slot++)
+        {
+            size_t layer = z + size_t(slot) * grid.size[2];
+            float* texel = &texels[(x + grid.size[0] * (y + grid.size[1] * layer)) * 4];
+            for (int channel = 0; channel < 4; channel++)
+            {
+                int f = slot * 4 + channel;
+                texel[channel] = f < PROBE_FLOATS ? grid.coefficients[p * PROBE_FLOATS + f] : 0.0f;
+            }
+        }
+    }
+}
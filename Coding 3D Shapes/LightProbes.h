@@ -0,0 +1,49 @@
+#pragma once
+
+// Irradiance probes for the objects that aren't lightmapped. A regular grid of probes spans the
+// scene; each stores the light arriving from every direction (ambient sky and light bounced off
+// the static objects) as L2 spherical harmonics already convolved with the cosine lobe, so the
+// fragment shader turns 9 RGB coefficients (27 floats) and a normal straight into irradiance,
+// with the same meaning as a lightmap texel. Probes are baked on the CPU next to the lightmaps
+// and sampled from a 3D texture with trilinear filtering. Nothing in here touches GL.
+
+#include "Scene.h"
+
+#include <string>
+#include <vector>
+
+const int PROBE_GRID_X = 9;
+const int PROBE_GRID_Y = 4;
+const int PROBE_GRID_Z = 9;
+// Probes sit on the corners of this box; the lowest layer floats just above the floor
+const glm::vec3 PROBE_GRID_MIN = glm::vec3(-5.0f, -2.0f, -5.0f);
+const glm::vec3 PROBE_GRID_MAX = glm::vec3(5.0f, 2.5f, 5.0f);
+const int PROBE_SH_COEFFICIENTS = 9;
+const int PROBE_FLOATS = PROBE_SH_COEFFICIENTS * 3;
+const int PROBE_SAMPLES = 1024; // directions traced per probe
+// RGBA texels per probe in the 3D texture: 27 floats rounded up to 28. A probe's slots are
+// stacked along z, PROBE_GRID_Z layers apart, so trilinear filtering never mixes two slots.
+// shaders/scene.frag declares PROBE_SH_COEFFICIENTS and this the same way; keep them in step.
+const int PROBE_TEXTURE_SLOTS = (PROBE_FLOATS + 3) / 4;
+// Texture unit the scene shaders read probes from, after the surface texture, shadow map and lightmap
+const int PROBE_TEXTURE_UNIT = 3;
+
+struct ProbeGrid
+{
+    int size[3] = { PROBE_GRID_X, PROBE_GRID_Y, PROBE_GRID_Z };
+    glm::vec3 min = PROBE_GRID_MIN;
+    glm::vec3 max = PROBE_GRID_MAX;
+    std::vector<float> coefficients; // PROBE_FLOATS per probe, x fastest; coefficient k of channel c at k * 3 + c
+};
+
+// Bakes every probe from the static objects only: the objects the probes light would otherwise
+// shadow themselves. Probes that end up inside a shape take the average of their neighbours.
+// Returns how many probes were inside.
+int UBakeLightProbes(const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], int samples, int bounces, ProbeGrid& grid);
+
+std::string UProbeGridPath(const char* directory);
+bool UWriteProbeGrid(const char* path, const ProbeGrid& grid);
+// Fails if the file is missing or was baked for a different grid
+bool ULoadProbeGrid(const char* path, ProbeGrid& grid);
+// RGBA floats for a size[0] x size[1] x (size[2] * PROBE_TEXTURE_SLOTS) 3D texture
+void UPackProbeTexels(const ProbeGrid& grid, std::vector<float>& texels);
@@ -0,0 +1,474 @@
+#include "Lightmap.h"
+#include "LightProbes.h"
+#include "PathTracer.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+    // Texel rays leave this far off the surface so they don't hit the triangle they start on
+    const float LIGHTMAP_RAY_OFFSET = 1e-3f;
+    // Texels are baked in square tiles; a tile is the unit of work threads take and steal
+    const int LIGHTMAP_TILE_SIZE = 8;
+    // Triangles whose normals all lie within this cosine of the chart's count as one flat face
+    const float LIGHTMAP_FLAT_COSINE = 0.999f;
+
+    struct Chart
+    {
+        vector<unsigned> triangles;
+        glm::vec2 min = glm::vec2(FLT_MAX); // flattened extent, world units
+        glm::vec2 max = glm::vec2(-FLT_MAX);
+        int x = 0, y = 0;          // placement in the lightmap, in texels
+        int width = 0, height = 0; // in texels, padding included
+    };
+
+    // One tile of one object's lightmap
+    struct BakeTile
+    {
+        size_t object;
+        int x, y;
+    };
+
+    // Texels of one object's lightmap that its surface covers
+    struct BakeTarget
+    {
+        vector<glm::vec3> positions; // per texel, world space
+        vector<glm::vec3> normals;
+        vector<unsigned char> covered;
+    };
+
+    glm::vec3 UVertexPosition(const SceneMeshData& mesh, unsigned index)
+    {
+        const float* p = &mesh.vertices[size_t(index) * SCENE_VERTEX_FLOATS + SCENE_POSITION_OFFSET];
+        return glm::vec3(p[0], p[1], p[2]);
+    }
+
+    unsigned UFindRoot(vector<unsigned>& parent, unsigned v)
+    {
+        while (parent[v] != v)
+        {
+            parent[v] = parent[parent[v]];
+            v = parent[v];
+        }
+        return v;
+    }
+
+    // Lays a chart flat in world units: straight down its normal if it is one flat face, otherwise
+    // along its texture coordinates stretched to the surface's size (which unrolls the cylinder's side)
+    void UFlattenChart(const SceneMeshData& mesh, const vector<glm::vec3>& world, Chart& chart, vector<glm::vec2>& flat)
+    {
+        glm::vec3 normalSum(0.0f);
+        for (unsigned t : chart.triangles)
+        {
+            const unsigned short* index = &mesh.indices[t * 3];
+            normalSum += glm::cross(world[index[1]] - world[index[0]], world[index[2]] - world[index[0]]);
+        }
+        bool planar = glm::length(normalSum) > 1e-12f;
+        glm::vec3 normal = planar ? glm::normalize(normalSum) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+        // Texture coordinate scale from how far the surface moves per unit of u and of v, area-weighted
+        float uScale = 0.0f, vScale = 0.0f, weight = 0.0f;
+        for (unsigned t : chart.triangles)
+        {
+            const unsigned short* index = &mesh.indices[t * 3];
+            glm::vec3 e1 = world[index[1]] - world[index[0]];
+            glm::vec3 e2 = world[index[2]] - world[index[0]];
+            glm::vec3 faceNormal = glm::cross(e1, e2);
+            float area = glm::length(faceNormal);
+            if (area < 1e-12f)
+                continue;
+            planar = planar && glm::dot(faceNormal / area, normal) > LIGHTMAP_FLAT_COSINE;
+
+            const float* uv0 = &mesh.vertices[size_t(index[0]) * SCENE_VERTEX_FLOATS + SCENE_TEXCOORD_OFFSET];
+            const float* uv1 = &mesh.vertices[size_t(index[1]) * SCENE_VERTEX_FLOATS + SCENE_TEXCOORD_OFFSET];
+            const float* uv2 = &mesh.vertices[size_t(index[2]) * SCENE_VERTEX_FLOATS + SCENE_TEXCOORD_OFFSET];
+            float du1 = uv1[0] - uv0[0], dv1 = uv1[1] - uv0[1];
+            float du2 = uv2[0] - uv0[0], dv2 = uv2[1] - uv0[1];
+            float determinant = du1 * dv2 - du2 * dv1;
+            if (fabs(determinant) < 1e-12f)
+                continue;
+            uScale += area * glm::length((e1 * dv2 - e2 * dv1) / determinant);
+            vScale += area * glm::length((e2 * du1 - e1 * du2) / determinant);
+            weight += area;
+        }
+
+        bool useTexcoords = !planar && weight > 0.0f && uScale > 1e-6f * weight && vScale > 1e-6f * weight;
+        glm::vec3 tangent = glm::normalize(glm::cross(fabs(normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        for (unsigned t : chart.triangles)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned v = mesh.indices[t * 3 + corner];
+                if (useTexcoords)
+                {
+                    const float* uv = &mesh.vertices[size_t(v) * SCENE_VERTEX_FLOATS + SCENE_TEXCOORD_OFFSET];
+                    flat[v] = glm::vec2(uv[0] * uScale / weight, uv[1] * vScale / weight);
+                }
+                else
+                {
+                    flat[v] = glm::vec2(glm::dot(world[v], tangent), glm::dot(world[v], bitangent));
+                }
+                chart.min = glm::min(chart.min, flat[v]);
+                chart.max = glm::max(chart.max, flat[v]);
+            }
+        }
+    }
+
+    // Shelf packing, tallest charts first, into a roughly square lightmap
+    void UPackCharts(vector<Chart>& charts, float texelsPerUnit, int& width, int& height)
+    {
+        int area = 0, widest = 0;
+        for (Chart& chart : charts)
+        {
+            glm::vec2 extent = (chart.max - chart.min) * texelsPerUnit;
+            chart.width = static_cast<int>(ceil(extent.x)) + 2 * LIGHTMAP_PADDING;
+            chart.height = static_cast<int>(ceil(extent.y)) + 2 * LIGHTMAP_PADDING;
+            area += chart.width * chart.height;
+            widest = max(widest, chart.width);
+        }
+
+        vector<Chart*> order;
+        for (Chart& chart : charts)
+            order.push_back(&chart);
+        stable_sort(order.begin(), order.end(), [](const Chart* a, const Chart* b) { return a->height > b->height; });
+
+        width = max(widest, static_cast<int>(ceil(sqrt(float(area)))));
+        height = 0;
+        int x = 0, shelfHeight = 0;
+        for (Chart* chart : order)
+        {
+            if (x + chart->width > width)
+            {
+                height += shelfHeight;
+                x = 0;
+                shelfHeight = 0;
+            }
+            chart->x = x;
+            chart->y = height;
+            x += chart->width;
+            shelfHeight = max(shelfHeight, chart->height);
+        }
+        height += shelfHeight;
+    }
+
+    // Finds the world position and normal under every texel center the object's triangles cover
+    void URasterizeTarget(const SceneMeshData& mesh, const glm::mat4& model, BakeTarget& target)
+    {
+        const int width = mesh.lightmapWidth;
+        const int height = mesh.lightmapHeight;
+        target.positions.assign(size_t(width) * height, glm::vec3(0.0f));
+        target.normals.assign(size_t(width) * height, glm::vec3(0.0f));
+        target.covered.assign(size_t(width) * height, 0);
+
+        glm::mat3 normalMatrix = UNormalMatrix(model);
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+        {
+            glm::vec2 texel[3];
+            glm::vec3 position[3], normal[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const float* v = &mesh.vertices[size_t(mesh.indices[t + corner]) * SCENE_VERTEX_FLOATS];
+                texel[corner] = glm::vec2(v[SCENE_LIGHTMAP_UV_OFFSET] * width, v[SCENE_LIGHTMAP_UV_OFFSET + 1] * height);
+                position[corner] = glm::vec3(model * glm::vec4(v[0], v[1], v[2], 1.0f));
+                normal[corner] = normalMatrix * glm::vec3(v[SCENE_NORMAL_OFFSET], v[SCENE_NORMAL_OFFSET + 1], v[SCENE_NORMAL_OFFSET + 2]);
+            }
+
+            glm::vec2 e1 = texel[1] - texel[0];
+            glm::vec2 e2 = texel[2] - texel[0];
+            float area = e1.x * e2.y - e1.y * e2.x;
+            if (fabs(area) < 1e-12f)
+                continue;
+
+            glm::vec2 lo = glm::min(texel[0], glm::min(texel[1], texel[2]));
+            glm::vec2 hi = glm::max(texel[0], glm::max(texel[1], texel[2]));
+            int x0 = max(0, static_cast<int>(floor(lo.x))), x1 = min(width - 1, static_cast<int>(ceil(hi.x)));
+            int y0 = max(0, static_cast<int>(floor(lo.y))), y1 = min(height - 1, static_cast<int>(ceil(hi.y)));
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    size_t index = size_t(y) * width + x;
+                    if (target.covered[index])
+                        continue;
+
+                    glm::vec2 p = glm::vec2(x + 0.5f, y + 0.5f) - texel[0];
+                    float b1 = (p.x * e2.y - p.y * e2.x) / area;
+                    float b2 = (e1.x * p.y - e1.y * p.x) / area;
+                    float b0 = 1.0f - b1 - b2;
+                    const float edge = -1e-4f; // keeps texels exactly on a shared edge
+                    if (b0 < edge || b1 < edge || b2 < edge)
+                        continue;
+
+                    target.positions[index] = position[0] * b0 + position[1] * b1 + position[2] * b2;
+                    target.normals[index] = glm::normalize(normal[0] * b0 + normal[1] * b1 + normal[2] * b2);
+                    target.covered[index] = 1;
+                }
+            }
+        }
+    }
+
+    // Fills the padding around every chart from the chart's border, one ring of texels per pass
+    void UDilate(ImageHdr& image, vector<unsigned char> covered)
+    {
+        for (int pass = 0; pass < LIGHTMAP_PADDING; pass++)
+        {
+            vector<unsigned char> next = covered;
+            for (int y = 0; y < image.height; y++)
+            {
+                for (int x = 0; x < image.width; x++)
+                {
+                    if (covered[size_t(y) * image.width + x])
+                        continue;
+
+                    glm::vec3 sum(0.0f);
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < 0 || ny < 0 || nx >= image.width || ny >= image.height || !covered[size_t(ny) * image.width + nx])
+                                continue;
+                            const float* rgb = &image.pixels[(size_t(ny) * image.width + nx) * 3];
+                            sum += glm::vec3(rgb[0], rgb[1], rgb[2]);
+                            count++;
+                        }
+                    }
+                    if (count == 0)
+                        continue;
+
+                    float* out = &image.pixels[(size_t(y) * image.width + x) * 3];
+                    out[0] = sum.x / count;
+                    out[1] = sum.y / count;
+                    out[2] = sum.z / count;
+                    next[size_t(y) * image.width + x] = 1;
+                }
+            }
+            covered.swap(next);
+        }
+    }
+}
+
+void UGenerateLightmapUVs(SceneMeshData& mesh, const glm::mat4& model)
+{
+    const size_t vertexCount = mesh.vertices.size() / SCENE_VERTEX_FLOATS;
+    const size_t triangleCount = mesh.indices.size() / 3;
+
+    // Charts are the mesh's connected pieces; vertices are already split wherever the texture
+    // coordinates or (on faceted meshes) the normals jump, so every piece is one smooth surface
+    vector<unsigned> parent(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        parent[v] = static_cast<unsigned>(v);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        unsigned a = UFindRoot(parent, mesh.indices[t * 3]);
+        for (int corner = 1; corner < 3; corner++)
+        {
+            unsigned b = UFindRoot(parent, mesh.indices[t * 3 + corner]);
+            if (a != b)
+                parent[b] = a;
+        }
+    }
+
+    vector<Chart> charts;
+    vector<int> chartOfRoot(vertexCount, -1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        unsigned root = UFindRoot(parent, mesh.indices[t * 3]);
+        if (chartOfRoot[root] < 0)
+        {
+            chartOfRoot[root] = static_cast<int>(charts.size());
+            charts.push_back(Chart());
+        }
+        charts[chartOfRoot[root]].triangles.push_back(static_cast<unsigned>(t));
+    }
+
+    vector<glm::vec3> world(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        world[v] = glm::vec3(model * glm::vec4(UVertexPosition(mesh, static_cast<unsigned>(v)), 1.0f));
+    vector<glm::vec2> flat(vertexCount, glm::vec2(0.0f));
+    for (Chart& chart : charts)
+        UFlattenChart(mesh, world, chart, flat);
+
+    // Lower the density until the lightmap fits
+    float texelsPerUnit = LIGHTMAP_TEXELS_PER_UNIT;
+    int width = 0, height = 0;
+    for (;;)
+    {
+        UPackCharts(charts, texelsPerUnit, width, height);
+        int largest = max(width, height);
+        if (largest <= LIGHTMAP_MAX_SIZE || texelsPerUnit < 0.01f)
+            break;
+        texelsPerUnit *= 0.95f * LIGHTMAP_MAX_SIZE / largest;
+    }
+
+    for (const Chart& chart : charts)
+    {
+        glm::vec2 origin(chart.x + LIGHTMAP_PADDING, chart.y + LIGHTMAP_PADDING);
+        for (unsigned t : chart.triangles)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned v = mesh.indices[t * 3 + corner];
+                glm::vec2 texel = origin + (flat[v] - chart.min) * texelsPerUnit;
+                float* out = &mesh.vertices[size_t(v) * SCENE_VERTEX_FLOATS + SCENE_LIGHTMAP_UV_OFFSET];
+                out[0] = texel.x / width;
+                out[1] = texel.y / height;
+            }
+        }
+    }
+    mesh.lightmapWidth = width;
+    mesh.lightmapHeight = height;
+}
+
+string ULightmapPath(const char* directory, size_t objectIndex)
+{
+    const SceneObject& object = USceneObjects()[objectIndex];
+    return string(directory) + "/" + USceneMeshName(object.mesh) + ".hdr";
+}
+
+void UBakeLightmaps(const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], const LightmapSettings& settings,
+    vector<ImageHdr>& lightmaps)
+{
+    const vector<SceneObject>& objects = USceneObjects();
+    // Every object is in the way of the rays, lightmapped or not; nothing in the scene moves far
+    BakeScene scene;
+    UBuildBakeScene(meshes, false, scene);
+
+    lightmaps.assign(objects.size(), ImageHdr());
+    vector<BakeTarget> targets(objects.size());
+    vector<BakeTile> tiles;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const SceneMeshData& mesh = meshes[objects[i].mesh][0];
+        if (!objects[i].lightmapped || mesh.lightmapWidth == 0)
+            continue;
+
+        ImageHdr& lightmap = lightmaps[i];
+        lightmap.width = mesh.lightmapWidth;
+        lightmap.height = mesh.lightmapHeight;
+        lightmap.pixels.assign(size_t(lightmap.width) * lightmap.height * 3, 0.0f);
+        URasterizeTarget(mesh, objects[i].model, targets[i]);
+
+        for (int y = 0; y < lightmap.height; y += LIGHTMAP_TILE_SIZE)
+            for (int x = 0; x < lightmap.width; x += LIGHTMAP_TILE_SIZE)
+                tiles.push_back({ i, x, y });
+    }
+
+    // Tiles cost very different amounts (empty padding, shadowed corners, open floor), and
+    // neighbouring tiles trace through the same part of the BVH, so workers keep runs of
+    // tiles and steal from each other as they run dry
+    UParallelFor(tiles.size(), [&](size_t t)
+        {
+            const BakeTile& tile = tiles[t];
+            const BakeTarget& target = targets[tile.object];
+            ImageHdr& lightmap = lightmaps[tile.object];
+            for (int y = tile.y; y < min(tile.y + LIGHTMAP_TILE_SIZE, lightmap.height); y++)
+            {
+                for (int x = tile.x; x < min(tile.x + LIGHTMAP_TILE_SIZE, lightmap.width); x++)
+                {
+                    size_t index = size_t(y) * lightmap.width + x;
+                    if (!target.covered[index])
+                        continue;
+
+                    uint32_t random = URandomSeed(static_cast<uint32_t>(tile.object), x, y);
+                    const glm::vec3& normal = target.normals[index];
+                    glm::vec3 origin = target.positions[index] + normal * LIGHTMAP_RAY_OFFSET;
+                    glm::vec3 gathered(0.0f);
+                    for (int s = 0; s < settings.samples; s++)
+                        gathered += UTraceRadiance(scene, origin, UCosineDirection(normal, random), settings.bounces, random);
+                    glm::vec3 irradiance = UDirectLight(scene, origin, normal) + gathered / float(max(settings.samples, 1));
+
+                    float* out = &lightmap.pixels[index * 3];
+                    out[0] = irradiance.x;
+                    out[1] = irradiance.y;
+                    out[2] = irradiance.z;
+                }
+            }
+        });
+
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        if (lightmaps[i].width > 0)
+            UDilate(lightmaps[i], targets[i].covered);
+    }
+}
+
+int ULightmapBakeMain(int argc, char* argv[])
+{
+    LightmapSettings settings;
+    int probeSamples = PROBE_SAMPLES;
+    const char* directory = LIGHTMAP_DIRECTORY;
+    for (int i = 2; i < argc; i++)
+    {
+        if (UParseThreadsOption(argc, argv, i))
+            continue;
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            settings.samples = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--probe-samples") == 0 && i + 1 < argc)
+            probeSamples = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--bounces") == 0 && i + 1 < argc)
+            settings.bounces = max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            directory = argv[++i];
+    }
+
+    SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT];
+    UBuildSceneMeshes(meshes);
+
+    cout << "INFO: Baking lightmaps, " << settings.samples << " paths per texel, up to " << settings.bounces
+         << " bounces, on " << UParallelThreadCount() << " threads" << endl;
+    auto start = chrono::steady_clock::now();
+    vector<ImageHdr> lightmaps;
+    UBakeLightmaps(meshes, settings, lightmaps);
+    ProbeGrid probes;
+    int insideProbes = UBakeLightProbes(meshes, probeSamples, settings.bounces, probes);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (!UMakeDirectory(directory))
+    {
+        cout << "ERROR::LIGHTMAP::DIRECTORY_NOT_CREATED\n" << directory << endl;
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < lightmaps.size(); i++)
+    {
+        if (lightmaps[i].width == 0)
+            continue;
+
+        string path = ULightmapPath(directory, i);
+        if (!UWriteHdr(path.c_str(), lightmaps[i]))
+        {
+            cout << "ERROR::LIGHTMAP::WRITE_FAILED\n" << path << endl;
+            ok = false;
+            continue;
+        }
+        cout << "INFO: " << USceneMeshName(USceneObjects()[i].mesh) << " lightmap " << lightmaps[i].width << "x"
+             << lightmaps[i].height << " written to " << path << endl;
+    }
+
+    string probePath = UProbeGridPath(directory);
+    if (UWriteProbeGrid(probePath.c_str(), probes))
+    {
+        cout << "INFO: " << probes.size[0] * probes.size[1] * probes.size[2] << " light probes (" << insideProbes
+             << " inside shapes, filled from neighbours) written to " << probePath << endl;
+    }
+    else
+    {
+        cout << "ERROR::LIGHTMAP::WRITE_FAILED\n" << probePath << endl;
+        ok = false;
+    }
+    cout << fixed << setprecision(2) << "INFO: Baked in " << seconds << " s" << endl;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
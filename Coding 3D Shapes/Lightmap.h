@@ -0,0 +1,47 @@
+#pragma once
+
+// Baked lighting for the static objects. Every lightmapped object gets a lightmap of its own: its
+// triangles are grouped into charts (connected pieces of the mesh), each chart is laid flat and
+// packed into the lightmap at a fixed number of texels per world unit, and the baker path-traces
+// the baked lights, the ambient sky and light bounced between surfaces into every covered texel.
+// At runtime all of that is one texture fetch. Nothing in here touches GL, so lightmaps can be
+// baked on machines without a GPU.
+
+#include "ImageIO.h"
+#include "Scene.h"
+
+#include <string>
+#include <vector>
+
+const float LIGHTMAP_TEXELS_PER_UNIT = 16.0f;
+// Empty texels left around every chart and then filled from its border, so bilinear
+// filtering at a chart's edge never blends in a neighbouring chart
+const int LIGHTMAP_PADDING = 2;
+// Objects whose lightmap would be larger than this get fewer texels per unit
+const int LIGHTMAP_MAX_SIZE = 1024;
+const int LIGHTMAP_SAMPLES = 64; // paths traced per texel
+const int LIGHTMAP_BOUNCES = 3;  // surfaces a path may bounce off before it is cut short
+const char* const LIGHTMAP_DIRECTORY = "lightmaps";
+// Texture unit the scene shaders read lightmaps from; units 0 and 1 hold the surface texture and shadow map
+const int LIGHTMAP_TEXTURE_UNIT = 2;
+
+struct LightmapSettings
+{
+    int samples = LIGHTMAP_SAMPLES;
+    int bounces = LIGHTMAP_BOUNCES;
+};
+
+// Charts `mesh` as placed in the world by `model`, writes every vertex's lightmap coordinate at
+// SCENE_LIGHTMAP_UV_OFFSET and sets the mesh's lightmap size
+void UGenerateLightmapUVs(SceneMeshData& mesh, const glm::mat4& model);
+// Where the lightmap of scene object `objectIndex` is written and read
+std::string ULightmapPath(const char* directory, size_t objectIndex);
+// Bakes irradiance (what the shaders multiply the surface color by) for every lightmapped object in
+// USceneObjects(); the others get an empty image. Texels are baked in tiles spread over all cores,
+// and every texel draws its own random numbers, so the result is the same on any number of threads.
+void UBakeLightmaps(const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], const LightmapSettings& settings,
+    std::vector<ImageHdr>& lightmaps);
+
+// Entry point for `--bake-lightmaps`: bakes without a window and writes one .hdr per lightmapped
+// object, plus the light probe grid for everything else (see LightProbes.h)
+int ULightmapBakeMain(int argc, char* argv[]);
@@ -0,0 +1,106 @@
+#include "Lod.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+    // Coarsest level that still has `needed` segments around, or the finest level if none do
+    int UCoarsestAdequateLevel(const SceneMeshData* lods, int lodCount, float needed)
+    {
+        for (int level = lodCount - 1; level > 0; level--)
+        {
+            if (lods[level].segments >= needed)
+                return level;
+        }
+        return 0;
+    }
+}
+
+ViewFrustum UExtractFrustum(const glm::mat4& viewProjection)
+{
+    // Gribb/Hartmann: each plane is the last row of the matrix plus or minus one of the others
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    ViewFrustum frustum;
+    frustum.planes[0] = rows[3] + rows[0]; // left
+    frustum.planes[1] = rows[3] - rows[0]; // right
+    frustum.planes[2] = rows[3] + rows[1]; // bottom
+    frustum.planes[3] = rows[3] - rows[1]; // top
+    frustum.planes[4] = rows[3] + rows[2]; // near
+    frustum.planes[5] = rows[3] - rows[2]; // far
+    for (glm::vec4& plane : frustum.planes)
+        plane = plane * (1.0f / glm::length(glm::vec3(plane)));
+    return frustum;
+}
+
+glm::vec3 UPointAtViewDepth(const glm::mat4& inverseProjection, float x, float y, float depth)
+{
+    // The ray runs from the unprojected near point to the unprojected far point
+    glm::vec4 nearPoint = inverseProjection * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseProjection * glm::vec4(x, y, 1.0f, 1.0f);
+    glm::vec3 a = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 b = glm::vec3(farPoint) / farPoint.w;
+    float t = (-depth - a.z) / (b.z - a.z);
+    return a + (b - a) * t;
+}
+
+void UWorldBounds(const SceneMeshData& mesh, const glm::mat4& model, glm::vec3& center, float& radius)
+{
+    center = glm::vec3(model * glm::vec4(mesh.boundsCenter, 1.0f));
+    float maxScale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    radius = mesh.boundsRadius * maxScale;
+}
+
+bool USphereInFrustum(const ViewFrustum& frustum, const glm::vec3& center, float radius)
+{
+    for (const glm::vec4& plane : frustum.planes)
+    {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+float UProjectedDiameter(const glm::vec3& center, float radius, const glm::mat4& view, const glm::mat4& projection,
+    bool isPerspective, float viewportHeight)
+{
+    // projection[1][1] is cot(fovy / 2) for perspective and 2 / (top - bottom) for ortho
+    if (!isPerspective)
+        return radius * projection[1][1] * viewportHeight;
+
+    float depth = -(view * glm::vec4(center, 1.0f)).z;
+    if (depth <= radius)
+        return viewportHeight * 4.0f; // camera is inside or touching the bounds: treat as full detail
+    return radius * projection[1][1] * viewportHeight / depth;
+}
+
+int USelectLod(const SceneMeshData* lods, int lodCount, float projectedDiameter, LodSelection& selection)
+{
+    if (lodCount <= 1)
+    {
+        selection.level = 0;
+        return 0;
+    }
+
+    // Segments needed so each one spans about LOD_TARGET_SEGMENT_PIXELS along the silhouette
+    const float needed = glm::pi<float>() * projectedDiameter / LOD_TARGET_SEGMENT_PIXELS;
+    const int ideal = UCoarsestAdequateLevel(lods, lodCount, needed);
+
+    if (selection.level < 0 || selection.level >= lodCount || ideal < selection.level)
+    {
+        // First frame, or the object grew: refine right away so it never looks faceted
+        selection.level = ideal;
+    }
+    else if (ideal > selection.level)
+    {
+        // Only drop detail once the object is comfortably below the coarser level's threshold
+        int coarser = UCoarsestAdequateLevel(lods, lodCount, needed * (1.0f + LOD_HYSTERESIS));
+        if (coarser > selection.level)
+            selection.level = coarser;
+    }
+    return selection.level;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+// Level-of-detail selection for the procedural meshes, shared by both renderers.
+// The level comes from the object's projected size on screen, with hysteresis so
+// an object sitting near a threshold doesn't flip between levels every frame.
+
+#include "Scene.h"
+
+// Target length, in pixels, of one segment around the silhouette
+const float LOD_TARGET_SEGMENT_PIXELS = 12.0f;
+// How far below a coarser level's threshold an object has to drop before it switches down
+const float LOD_HYSTERESIS = 0.2f;
+
+// Level picked for one object, remembered between frames
+struct LodSelection
+{
+    int level = -1; // -1 until the first selection
+};
+
+struct ViewFrustum
+{
+    glm::vec4 planes[6]; // inward-facing, normalized
+};
+
+ViewFrustum UExtractFrustum(const glm::mat4& viewProjection);
+// View-space point on the ray through NDC (x, y) at view depth `depth` (distance in front of the camera).
+// Works for perspective and orthographic projections alike.
+glm::vec3 UPointAtViewDepth(const glm::mat4& inverseProjection, float x, float y, float depth);
+// World-space bounding sphere of a mesh placed with `model`
+void UWorldBounds(const SceneMeshData& mesh, const glm::mat4& model, glm::vec3& center, float& radius);
+bool USphereInFrustum(const ViewFrustum& frustum, const glm::vec3& center, float radius);
+// Diameter of a world-space sphere on screen, in pixels
+float UProjectedDiameter(const glm::vec3& center, float radius, const glm::mat4& view, const glm::mat4& projection,
+    bool isPerspective, float viewportHeight);
+
+// Picks a level from lods[0..lodCount) for the given on-screen diameter and updates `selection`
+int USelectLod(const SceneMeshData* lods, int lodCount, float projectedDiameter, LodSelection& selection);
@@ -0,0 +1,262 @@
+#include "MeshNormals.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const size_t TRIANGLES_PER_BLOCK = 256;
+    const size_t VERTICES_PER_BLOCK = 256;
+
+    // One triangle's contribution to its corners: each vector is scaled by the triangle's area
+    struct FaceFrame
+    {
+        glm::vec3 normal;
+        glm::vec3 tangent;
+        glm::vec3 bitangent;
+    };
+
+    // Gives every triangle its own three vertices so nothing is shared across faces
+    void UUnweld(SceneMeshData& mesh)
+    {
+        vector<float> vertices;
+        vertices.reserve(mesh.indices.size() * SCENE_BASE_VERTEX_FLOATS);
+        for (size_t i = 0; i < mesh.indices.size(); i++)
+        {
+            const float* source = &mesh.vertices[size_t(mesh.indices[i]) * SCENE_BASE_VERTEX_FLOATS];
+            vertices.insert(vertices.end(), source, source + SCENE_BASE_VERTEX_FLOATS);
+            mesh.indices[i] = static_cast<unsigned short>(i);
+        }
+        mesh.vertices.swap(vertices);
+    }
+
+    // Merges vertices that came out identical, like the corners a flat face shares
+    void UWeldIdentical(SceneMeshData& mesh)
+    {
+        map<vector<float>, unsigned short> unique;
+        vector<float> vertices;
+        for (unsigned short& index : mesh.indices)
+        {
+            const float* source = &mesh.vertices[size_t(index) * SCENE_VERTEX_FLOATS];
+            vector<float> key(source, source + SCENE_VERTEX_FLOATS);
+            auto found = unique.find(key);
+            if (found == unique.end())
+            {
+                found = unique.emplace(key, static_cast<unsigned short>(vertices.size() / SCENE_VERTEX_FLOATS)).first;
+                vertices.insert(vertices.end(), key.begin(), key.end());
+            }
+            index = found->second;
+        }
+        mesh.vertices.swap(vertices);
+    }
+
+    // Area-weighted normal and UV tangent frame of every triangle, four triangles per SIMD step
+    void UComputeFaceFrames(const SceneMeshData& mesh, vector<FaceFrame>& faces)
+    {
+        const size_t triangleCount = mesh.indices.size() / 3;
+        faces.resize(triangleCount);
+
+        const size_t blockCount = (triangleCount + TRIANGLES_PER_BLOCK - 1) / TRIANGLES_PER_BLOCK;
+        UParallelFor(blockCount, [&](size_t block)
+            {
+                const size_t begin = block * TRIANGLES_PER_BLOCK;
+                const size_t end = min(begin + TRIANGLES_PER_BLOCK, triangleCount);
+                for (size_t t = begin; t < end; t += 4)
+                {
+                    // Transpose four triangles into lanes; a short last group repeats its final triangle
+                    float x[3][4], y[3][4], z[3][4], u[3][4], v[3][4];
+                    for (int lane = 0; lane < 4; lane++)
+                    {
+                        const size_t triangle = min(t + lane, end - 1);
+                        for (int k = 0; k < 3; k++)
+                        {
+                            const float* source = &mesh.vertices[size_t(mesh.indices[triangle * 3 + k]) * SCENE_BASE_VERTEX_FLOATS];
+                            x[k][lane] = source[SCENE_POSITION_OFFSET];
+                            y[k][lane] = source[SCENE_POSITION_OFFSET + 1];
+                            z[k][lane] = source[SCENE_POSITION_OFFSET + 2];
+                            u[k][lane] = source[SCENE_TEXCOORD_OFFSET];
+                            v[k][lane] = source[SCENE_TEXCOORD_OFFSET + 1];
+                        }
+                    }
+
+                    const Float4 e1x = ULoad4(x[1]) - ULoad4(x[0]), e1y = ULoad4(y[1]) - ULoad4(y[0]), e1z = ULoad4(z[1]) - ULoad4(z[0]);
+                    const Float4 e2x = ULoad4(x[2]) - ULoad4(x[0]), e2y = ULoad4(y[2]) - ULoad4(y[0]), e2z = ULoad4(z[2]) - ULoad4(z[0]);
+                    const Float4 du1 = ULoad4(u[1]) - ULoad4(u[0]), dv1 = ULoad4(v[1]) - ULoad4(v[0]);
+                    const Float4 du2 = ULoad4(u[2]) - ULoad4(u[0]), dv2 = ULoad4(v[2]) - ULoad4(v[0]);
+
+                    // The cross product's length is twice the area, which is the weight we want
+                    const Float4 nx = e1y * e2z - e1z * e2y;
+                    const Float4 ny = e1z * e2x - e1x * e2z;
+                    const Float4 nz = e1x * e2y - e1y * e2x;
+                    const Float4 area = USqrt(nx * nx + ny * ny + nz * nz);
+
+                    // Directions of increasing u and v across the triangle. Only their direction
+                    // matters, so scale by sign(det) and the area instead of dividing by det.
+                    const Float4 det = du1 * dv2 - du2 * dv1;
+                    const Float4 zero(0.0f), tiny(1e-12f);
+                    const Float4 flip = USelect(det < zero, Float4(-1.0f), Float4(1.0f));
+                    const Float4 usable = (det > tiny) | (det < zero - tiny);
+                    Float4 tx = e1x * dv2 - e2x * dv1, ty = e1y * dv2 - e2y * dv1, tz = e1z * dv2 - e2z * dv1;
+                    Float4 bx = e2x * du1 - e1x * du2, by = e2y * du1 - e1y * du2, bz = e2z * du1 - e1z * du2;
+                    const Float4 tScale = USelect(usable, flip * area / UMax(USqrt(tx * tx + ty * ty + tz * tz), tiny), zero);
+                    const Float4 bScale = USelect(usable, flip * area / UMax(USqrt(bx * bx + by * by + bz * bz), tiny), zero);
+                    tx = tx * tScale; ty = ty * tScale; tz = tz * tScale;
+                    bx = bx * bScale; by = by * bScale; bz = bz * bScale;
+
+                    float out[9][4];
+                    const Float4 lanes[9] = { nx, ny, nz, tx, ty, tz, bx, by, bz };
+                    for (int c = 0; c < 9; c++)
+                        UStore4(out[c], lanes[c]);
+                    for (int lane = 0; lane < 4 && t + lane < end; lane++)
+                    {
+                        FaceFrame& face = faces[t + lane];
+                        face.normal = glm::vec3(out[0][lane], out[1][lane], out[2][lane]);
+                        face.tangent = glm::vec3(out[3][lane], out[4][lane], out[5][lane]);
+                        face.bitangent = glm::vec3(out[6][lane], out[7][lane], out[8][lane]);
+                    }
+                }
+            });
+    }
+
+    // Sums each vertex's face frames. Walks a vertex-to-triangle table so every vertex is
+    // written by one worker and no locking is needed.
+    void UGatherVertexFrames(const SceneMeshData& mesh, size_t vertexCount, const vector<FaceFrame>& faces,
+        vector<FaceFrame>& frames)
+    {
+        vector<unsigned> adjacencyStart(vertexCount + 1, 0);
+        for (unsigned short index : mesh.indices)
+            adjacencyStart[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyStart[v + 1] += adjacencyStart[v];
+
+        vector<unsigned> adjacency(mesh.indices.size());
+        vector<unsigned> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t i = 0; i < mesh.indices.size(); i++)
+            adjacency[fill[mesh.indices[i]]++] = unsigned(i / 3);
+
+        frames.assign(vertexCount, FaceFrame{ glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) });
+        const size_t blockCount = (vertexCount + VERTICES_PER_BLOCK - 1) / VERTICES_PER_BLOCK;
+        UParallelFor(blockCount, [&](size_t block)
+            {
+                const size_t end = min((block + 1) * VERTICES_PER_BLOCK, vertexCount);
+                for (size_t v = block * VERTICES_PER_BLOCK; v < end; v++)
+                {
+                    FaceFrame& frame = frames[v];
+                    for (unsigned i = adjacencyStart[v]; i < adjacencyStart[v + 1]; i++)
+                    {
+                        const FaceFrame& face = faces[adjacency[i]];
+                        frame.normal += face.normal;
+                        frame.tangent += face.tangent;
+                        frame.bitangent += face.bitangent;
+                    }
+                }
+            });
+    }
+
+    // Shares frames between vertices duplicated at one position whose normals roughly agree.
+    // Positions are compared on a fine grid: the generators' trig leaves poles a few ulps apart.
+    void UWeldSeams(const SceneMeshData& mesh, size_t vertexCount, vector<FaceFrame>& frames)
+    {
+        const float gridSize = 1e-5f;
+        vector<array<long, 3>> keys(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            const float* p = &mesh.vertices[v * SCENE_BASE_VERTEX_FLOATS + SCENE_POSITION_OFFSET];
+            for (int c = 0; c < 3; c++)
+                keys[v][c] = lround(p[c] / gridSize);
+        }
+
+        vector<size_t> order(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            order[v] = v;
+        sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+        const vector<FaceFrame> accumulated = frames;
+        for (size_t first = 0; first < vertexCount;)
+        {
+            size_t last = first + 1;
+            while (last < vertexCount && keys[order[last]] == keys[order[first]])
+                last++;
+
+            // A vertex only touched by sliver triangles (the last column at a pole) has no
+            // reliable direction of its own, so it takes the whole group's frame
+            float groupLength = 0.0f;
+            for (size_t j = first; j < last; j++)
+                groupLength = max(groupLength, glm::length(accumulated[order[j]].normal));
+
+            for (size_t i = first; i < last && last - first > 1; i++)
+            {
+                const glm::vec3 own = accumulated[order[i]].normal;
+                const float ownLength = glm::length(own);
+                const bool undecided = ownLength < groupLength * 1e-3f;
+                FaceFrame merged = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+                for (size_t j = first; j < last; j++)
+                {
+                    const FaceFrame& other = accumulated[order[j]];
+                    const float otherLength = glm::length(other.normal);
+                    if (j != i && !undecided && glm::dot(own, other.normal) < NORMAL_WELD_MIN_COS * ownLength * otherLength)
+                        continue;
+                    merged.normal += other.normal;
+                    merged.tangent += other.tangent;
+                    merged.bitangent += other.bitangent;
+                }
+                frames[order[i]] = merged;
+            }
+            first = last;
+        }
+    }
+}
+
+void UGenerateNormalsAndTangents(SceneMeshData& mesh, bool faceted)
+{
+    if (faceted)
+        UUnweld(mesh);
+
+    const size_t vertexCount = mesh.vertices.size() / SCENE_BASE_VERTEX_FLOATS;
+    vector<FaceFrame> faces;
+    vector<FaceFrame> frames;
+    UComputeFaceFrames(mesh, faces);
+    UGatherVertexFrames(mesh, vertexCount, faces, frames);
+    if (!faceted)
+        UWeldSeams(mesh, vertexCount, frames);
+
+    // Orthonormalise and write out the wider vertices
+    vector<float> vertices(vertexCount * SCENE_VERTEX_FLOATS);
+    const size_t blockCount = (vertexCount + VERTICES_PER_BLOCK - 1) / VERTICES_PER_BLOCK;
+    UParallelFor(blockCount, [&](size_t block)
+        {
+            const size_t end = min((block + 1) * VERTICES_PER_BLOCK, vertexCount);
+            for (size_t v = block * VERTICES_PER_BLOCK; v < end; v++)
+            {
+                const FaceFrame& frame = frames[v];
+                glm::vec3 normal = glm::length(frame.normal) > 0.0f ? glm::normalize(frame.normal) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+                // Gram-Schmidt; fall back to any perpendicular where the UVs gave no direction
+                glm::vec3 tangent = frame.tangent - normal * glm::dot(normal, frame.tangent);
+                if (glm::length(tangent) < 1e-6f)
+                    tangent = glm::cross(fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f), normal);
+                tangent = glm::normalize(tangent);
+                const float handedness = glm::dot(glm::cross(normal, tangent), frame.bitangent) < 0.0f ? -1.0f : 1.0f;
+
+                float* out = &vertices[v * SCENE_VERTEX_FLOATS];
+                copy_n(&mesh.vertices[v * SCENE_BASE_VERTEX_FLOATS], SCENE_BASE_VERTEX_FLOATS, out);
+                out[SCENE_NORMAL_OFFSET] = normal.x;
+                out[SCENE_NORMAL_OFFSET + 1] = normal.y;
+                out[SCENE_NORMAL_OFFSET + 2] = normal.z;
+                out[SCENE_TANGENT_OFFSET] = tangent.x;
+                out[SCENE_TANGENT_OFFSET + 1] = tangent.y;
+                out[SCENE_TANGENT_OFFSET + 2] = tangent.z;
+                out[SCENE_TANGENT_OFFSET + 3] = handedness;
+            }
+        });
+    mesh.vertices.swap(vertices);
+
+    if (faceted)
+        UWeldIdentical(mesh);
+}
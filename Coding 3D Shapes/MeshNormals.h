@@ -0,0 +1,17 @@
+#pragma once
+
+// Normal and tangent generation for the scene meshes. Face normals and UV-space tangents are
+// computed four triangles at a time and spread over all cores, then gathered per vertex.
+// Tangents follow MikkTSpace's conventions: orthogonalised against the normal, with the
+// bitangent's handedness in w, so a normal map baked for MikkTSpace reads back correctly.
+
+#include "Scene.h"
+
+// Duplicated vertices at the same position (UV seams, sphere poles) share one smoothed normal
+// when their own normals are within this cosine of each other (60 degrees). Sharper creases,
+// like a cylinder's rim, stay hard.
+const float NORMAL_WELD_MIN_COS = 0.5f;
+
+// Expands `mesh` from SCENE_BASE_VERTEX_FLOATS to SCENE_VERTEX_FLOATS floats per vertex and fills
+// in normals and tangents. Faceted meshes get their vertices split so every face is lit flat.
+void UGenerateNormalsAndTangents(SceneMeshData& mesh, bool faceted);
@@ -0,0 +1,344 @@
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+    // Forsyth's "Linear-Speed Vertex Cache Optimisation" scoring, with his suggested constants
+    const int FORSYTH_CACHE_SIZE = 32;
+    const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+    const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+    const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+    const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+    float UForsythScore(int cachePosition, int liveTriangles)
+    {
+        if (liveTriangles == 0)
+            return -1.0f; // nothing left to draw with this vertex
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // The last triangle's vertices get a fixed score so the next one doesn't just reuse an edge
+            if (cachePosition < 3)
+                score = FORSYTH_LAST_TRIANGLE_SCORE;
+            else
+                score = pow(1.0f - float(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+        }
+
+        // Favour vertices with few triangles left so they get finished off and drop out
+        score += FORSYTH_VALENCE_BOOST_SCALE * pow(float(liveTriangles), -FORSYTH_VALENCE_BOOST_POWER);
+        return score;
+    }
+
+    glm::vec3 UVertexPosition(const vector<float>& vertices, int stride, unsigned short index)
+    {
+        const float* p = &vertices[size_t(index) * stride];
+        return glm::vec3(p[0], p[1], p[2]);
+    }
+}
+
+MeshCacheStats UAnalyzeVertexCache(const vector<unsigned short>& indices, size_t vertexCount, int cacheSize)
+{
+    MeshCacheStats stats;
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+
+    // FIFO cache: a vertex is still cached if fewer than cacheSize misses happened since it went in
+    vector<unsigned> insertedAt(vertexCount, 0);
+    vector<bool> used(vertexCount, false);
+    unsigned clock = cacheSize + 1;
+    size_t misses = 0;
+    size_t uniqueVertices = 0;
+    for (unsigned short index : indices)
+    {
+        if (clock - insertedAt[index] > unsigned(cacheSize))
+        {
+            insertedAt[index] = clock++;
+            misses++;
+        }
+        if (!used[index])
+        {
+            used[index] = true;
+            uniqueVertices++;
+        }
+    }
+
+    stats.acmr = float(misses) / float(indices.size() / 3);
+    stats.atvr = float(misses) / float(uniqueVertices);
+    return stats;
+}
+
+void UOptimizeVertexCache(vector<unsigned short>& indices, size_t vertexCount)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles using each vertex, packed into one array; the first liveTriangles[v] entries
+    // of a vertex's range are the ones not drawn yet
+    vector<unsigned> adjacencyStart(vertexCount + 1, 0);
+    for (unsigned short index : indices)
+        adjacencyStart[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyStart[v + 1] += adjacencyStart[v];
+
+    vector<unsigned> adjacency(indices.size());
+    vector<int> liveTriangles(vertexCount, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned short v = indices[t * 3 + k];
+            adjacency[adjacencyStart[v] + liveTriangles[v]++] = unsigned(t);
+        }
+    }
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = UForsythScore(-1, liveTriangles[v]);
+
+    vector<float> triangleScore(triangleCount);
+    vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    vector<unsigned short> ordered;
+    ordered.reserve(indices.size());
+    vector<unsigned short> cache, nextCache; // most recently used first
+    long best = long(max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+
+    while (ordered.size() < indices.size())
+    {
+        if (best < 0)
+        {
+            // Nothing in the cache touches an undrawn triangle: start again from the best of the rest
+            float bestScore = -1.0f;
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                if (!emitted[t] && triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = long(t);
+                }
+            }
+        }
+
+        emitted[best] = true;
+        nextCache.clear();
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned short v = indices[best * 3 + k];
+            ordered.push_back(v);
+            nextCache.push_back(v);
+
+            // Move the triangle past the end of the vertex's live range
+            unsigned* first = &adjacency[adjacencyStart[v]];
+            unsigned* last = first + liveTriangles[v] - 1;
+            *find(first, last + 1, unsigned(best)) = *last;
+            *last = unsigned(best);
+            liveTriangles[v]--;
+        }
+        for (unsigned short v : cache)
+        {
+            if (find(nextCache.begin(), nextCache.begin() + 3, v) == nextCache.begin() + 3)
+                nextCache.push_back(v);
+        }
+
+        // Rescore everything that entered, moved in or fell out of the cache
+        for (size_t i = 0; i < nextCache.size(); i++)
+        {
+            unsigned short v = nextCache[i];
+            cachePosition[v] = i < size_t(FORSYTH_CACHE_SIZE) ? int(i) : -1;
+            vertexScore[v] = UForsythScore(cachePosition[v], liveTriangles[v]);
+        }
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned short v : nextCache)
+        {
+            for (int i = 0; i < liveTriangles[v]; i++)
+            {
+                unsigned t = adjacency[adjacencyStart[v] + i];
+                triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = long(t);
+                }
+            }
+        }
+
+        if (nextCache.size() > size_t(FORSYTH_CACHE_SIZE))
+            nextCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(nextCache);
+    }
+
+    indices.swap(ordered);
+}
+
+void UOptimizeOverdraw(vector<unsigned short>& indices, const vector<float>& vertices, int stride, float threshold)
+{
+    // Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw":
+    // cut the cache-friendly order into clusters wherever the run so far is already about as
+    // cache-efficient as the whole mesh, then draw the clusters facing away from the center first
+    const size_t triangleCount = indices.size() / 3;
+    const size_t vertexCount = vertices.size() / stride;
+    if (triangleCount < 2)
+        return;
+
+    const float targetAcmr = UAnalyzeVertexCache(indices, vertexCount).acmr * threshold;
+    vector<size_t> clusterStarts(1, 0);
+    {
+        vector<unsigned> insertedAt(vertexCount, 0);
+        unsigned clock = MESH_ANALYSIS_CACHE_SIZE + 1;
+        size_t misses = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned short v = indices[t * 3 + k];
+                if (clock - insertedAt[v] > unsigned(MESH_ANALYSIS_CACHE_SIZE))
+                {
+                    insertedAt[v] = clock++;
+                    misses++;
+                }
+            }
+
+            size_t clusterTriangles = t + 1 - clusterStarts.back();
+            if (t + 1 < triangleCount && float(misses) / clusterTriangles <= targetAcmr)
+            {
+                // Clusters get drawn in any order, so the next one starts with a cold cache
+                clusterStarts.push_back(t + 1);
+                clock += MESH_ANALYSIS_CACHE_SIZE + 1;
+                misses = 0;
+            }
+        }
+    }
+    if (clusterStarts.size() < 2)
+        return;
+    clusterStarts.push_back(triangleCount);
+
+    // Area-weighted centroid and normal of every cluster, and of the whole mesh
+    const size_t clusterCount = clusterStarts.size() - 1;
+    vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.0f));
+    vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float clusterArea = 0.0f;
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            glm::vec3 a = UVertexPosition(vertices, stride, indices[t * 3]);
+            glm::vec3 b = UVertexPosition(vertices, stride, indices[t * 3 + 1]);
+            glm::vec3 d = UVertexPosition(vertices, stride, indices[t * 3 + 2]);
+            glm::vec3 areaNormal = glm::cross(b - a, d - a) * 0.5f; // length is the triangle's area
+            float area = glm::length(areaNormal);
+            clusterCentroid[c] += (a + b + d) * (area / 3.0f);
+            clusterNormal[c] += areaNormal;
+            clusterArea += area;
+        }
+        meshCentroid += clusterCentroid[c];
+        meshArea += clusterArea;
+        if (clusterArea > 0.0f)
+            clusterCentroid[c] = clusterCentroid[c] * (1.0f / clusterArea);
+    }
+    if (meshArea > 0.0f)
+        meshCentroid = meshCentroid * (1.0f / meshArea);
+
+    vector<float> sortKey(clusterCount);
+    vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float normalLength = glm::length(clusterNormal[c]);
+        glm::vec3 normal = normalLength > 0.0f ? clusterNormal[c] * (1.0f / normalLength) : glm::vec3(0.0f);
+        sortKey[c] = glm::dot(clusterCentroid[c] - meshCentroid, normal);
+        order[c] = c;
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    vector<unsigned short> sorted;
+    sorted.reserve(indices.size());
+    for (size_t c : order)
+        sorted.insert(sorted.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+    indices.swap(sorted);
+}
+
+void UOptimizeVertexFetch(SceneMeshData& mesh, int stride)
+{
+    const size_t vertexCount = mesh.vertices.size() / stride;
+    vector<int> remap(vertexCount, -1);
+    int next = 0;
+    for (unsigned short index : mesh.indices)
+    {
+        if (remap[index] < 0)
+            remap[index] = next++;
+    }
+    // Unreferenced vertices keep their data, after everything that is drawn
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] < 0)
+            remap[v] = next++;
+    }
+
+    vector<float> vertices(mesh.vertices.size());
+    for (size_t v = 0; v < vertexCount; v++)
+        copy_n(mesh.vertices.begin() + v * stride, stride, vertices.begin() + size_t(remap[v]) * stride);
+    mesh.vertices.swap(vertices);
+
+    for (unsigned short& index : mesh.indices)
+        index = static_cast<unsigned short>(remap[index]);
+}
+
+void UOptimizeMesh(SceneMeshData& mesh, int stride)
+{
+    const size_t vertexCount = mesh.vertices.size() / stride;
+    vector<unsigned short> original = mesh.indices;
+    UOptimizeVertexCache(mesh.indices, vertexCount);
+    UOptimizeOverdraw(mesh.indices, mesh.vertices, stride);
+
+    // Small meshes that already fit in the cache can come out slightly worse; keep their order
+    if (UAnalyzeVertexCache(mesh.indices, vertexCount).acmr > UAnalyzeVertexCache(original, vertexCount).acmr)
+        mesh.indices.swap(original);
+    UOptimizeVertexFetch(mesh, stride);
+}
+
+int UMeshStatsMain(int, char* [])
+{
+    SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT];
+    UBuildSceneMeshes(meshes, false);
+
+    cout << fixed << setprecision(3);
+    cout << "INFO: ACMR/ATVR with a " << MESH_ANALYSIS_CACHE_SIZE << "-entry FIFO cache, before -> after" << endl;
+    size_t transformsBefore = 0, transformsAfter = 0;
+    for (int i = 0; i < MESH_COUNT; i++)
+    {
+        SceneMeshId id = static_cast<SceneMeshId>(i);
+        for (int lod = 0; lod < USceneLodCount(id); lod++)
+        {
+            SceneMeshData& mesh = meshes[i][lod];
+            const size_t vertexCount = mesh.vertices.size() / SCENE_VERTEX_FLOATS;
+            const size_t triangleCount = mesh.indices.size() / 3;
+            MeshCacheStats before = UAnalyzeVertexCache(mesh.indices, vertexCount);
+            UOptimizeMesh(mesh, SCENE_VERTEX_FLOATS);
+            MeshCacheStats after = UAnalyzeVertexCache(mesh.indices, vertexCount);
+
+            transformsBefore += size_t(before.acmr * triangleCount + 0.5f);
+            transformsAfter += size_t(after.acmr * triangleCount + 0.5f);
+            cout << "INFO: " << USceneMeshName(id) << " LOD " << lod << ": " << triangleCount << " triangles, ACMR "
+                << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << endl;
+        }
+    }
+
+    cout << "INFO: vertex shader runs for all meshes: " << transformsBefore << " -> " << transformsAfter << endl;
+    cout << "INFO: GPU vertex size " << UCompactVertexFormat().stride << " bytes (" << SCENE_VERTEX_FLOATS * sizeof(float)
+        << " bytes as floats)" << endl;
+    return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+// Index and vertex reordering for the scene meshes, run once when they are built so both
+// renderers get the same data. Triangles are ordered for the post-transform vertex cache
+// (Forsyth), groups of them are then ordered so outward-facing ones draw first to cut
+// overdraw, and finally vertices are renumbered in the order they are fetched.
+
+#include "Scene.h"
+
+#include <cstddef>
+#include <vector>
+
+// FIFO cache size assumed when measuring ACMR; close to what current GPUs reuse
+const int MESH_ANALYSIS_CACHE_SIZE = 16;
+// How much worse than the cache-optimal order a cluster may get before the overdraw pass splits it
+const float MESH_OVERDRAW_THRESHOLD = 1.05f;
+
+struct MeshCacheStats
+{
+    float acmr = 0.0f; // vertex shader runs per triangle (0.5 is ideal on a regular grid, 3 is worst)
+    float atvr = 0.0f; // vertex shader runs per vertex (1 is ideal)
+};
+
+MeshCacheStats UAnalyzeVertexCache(const std::vector<unsigned short>& indices, size_t vertexCount,
+    int cacheSize = MESH_ANALYSIS_CACHE_SIZE);
+
+void UOptimizeVertexCache(std::vector<unsigned short>& indices, size_t vertexCount);
+// Expects indices already ordered by UOptimizeVertexCache
+void UOptimizeOverdraw(std::vector<unsigned short>& indices, const std::vector<float>& vertices, int stride,
+    float threshold = MESH_OVERDRAW_THRESHOLD);
+// Rewrites vertices and indices so vertices appear in first-use order
+void UOptimizeVertexFetch(SceneMeshData& mesh, int stride);
+// All three passes, in order
+void UOptimizeMesh(SceneMeshData& mesh, int stride);
+
+// Entry point for `--mesh-stats`: prints ACMR before and after optimization for every mesh
+int UMeshStatsMain(int argc, char* argv[]);
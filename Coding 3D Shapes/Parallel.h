@@ -0,0 +1,76 @@
+#pragma once
+
+// Small helpers for spreading CPU-side loops over all cores, on the job scheduler (see Jobs.h).
+
+#include "Jobs.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+// Most workers the job scheduler starts, whatever the setting or the hardware asks for
+const unsigned PARALLEL_MAX_THREADS = 256;
+
+// Number of workers the job scheduler starts, the calling thread included; 0 means one per hardware
+// thread. Read once, when the scheduler starts.
+inline unsigned& UParallelThreadSetting()
+{
+    static unsigned threadCount = 0;
+    return threadCount;
+}
+
+inline unsigned UParallelThreadCount()
+{
+    unsigned count = UParallelThreadSetting();
+    if (count == 0)
+        count = std::thread::hardware_concurrency();
+    return std::min(count == 0 ? 1u : count, PARALLEL_MAX_THREADS);
+}
+
+// Reads `--threads N` at argv[i] into UParallelThreadSetting(), clamped to [0, PARALLEL_MAX_THREADS],
+// and steps i past N. Returns false, leaving i alone, for any other argument.
+inline bool UParseThreadsOption(int argc, char* argv[], int& i)
+{
+    if (strcmp(argv[i], "--threads") != 0 || i + 1 >= argc)
+        return false;
+    UParallelThreadSetting() = unsigned(std::min(std::max(0, atoi(argv[++i])), int(PARALLEL_MAX_THREADS)));
+    return true;
+}
+
+// Runs fn(i) for i in [begin, end): splits off the back half as a job for idle workers to steal
+// until at most `grain` items are left, runs those, then takes up the pieces no one stole, nearest first
+template <class Fn>
+void UParallelRange(const Fn& fn, JobCounter& counter, size_t begin, size_t end, size_t grain)
+{
+    while (end - begin > grain)
+    {
+        size_t middle = begin + (end - begin) / 2;
+        USubmitJob(UCreateJob([&fn, &counter, middle, end, grain]() { UParallelRange(fn, counter, middle, end, grain); }, &counter));
+        end = middle;
+    }
+    for (size_t i = begin; i < end; ++i)
+        fn(i);
+}
+
+// Calls fn(i) for every i in [0, count) on the job scheduler's workers, at least `grain` items per
+// job. The range is halved only as workers run dry, so uneven items (like tiles with lots of
+// triangles) still balance out, while neighbouring items mostly stay on one worker, which suits
+// work where neighbours share data (like texels of one chart). Nested calls are fine: a worker
+// waiting on its own loop runs other jobs meanwhile.
+template <class Fn>
+void UParallelFor(size_t count, Fn fn, size_t grain = 1)
+{
+    grain = std::max<size_t>(grain, 1);
+    if (count <= grain || !UJobsAvailable() || UJobWorkerCount() < 2)
+    {
+        for (size_t i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    JobCounter counter;
+    UParallelRange(fn, counter, 0, count, grain);
+    UWaitForJobs(counter);
+}
@@ -0,0 +1,158 @@
+#include "PathTracer.h"
+#include "ImageIO.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+    // Rays leave this far off the surface so they don't hit the triangle they start on
+    const float PATH_RAY_OFFSET = 1e-3f;
+}
+
+void UBuildBakeScene(const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], bool staticOnly, BakeScene& scene)
+{
+    // Bounced light only needs each texture's average color, not its detail
+    glm::vec3 textureAverage[TEXTURE_COUNT];
+    for (int t = 0; t < TEXTURE_COUNT; t++)
+    {
+        textureAverage[t] = glm::vec3(1.0f);
+        ImageRgb image;
+        if (!ULoadImageRgb(USceneTexturePath(static_cast<SceneTextureId>(t)), image))
+        {
+            cout << "Failed to load " << USceneTexturePath(static_cast<SceneTextureId>(t)) << endl;
+            continue;
+        }
+        double sum[3] = { 0.0, 0.0, 0.0 };
+        for (size_t p = 0; p < image.pixels.size(); p++)
+            sum[p % 3] += image.pixels[p];
+        double scale = 1.0 / (255.0 * max<size_t>(image.pixels.size() / 3, 1));
+        textureAverage[t] = glm::vec3(float(sum[0] * scale), float(sum[1] * scale), float(sum[2] * scale));
+    }
+
+    vector<glm::vec3> vertices;
+    scene.normals.clear();
+    scene.albedos.clear();
+    for (const SceneObject& object : USceneObjects())
+    {
+        if (staticOnly && !object.lightmapped)
+            continue;
+
+        const SceneMeshData& mesh = meshes[object.mesh][0];
+        glm::mat3 normalMatrix = UNormalMatrix(object.model);
+        for (unsigned short index : mesh.indices)
+        {
+            const float* v = &mesh.vertices[size_t(index) * SCENE_VERTEX_FLOATS];
+            vertices.push_back(glm::vec3(object.model * glm::vec4(v[0], v[1], v[2], 1.0f)));
+            scene.normals.push_back(glm::normalize(normalMatrix *
+                glm::vec3(v[SCENE_NORMAL_OFFSET], v[SCENE_NORMAL_OFFSET + 1], v[SCENE_NORMAL_OFFSET + 2])));
+            scene.albedos.push_back(glm::vec3(v[SCENE_COLOR_OFFSET], v[SCENE_COLOR_OFFSET + 1], v[SCENE_COLOR_OFFSET + 2]) *
+                textureAverage[object.texture]);
+        }
+    }
+    UBuildBvh(vertices, scene.bvh);
+
+    scene.lights.clear();
+    for (const PointLight& light : USceneLights())
+    {
+        if (light.baked > 0.0f)
+            scene.lights.push_back(light);
+    }
+}
+
+uint32_t URandomSeed(uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t h = a * 0x9E3779B1u ^ b * 0x85EBCA77u ^ c * 0xC2B2AE3Du;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h == 0 ? 1u : h; // xorshift never leaves 0
+}
+
+float URandom(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+glm::vec3 UCosineDirection(const glm::vec3& normal, uint32_t& random)
+{
+    float angle = 2.0f * glm::pi<float>() * URandom(random);
+    float radius2 = URandom(random);
+    float radius = sqrt(radius2);
+    glm::vec3 tangent = glm::normalize(glm::cross(fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f), normal));
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+    return tangent * (radius * cos(angle)) + bitangent * (radius * sin(angle)) + normal * sqrt(max(0.0f, 1.0f - radius2));
+}
+
+glm::vec3 USphereDirection(uint32_t& random)
+{
+    float z = 1.0f - 2.0f * URandom(random);
+    float angle = 2.0f * glm::pi<float>() * URandom(random);
+    float radius = sqrt(max(0.0f, 1.0f - z * z));
+    return glm::vec3(radius * cos(angle), radius * sin(angle), z);
+}
+
+glm::vec3 UDirectLight(const BakeScene& scene, const glm::vec3& origin, const glm::vec3& normal)
+{
+    glm::vec3 irradiance(0.0f);
+    for (const PointLight& light : scene.lights)
+    {
+        glm::vec3 toLight = light.position - origin;
+        float lightDistance = glm::length(toLight);
+        glm::vec3 direction = toLight / lightDistance;
+        float cosine = glm::dot(normal, direction);
+        float falloff = ULightFalloff(lightDistance, light.radius);
+        if (cosine <= 0.0f || falloff <= 0.0f)
+            continue;
+        if (UOccludedBvh(scene.bvh, origin, direction, lightDistance))
+            continue;
+        irradiance += light.color * cosine * falloff;
+    }
+    return irradiance;
+}
+
+glm::vec3 UTraceRadiance(const BakeScene& scene, glm::vec3 origin, glm::vec3 direction, int bounces, uint32_t& random,
+    bool* backFace)
+{
+    if (backFace)
+        *backFace = false;
+
+    glm::vec3 radiance(0.0f);
+    glm::vec3 throughput(1.0f);
+    glm::vec3 normal(0.0f);
+    for (int bounce = 0; bounce < bounces; bounce++)
+    {
+        if (bounce > 0)
+            direction = UCosineDirection(normal, random);
+
+        BvhHit hit;
+        if (!UIntersectBvh(scene.bvh, origin, direction, FLT_MAX, hit))
+            return radiance + throughput * AMBIENT_LIGHT_COLOR;
+        if (hit.backFace)
+        {
+            if (backFace && bounce == 0)
+                *backFace = true;
+            return radiance; // inside a closed shape, where no light gets
+        }
+
+        float w = 1.0f - hit.u - hit.v;
+        const glm::vec3* normals = &scene.normals[hit.triangle * 3];
+        const glm::vec3* albedos = &scene.albedos[hit.triangle * 3];
+        normal = glm::normalize(normals[0] * w + normals[1] * hit.u + normals[2] * hit.v);
+        if (glm::dot(normal, direction) > 0.0f)
+            normal = -normal; // smoothed normal bent past the ray near a silhouette
+        origin += direction * hit.distance + normal * PATH_RAY_OFFSET;
+
+        throughput *= albedos[0] * w + albedos[1] * hit.u + albedos[2] * hit.v;
+        radiance += throughput * UDirectLight(scene, origin, normal);
+    }
+    return radiance;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+// CPU path tracing through the scene, shared by the bakers (lightmaps and light probes).
+// Lighting follows the fragment shader's conventions: a surface reflects its color times the
+// irradiance reaching it, baked lights arrive with the shader's diffuse term and falloff, and a
+// path that escapes the scene sees the ambient light color as a uniform sky. Nothing in here
+// touches GL.
+
+#include "Bvh.h"
+#include "Scene.h"
+
+#include <cstdint>
+#include <vector>
+
+// Everything a ray can hit while baking, world space
+struct BakeScene
+{
+    Bvh bvh;
+    std::vector<glm::vec3> normals; // three per triangle
+    std::vector<glm::vec3> albedos; // three per triangle: vertex color times the texture's average
+    std::vector<PointLight> lights; // the baked ones only
+};
+
+// Builds from every object's finest level, or only the lightmapped (static) objects
+void UBuildBakeScene(const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], bool staticOnly, BakeScene& scene);
+
+// Seed for URandom from up to three integers (an object and a texel, a probe, ...)
+uint32_t URandomSeed(uint32_t a, uint32_t b, uint32_t c);
+// xorshift32, uniform in [0, 1)
+float URandom(uint32_t& state);
+// Direction around `normal` with probability proportional to the cosine
+glm::vec3 UCosineDirection(const glm::vec3& normal, uint32_t& random);
+// Direction with every one equally likely
+glm::vec3 USphereDirection(uint32_t& random);
+
+// Baked lights reaching `origin` unblocked, weighted like the fragment shader's diffuse term
+glm::vec3 UDirectLight(const BakeScene& scene, const glm::vec3& origin, const glm::vec3& normal);
+// Light arriving at `origin` from `direction`: the ambient sky if the path escapes, otherwise what
+// the surfaces it bounces off reflect of the baked lights, up to `bounces` surfaces deep.
+// `backFace` is set if the first surface was hit from behind, i.e. `origin` is inside a shape.
+glm::vec3 UTraceRadiance(const BakeScene& scene, glm::vec3 origin, glm::vec3 direction, int bounces, uint32_t& random,
+    bool* backFace = nullptr);
@@ -0,0 +1,536 @@
+#include "Scene.h"
+#include "MeshOptimizer.h"
+#include "MeshNormals.h"
+#include "Lightmap.h"
+
+#include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace {
+    void UBuildPyramid(SceneMeshData& mesh)
+    {
+        mesh.vertices = {
+            // Vertex Positions    // Colors (r,g,b,a)       // Texture coordinates
+           0.0f,  0.5f, 0.0f,    1.0f, 0.5f, 0.0f, 1.0f,   0.5f, 1.0f, // Top Vertex 0 (apex)
+          -0.5f, -1.2f, 0.5f,    1.0f, 0.5f, 0.0f, 1.0f,   0.0f, 0.0f, // Bottom-left Vertex 1
+           0.5f, -1.2f, 0.5f,    1.0f, 0.5f, 0.0f, 1.0f,   1.0f, 0.0f, // Bottom-right Vertex 2
+
+           0.0f,  0.5f, 0.0f,    1.0f, 0.5f, 0.0f, 1.0f,   0.5f, 1.0f, // Top Vertex 3 (apex)
+           0.5f, -1.2f, 0.5f,    1.0f, 0.5f, 0.0f, 1.0f,   0.0f, 0.0f, // Bottom-right Vertex 4
+           0.5f, -1.2f, -0.5f,   1.0f, 0.5f, 0.0f, 1.0f,   1.0f, 0.0f, // Bottom-left Vertex 5
+
+           0.0f,  0.5f, 0.0f,    1.0f, 0.5f, 0.0f, 1.0f,   0.5f, 1.0f, // Top Vertex 6 (apex)
+           0.5f, -1.2f, -0.5f,   1.0f, 0.5f, 0.0f, 1.0f,   0.0f, 0.0f, // Bottom-right Vertex 7
+          -0.5f, -1.2f, -0.5f,   1.0f, 0.5f, 0.0f, 1.0f,   1.0f, 0.0f, // Bottom-left Vertex 8
+
+           0.0f,  0.5f, 0.0f,    1.0f, 0.5f, 0.0f, 1.0f,   0.5f, 1.0f, // Top Vertex 9 (apex)
+          -0.5f, -1.2f, -0.5f,   1.0f, 0.5f, 0.0f, 1.0f,   0.0f, 0.0f, // Bottom-left Vertex 10
+          -0.5f, -1.2f, 0.5f,    1.0f, 0.5f, 0.0f, 1.0f,   1.0f, 0.0f  // Bottom-right Vertex 11
+        };
+
+        mesh.indices = {
+            0, 1, 2, // Right face
+            3, 4, 5, // Back face
+            6, 7, 8, // Left face
+            9, 10, 11, // Front face
+
+            // Base of the pyramid (two triangles)
+            1, 8, 5,
+            1, 5, 2
+        };
+    }
+
+    void UBuildSphere(SceneMeshData& mesh, int numStacks, int numSlices)
+    {
+        vector<float>& sphereVertices = mesh.vertices;
+        vector<unsigned short>& sphereIndices = mesh.indices;
+        const float radius = 0.5f;
+        mesh.segments = numSlices;
+
+        // Create sphere vertices and indices
+        for (int i = 0; i <= numStacks; ++i) {
+            float phi = glm::pi<float>() * static_cast<float>(i) / numStacks;
+            for (int j = 0; j <= numSlices; ++j) {
+                float theta = 2 * glm::pi<float>() * static_cast<float>(j) / numSlices;
+
+                float x = radius * sin(phi) * cos(theta);
+                float y = radius * cos(phi);
+                float z = radius * sin(phi) * sin(theta);
+
+                float r = 1.0f; // Orange color
+                float g = 0.5f; // Orange color
+                float b = 0.0f; // Orange color
+
+                sphereVertices.push_back(x);
+                sphereVertices.push_back(y);
+                sphereVertices.push_back(z);
+                sphereVertices.push_back(r);
+                sphereVertices.push_back(g);
+                sphereVertices.push_back(b);
+                sphereVertices.push_back(1.0f);
+                sphereVertices.push_back(static_cast<float>(j) / numSlices);     // u around
+                sphereVertices.push_back(1.0f - static_cast<float>(i) / numStacks); // v from bottom to top
+            }
+        }
+
+        // Create sphere indices
+        for (int i = 0; i < numStacks; ++i) {
+            for (int j = 0; j < numSlices; ++j) {
+                int first = i * (numSlices + 1) + j;
+                int second = first + numSlices + 1;
+
+                // Counter-clockwise seen from outside, like every scene mesh
+                sphereIndices.push_back(static_cast<unsigned short>(first));
+                sphereIndices.push_back(static_cast<unsigned short>(first + 1));
+                sphereIndices.push_back(static_cast<unsigned short>(second));
+
+                sphereIndices.push_back(static_cast<unsigned short>(second));
+                sphereIndices.push_back(static_cast<unsigned short>(first + 1));
+                sphereIndices.push_back(static_cast<unsigned short>(second + 1));
+            }
+        }
+    }
+
+    void UBuildPlane(SceneMeshData& mesh)
+    {
+        // Plane vertices
+        mesh.vertices = {
+            // Positions          // Colors                // Texture coordinates
+             5.0f,  0.0f,  5.0f,   1.0f, 1.0f, 1.0f, 1.0f,  1.0f, 1.0f,  // Top Right
+             5.0f,  0.0f, -5.0f,   1.0f, 1.0f, 1.0f, 1.0f,  1.0f, 0.0f,  // Bottom Right
+            -5.0f,  0.0f, -5.0f,   1.0f, 1.0f, 1.0f, 1.0f,  0.0f, 0.0f,  // Bottom Left
+            -5.0f,  0.0f,  5.0f,   1.0f, 1.0f, 1.0f, 1.0f,  0.0f, 1.0f   // Top Left
+        };
+
+        mesh.indices = {
+            0, 1, 3,  // First Triangle
+            1, 2, 3   // Second Triangle
+        };
+    }
+
+    // numCircles: number of circles, numCirclePoints: number of points for the small circle
+    void UBuildTorus(SceneMeshData& mesh, int numCircles, int numCirclePoints)
+    {
+        // Torus vertices and indices
+        vector<float>& torusVertices = mesh.vertices;
+        vector<unsigned short>& torusIndices = mesh.indices;
+
+        const float R = 1.0f;            // Big circle radius
+        const float r = 0.25f;           // Small circle radius
+        mesh.segments = numCircles;
+
+        // Generate the torus. The first circle and point are repeated at the end so the
+        // texture coordinates can run all the way to 1 across the seams.
+        for (int i = 0; i <= numCircles; ++i) {
+            float phi = 2.0f * M_PI * i / numCircles;
+            for (int j = 0; j <= numCirclePoints; ++j) {
+                float theta = 2.0f * M_PI * j / numCirclePoints;
+
+                float x = (R + r * cos(theta)) * cos(phi);
+                float y = r * sin(theta);
+                float z = (R + r * cos(theta)) * sin(phi);
+
+                torusVertices.push_back(x);
+                torusVertices.push_back(y);
+                torusVertices.push_back(z);
+                torusVertices.push_back(0.3f);  // Color
+                torusVertices.push_back(0.3f);
+                torusVertices.push_back(0.3f);
+                torusVertices.push_back(1.0f);
+                torusVertices.push_back(static_cast<float>(i) / numCircles);
+                torusVertices.push_back(static_cast<float>(j) / numCirclePoints);
+            }
+        }
+
+        // Generate the indices for the torus
+        for (int i = 0; i < numCircles; ++i) {
+            for (int j = 0; j < numCirclePoints; ++j) {
+                int rowLength = numCirclePoints + 1;
+                int currentPoint = i * rowLength + j;
+                int adjacentPoint = currentPoint + 1;
+                int belowPoint = currentPoint + rowLength;
+                int diagonalPoint = belowPoint + 1;
+
+                // First triangle
+                torusIndices.push_back(currentPoint);
+                torusIndices.push_back(adjacentPoint);
+                torusIndices.push_back(belowPoint);
+
+                // Second triangle
+                torusIndices.push_back(adjacentPoint);
+                torusIndices.push_back(diagonalPoint);
+                torusIndices.push_back(belowPoint);
+            }
+        }
+    }
+
+    void UBuildCube(SceneMeshData& mesh)
+    {
+        // add the cube
+        float l = 2.0f; // length
+        float w = 2.0f; // width
+        float h = 1.0f; // height (smaller than length and width)
+
+        mesh.vertices = {
+            // Positions          // Colors                 // Texture coordinates (top-down)
+            l / 2, -h / 2,  w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  1.0f, 1.0f,  // Top Right Front
+            l / 2, -h / 2, -w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  1.0f, 0.0f,  // Top Right Back
+           -l / 2, -h / 2, -w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  0.0f, 0.0f,  // Top Left Back
+           -l / 2, -h / 2,  w / 2,   0.1f, 0.1f, 0.f, 1.0f,  0.0f, 1.0f,  // Top Left Front
+            l / 2,  h / 2,  w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  1.0f, 1.0f,  // Bottom Right Front
+            l / 2,  h / 2, -w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  1.0f, 0.0f,  // Bottom Right Back
+           -l / 2,  h / 2, -w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  0.0f, 0.0f,  // Bottom Left Back
+           -l / 2,  h / 2,  w / 2,   0.1f, 0.1f, 0.3f, 1.0f,  0.0f, 1.0f   // Bottom Left Front
+        };
+
+        mesh.indices = {
+            0, 1, 5,  0, 5, 4,  // Front face
+            1, 2, 6,  1, 6, 5,  // Right face
+            2, 3, 7,  2, 7, 6,  // Back face
+            3, 0, 4,  3, 4, 7,  // Left face
+            4, 5, 6,  4, 6, 7,  // Bottom face
+            3, 2, 1,  3, 1, 0   // Top face
+        };
+    }
+
+    void UBuildCylinder(SceneMeshData& mesh, int cylinderSegments)
+    {
+        const float cylinderHeight = 1.0f;
+        const float cylinderRadius = 0.5f;
+        mesh.segments = cylinderSegments;
+
+        // Cylinder Vertices
+        vector<float>& cylinderVertices = mesh.vertices;
+        auto addVertex = [&](float x, float y, float z, float u, float v)
+        {
+            cylinderVertices.insert(cylinderVertices.end(), { x, y, z });
+            // Color (Royal Blue)
+            cylinderVertices.insert(cylinderVertices.end(), { 0.254f, 0.412f, 0.882f, 1.0f });
+            cylinderVertices.insert(cylinderVertices.end(), { u, v });
+        };
+
+        // Side: top and bottom vertex pairs, with the first pair repeated at the end so the
+        // texture wraps once around without a seam
+        for (int i = 0; i <= cylinderSegments; i++)
+        {
+            float theta = (float)i / cylinderSegments * 2.0f * M_PI;
+            float x = cylinderRadius * cos(theta);
+            float z = cylinderRadius * sin(theta);
+            float u = (float)i / cylinderSegments;
+
+            addVertex(x, cylinderHeight / 2, z, u, 1.0f);  // Top circle vertex
+            addVertex(x, -cylinderHeight / 2, z, u, 0.0f); // Bottom circle vertex
+        }
+
+        // Caps get their own rings so they can be mapped flat, top-down
+        const int capStart = (cylinderSegments + 1) * 2;
+        for (int cap = 0; cap < 2; cap++)
+        {
+            float y = cap == 0 ? cylinderHeight / 2 : -cylinderHeight / 2;
+            for (int i = 0; i < cylinderSegments; i++)
+            {
+                float theta = (float)i / cylinderSegments * 2.0f * M_PI;
+                float x = cylinderRadius * cos(theta);
+                float z = cylinderRadius * sin(theta);
+                addVertex(x, y, z, x / (2 * cylinderRadius) + 0.5f, z / (2 * cylinderRadius) + 0.5f);
+            }
+            addVertex(0.0f, y, 0.0f, 0.5f, 0.5f); // Center vertex
+        }
+
+        // Cylinder Indices
+        vector<unsigned short>& cylinderIndices = mesh.indices;
+
+        // Indices for the side of the cylinder
+        for (int i = 0; i < cylinderSegments; i++)
+        {
+            cylinderIndices.push_back(i * 2);
+            cylinderIndices.push_back((i + 1) * 2);
+            cylinderIndices.push_back((i * 2) + 1);
+
+            cylinderIndices.push_back((i + 1) * 2);
+            cylinderIndices.push_back((i + 1) * 2 + 1);
+            cylinderIndices.push_back((i * 2) + 1);
+        }
+
+        // Indices for the top and bottom of the cylinder
+        for (int cap = 0; cap < 2; cap++)
+        {
+            int ring = capStart + cap * (cylinderSegments + 1);
+            unsigned short centerIndex = ring + cylinderSegments;
+            for (int i = 0; i < cylinderSegments; i++)
+            {
+                // Top cap faces up, bottom cap faces down
+                int next = ring + (i + 1) % cylinderSegments;
+                cylinderIndices.push_back(centerIndex);
+                cylinderIndices.push_back(cap == 0 ? next : ring + i);
+                cylinderIndices.push_back(cap == 0 ? ring + i : next);
+            }
+        }
+    }
+
+    vector<SceneObject> UComposeModels(vector<SceneObject> objects)
+    {
+        for (SceneObject& object : objects)
+            object.model = UComposeTransform(object.transform);
+        return objects;
+    }
+}
+
+void UBuildSceneMeshes(SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], bool optimize)
+{
+    UBuildPyramid(meshes[MESH_PYRAMID][0]);
+    UBuildPlane(meshes[MESH_PLANE][0]);
+    UBuildCube(meshes[MESH_CUBE][0]);
+
+    // The procedural shapes get SCENE_LOD_COUNT levels, finest first. Level 0 has more
+    // detail than the old fixed meshes (sphere 20x20, torus 10x10, cylinder 32) for close-ups.
+    const int sphereDetail[SCENE_LOD_COUNT][2] = { { 40, 48 }, { 20, 24 }, { 10, 12 }, { 5, 8 } };
+    const int torusDetail[SCENE_LOD_COUNT][2] = { { 48, 16 }, { 24, 10 }, { 12, 8 }, { 8, 5 } };
+    const int cylinderDetail[SCENE_LOD_COUNT] = { 64, 32, 16, 8 };
+    for (int lod = 0; lod < SCENE_LOD_COUNT; lod++)
+    {
+        UBuildSphere(meshes[MESH_SPHERE][lod], sphereDetail[lod][0], sphereDetail[lod][1]);
+        UBuildTorus(meshes[MESH_TORUS][lod], torusDetail[lod][0], torusDetail[lod][1]);
+        UBuildCylinder(meshes[MESH_CYLINDER][lod], cylinderDetail[lod]);
+    }
+
+    for (int mesh = 0; mesh < MESH_COUNT; mesh++)
+    {
+        for (int lod = 0; lod < USceneLodCount(static_cast<SceneMeshId>(mesh)); lod++)
+        {
+            UGenerateNormalsAndTangents(meshes[mesh][lod], USceneMeshFaceted(static_cast<SceneMeshId>(mesh)));
+            if (optimize)
+                UOptimizeMesh(meshes[mesh][lod], SCENE_VERTEX_FLOATS);
+            UComputeBounds(meshes[mesh][lod], SCENE_VERTEX_FLOATS);
+        }
+    }
+
+    // Static objects get a chart layout to bake their lighting into; the layout depends on the
+    // object's size in the world, so it is made here and not with the shape
+    for (const SceneObject& object : USceneObjects())
+    {
+        if (object.lightmapped)
+            UGenerateLightmapUVs(meshes[object.mesh][0], object.model);
+    }
+}
+
+int USceneLodCount(SceneMeshId mesh)
+{
+    return (mesh == MESH_SPHERE || mesh == MESH_TORUS || mesh == MESH_CYLINDER) ? SCENE_LOD_COUNT : 1;
+}
+
+const char* USceneMeshName(SceneMeshId mesh)
+{
+    static const char* const names[MESH_COUNT] = { "pyramid", "sphere", "plane", "torus", "cube", "cylinder" };
+    return names[mesh];
+}
+
+bool USceneMeshFaceted(SceneMeshId mesh)
+{
+    return mesh == MESH_PYRAMID || mesh == MESH_PLANE || mesh == MESH_CUBE;
+}
+
+void UComputeBounds(SceneMeshData& mesh, int stride)
+{
+    if (mesh.vertices.empty())
+        return;
+
+    glm::vec3 lo(mesh.vertices[0], mesh.vertices[1], mesh.vertices[2]);
+    glm::vec3 hi = lo;
+    for (size_t i = 0; i + 2 < mesh.vertices.size(); i += stride)
+    {
+        glm::vec3 p(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+
+    mesh.boundsCenter = (lo + hi) * 0.5f;
+    mesh.boundsRadius = 0.0f;
+    for (size_t i = 0; i + 2 < mesh.vertices.size(); i += stride)
+    {
+        glm::vec3 p(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]);
+        mesh.boundsRadius = max(mesh.boundsRadius, glm::length(p - mesh.boundsCenter));
+    }
+}
+
+void UBuildLightSourceMesh(SceneMeshData& mesh)
+{
+    float size = 1.0f;
+    mesh.vertices = {
+        // front
+        -size, -size, size,
+        size, -size, size,
+        size, size, size,
+        -size, size, size,
+
+        // back
+        size, -size, -size,
+        -size, -size, -size,
+        -size, size, -size,
+         size, size, -size,
+
+         // right
+         size, -size, size,
+         size, -size, -size,
+         size, size, -size,
+         size, size, size,
+
+         // left
+         -size, -size, -size,
+         -size, -size, size,
+         -size, size, size,
+         -size, size, -size,
+
+         // top
+         -size, size, size,
+         size, size, size,
+         size, size, -size,
+         -size, size, -size,
+
+         // bottom
+         -size, -size, -size,
+         size, -size, -size,
+         size, -size, size,
+         -size, -size, size
+    };
+
+    mesh.indices = {
+        0, 1, 2, 2, 3, 0, // Front
+        4, 5, 6, 6, 7, 4, // Back
+        8, 9, 10, 10, 11, 8, // Right
+        12, 13, 14, 14, 15, 12, // Left
+        16, 17, 18, 18, 19, 16, // Top
+        20, 21, 22, 22, 23, 20 // Bottom
+    };
+    UComputeBounds(mesh, 3);
+}
+
+const vector<SceneObject>& USceneObjects()
+{
+    static const vector<SceneObject> objects = UComposeModels({
+        // Plane
+        { MESH_PLANE, TEXTURE_WOOD, { glm::vec3(0.0f, -2.1f, 0.0f) }, true },
+
+        // Pyramid
+        { MESH_PYRAMID, TEXTURE_SPONGE,
+            { glm::vec3(-2.5f, 0.1f, 0.3f),
+              glm::angleAxis(180.0f, glm::normalize(glm::vec3(0.5, 1.0f, 0.0f))),
+              glm::vec3(1.2f, 1.2f, 1.2f) } },
+
+        // Sphere
+        { MESH_SPHERE, TEXTURE_SPONGE,
+            { glm::vec3(-3.6f, -1.1f, 1.0f),
+              glm::angleAxis(90.0f, glm::normalize(glm::vec3(0.0, -1.2f, 1.0f))),
+              glm::vec3(2.0f, 2.0f, 2.0f) } },
+
+        // Torus
+        { MESH_TORUS, TEXTURE_WOOD,
+            { glm::vec3(-0.5f, -1.8f, 4.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.7f, 0.7f, 0.7f) } },
+
+        // Cube
+        { MESH_CUBE, TEXTURE_WOOD,
+            { glm::vec3(3.0f, -1.8f, 2.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.5f, 0.5f, 1.5f) }, true },
+
+        // Cylinder
+        { MESH_CYLINDER, TEXTURE_BLUECONTAINER,
+            { glm::vec3(-1.0f, -0.8f, -1.5f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(3.5f, 2.5f, 3.5f) }, true }
+    });
+    return objects;
+}
+
+glm::mat4 ULightSourceModel(const glm::vec3& position)
+{
+    return glm::translate(position) * glm::scale(glm::vec3(LIGHT_SOURCE_SCALE));
+}
+
+glm::mat4 UComposeTransform(const SceneTransform& transform)
+{
+    return glm::translate(transform.position) * glm::mat4_cast(transform.rotation) * glm::scale(transform.scale);
+}
+
+const vector<PointLight>& USceneLights()
+{
+    static const vector<PointLight> lights = {
+        { KEY_LIGHT_POSITION, SCENE_LIGHT_RADIUS, KEY_LIGHT_COLOR, 1.0f },
+        { FILL_LIGHT_POSITION, SCENE_LIGHT_RADIUS, FILL_LIGHT_COLOR, 1.0f }
+    };
+    return lights;
+}
+
+void USceneLightField(int count, float seconds, vector<PointLight>& lights)
+{
+    // Spread over a disc with the golden angle so any count covers the floor evenly;
+    // inner lights orbit faster than outer ones
+    const float goldenAngle = 2.39996323f;
+    for (int i = 0; i < count; i++)
+    {
+        float distance = 6.0f * sqrt((i + 0.5f) / count);
+        float angle = i * goldenAngle + seconds * 1.5f / (1.0f + distance);
+        float height = -1.8f + 0.25f * sin(seconds * 2.0f + i);
+
+        // Fully saturated hue around the color wheel
+        float hue = float(i) / count * 6.0f;
+        glm::vec3 color = glm::clamp(glm::vec3(fabs(hue - 3.0f) - 1.0f, 2.0f - fabs(hue - 2.0f), 2.0f - fabs(hue - 4.0f)),
+            glm::vec3(0.0f), glm::vec3(1.0f));
+
+        PointLight light;
+        light.position = glm::vec3(distance * cos(angle), height, 1.0f + distance * sin(angle));
+        light.radius = SCENE_LIGHT_FIELD_RADIUS;
+        light.color = color * 0.8f;
+        lights.push_back(light);
+    }
+}
+
+float ULightFalloff(float distance, float radius)
+{
+    float ratio = distance / radius;
+    float window = glm::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+    return window * window;
+}
+
+glm::mat3 UNormalMatrix(const glm::mat4& model)
+{
+    return glm::transpose(glm::inverse(glm::mat3(model)));
+}
+
+const char* USceneTexturePath(SceneTextureId texture)
+{
+    switch (texture)
+    {
+    case TEXTURE_WOOD: return "wood_texture.jpg";
+    case TEXTURE_SPONGE: return "sponge_texture.jpg";
+    case TEXTURE_BLUECONTAINER: return "bluecontainer_texture.jpg";
+    default: return "";
+    }
+}
+
+SceneCamera UDefaultSceneCamera()
+{
+    SceneCamera camera;
+    camera.position = glm::vec3(0.0f, 0.0f, 5.0f);
+    camera.front = glm::vec3(0.0f, 0.0f, -1.0f);
+    camera.up = glm::vec3(0.0f, 1.0f, 0.0f);
+    camera.isPerspective = true;
+    return camera;
+}
+
+glm::mat4 USceneView(const SceneCamera& camera)
+{
+    return glm::lookAt(camera.position, camera.position + camera.front, camera.up);
+}
+
+glm::mat4 USceneProjection(bool isPerspective, float aspect)
+{
+    if (isPerspective)
+        return glm::perspective(45.0f, aspect, SCENE_NEAR_PLANE, SCENE_FAR_PLANE);
+
+    float orthoScale = 5.0f;  // This controls how "zoomed out" your orthographic view is
+    return glm::ortho(-orthoScale * aspect, orthoScale * aspect, -orthoScale, orthoScale, SCENE_NEAR_PLANE, SCENE_FAR_PLANE);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+// Scene description shared by the OpenGL renderer and the software renderer.
+// Nothing in here touches GL so it can be used on machines without a GPU.
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+// Interleaved vertex layout used by every scene mesh: position (x,y,z), color (r,g,b,a), texture coordinate (u,v),
+// normal (x,y,z), tangent (x,y,z, handedness) and lightmap coordinate (u,v). The shape builders write only the
+// first SCENE_BASE_VERTEX_FLOATS; normals and tangents are generated afterwards (see MeshNormals.h), and
+// lightmap coordinates only for the finest level of lightmapped objects (see Lightmap.h).
+// This is the CPU-side layout; what goes to the GPU is packed from it (see VertexFormat.h).
+const int SCENE_VERTEX_FLOATS = 18;
+const int SCENE_BASE_VERTEX_FLOATS = 9;
+const int SCENE_POSITION_OFFSET = 0;
+const int SCENE_COLOR_OFFSET = 3;
+const int SCENE_TEXCOORD_OFFSET = 7;
+const int SCENE_NORMAL_OFFSET = 9;
+const int SCENE_TANGENT_OFFSET = 12;
+const int SCENE_LIGHTMAP_UV_OFFSET = 16;
+// Detail levels built for the procedural meshes (sphere, torus, cylinder); level 0 is the finest
+const int SCENE_LOD_COUNT = 4;
+
+enum SceneMeshId
+{
+    MESH_PYRAMID,
+    MESH_SPHERE,
+    MESH_PLANE,
+    MESH_TORUS,
+    MESH_CUBE,
+    MESH_CYLINDER,
+    MESH_COUNT
+};
+
+enum SceneTextureId
+{
+    TEXTURE_WOOD,
+    TEXTURE_SPONGE,
+    TEXTURE_BLUECONTAINER,
+    TEXTURE_COUNT
+};
+
+struct SceneMeshData
+{
+    std::vector<float> vertices;
+    std::vector<unsigned short> indices;
+    glm::vec3 boundsCenter = glm::vec3(0.0f); // bounding sphere in model space
+    float boundsRadius = 0.0f;
+    int segments = 0; // divisions around the widest circle, 0 for the hand-built meshes
+    int lightmapWidth = 0; // texels of the lightmap its lightmap coordinates were laid out for, 0 if it has none
+    int lightmapHeight = 0;
+};
+
+// Placement of an object: its model matrix is translate(position) * rotation * scale(scale)
+struct SceneTransform
+{
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); // unit length
+    glm::vec3 scale = glm::vec3(1.0f);
+};
+
+struct SceneObject
+{
+    SceneMeshId mesh;
+    SceneTextureId texture;
+    SceneTransform transform;
+    bool lightmapped = false; // static lighting comes from a baked lightmap instead of per-fragment lights
+    glm::mat4 model = glm::mat4(1.0f); // `transform` composed, for the offline paths (bakes, software renderer)
+};
+
+struct SceneCamera
+{
+    glm::vec3 position;
+    glm::vec3 front;
+    glm::vec3 up;
+    bool isPerspective;
+};
+
+//lights and thier color
+const glm::vec3 KEY_LIGHT_COLOR = glm::vec3(1.0f, 0.6f, 0.2f); //sunset yellow
+const glm::vec3 FILL_LIGHT_COLOR = glm::vec3(0.9f, 0.9f, 0.9f);
+const glm::vec3 KEY_LIGHT_POSITION = glm::vec3(-5.0f, 1.5f, 1.0f);
+const glm::vec3 FILL_LIGHT_POSITION = glm::vec3(5.5f, -1.0f, 0.0f);
+// The key light casts shadows as a spot light aimed here, at the middle of the floor
+const glm::vec3 KEY_LIGHT_TARGET = glm::vec3(0.0f, -2.1f, 1.0f);
+const glm::vec3 AMBIENT_LIGHT_COLOR = glm::vec3(0.3f, 0.3f, 0.3f); // Soft general light
+const glm::vec3 LIGHT_SOURCE_COLOR = glm::vec3(1.0f, 1.0f, 1.0f);
+// Size of the cube drawn at each light, relative to UBuildLightSourceMesh's
+const float LIGHT_SOURCE_SCALE = 0.2f;
+const float SHININESS = 32.0f; // higher values mean smaller, sharper highlights
+// Reach of the key and fill lights: far enough that their falloff never shows inside the scene
+const float SCENE_LIGHT_RADIUS = 100.0f;
+// Small colored lights circling the floor when the light field is on (L)
+const int SCENE_LIGHT_FIELD_COUNT = 256;
+const float SCENE_LIGHT_FIELD_RADIUS = 1.2f;
+
+const float SCENE_NEAR_PLANE = 0.1f;
+const float SCENE_FAR_PLANE = 100.0f;
+
+// A point light laid out the way the shaders read it from the light buffer (std430, two vec4s).
+// Its contribution fades smoothly to zero at `radius` (see ULightFalloff).
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float baked = 0.0f; // 1 if lightmapped objects already have this light in their lightmaps
+};
+
+// Builds the vertex/index data for every mesh in the scene, USceneLodCount(mesh) levels each.
+// `optimize` reorders each mesh for the vertex cache (see MeshOptimizer.h); only stats reporting turns it off.
+void UBuildSceneMeshes(SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT], bool optimize = true);
+int USceneLodCount(SceneMeshId mesh);
+// Lower-case name for logs and file names, e.g. "cylinder"
+const char* USceneMeshName(SceneMeshId mesh);
+// Whether a mesh is lit with one normal per face (hard edges) rather than smoothed across faces
+bool USceneMeshFaceted(SceneMeshId mesh);
+void UComputeBounds(SceneMeshData& mesh, int stride);
+// Position-only cube drawn at each light's location
+void UBuildLightSourceMesh(SceneMeshData& mesh);
+// Objects drawn each frame, in draw order, with their model matrices
+const std::vector<SceneObject>& USceneObjects();
+glm::mat4 ULightSourceModel(const glm::vec3& position);
+// The model matrix of `transform`, one object at a time (see TransformStore.h for many)
+glm::mat4 UComposeTransform(const SceneTransform& transform);
+// The key and fill lights, both baked into the lightmaps
+const std::vector<PointLight>& USceneLights();
+// Appends `count` light field lights at their positions `seconds` into the animation
+void USceneLightField(int count, float seconds, std::vector<PointLight>& lights);
+// Windowed falloff shared with the fragment shader: 1 at the light, 0 from `radius` on
+float ULightFalloff(float distance, float radius);
+// Transforms normals for a model matrix that may scale unevenly
+glm::mat3 UNormalMatrix(const glm::mat4& model);
+const char* USceneTexturePath(SceneTextureId texture);
+
+SceneCamera UDefaultSceneCamera();
+glm::mat4 USceneView(const SceneCamera& camera);
+glm::mat4 USceneProjection(bool isPerspective, float aspect);
@@ -0,0 +1,337 @@
+#include "SceneGraph.h"
+#include "Benchmark.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+namespace {
+    // Nodes in the random tree the correctness check edits, and how many edits it makes
+    const size_t SCENE_GRAPH_CHECK_NODES = 2000;
+    const int SCENE_GRAPH_CHECK_ROUNDS = 200;
+
+    // The tree as the benchmark's reference sees it, by node id
+    struct ReferenceTree
+    {
+        vector<uint32_t> parent;
+        vector<SceneTransform> local;
+    };
+
+    // World matrix of `node` the plain way: its parent's, recursively, times its own
+    glm::mat4 UReferenceWorld(const ReferenceTree& tree, uint32_t node)
+    {
+        glm::mat4 local = UComposeTransform(tree.local[node]);
+        return tree.parent[node] == SCENE_NODE_NONE ? local : UReferenceWorld(tree, tree.parent[node]) * local;
+    }
+
+    bool UIsBelow(const ReferenceTree& tree, uint32_t node, uint32_t ancestor)
+    {
+        for (uint32_t at = node; at != SCENE_NODE_NONE; at = tree.parent[at])
+        {
+            if (at == ancestor)
+                return true;
+        }
+        return false;
+    }
+
+    // Largest difference between any world matrix element and the reference, or infinity if the
+    // arrays aren't in breadth-first order
+    float USceneGraphError(const SceneGraph& graph, const ReferenceTree& tree)
+    {
+        for (size_t i = 0; i < graph.parent.size(); i++)
+        {
+            if (graph.parent[i] != SCENE_NODE_NONE && graph.parent[i] >= i)
+                return INFINITY;
+        }
+        float worst = 0.0f;
+        for (uint32_t node = 0; node < tree.parent.size(); node++)
+        {
+            const glm::mat4 reference = UReferenceWorld(tree, node);
+            const glm::mat4& world = USceneNodeWorld(graph, node);
+            for (int column = 0; column < 4; column++)
+                for (int row = 0; row < 4; row++)
+                    worst = max(worst, fabs(world[column][row] - reference[column][row]) / max(1.0f, fabs(reference[column][row])));
+        }
+        return worst;
+    }
+
+    SceneTransform URandomTransform(mt19937& random)
+    {
+        uniform_real_distribution<float> offset(-2.0f, 2.0f), component(-1.0f, 1.0f), size(0.5f, 1.5f);
+        SceneTransform transform;
+        transform.position = glm::vec3(offset(random), offset(random), offset(random));
+        transform.rotation = glm::normalize(glm::quat(component(random), component(random), component(random), component(random)));
+        transform.scale = glm::vec3(size(random), size(random), size(random));
+        return transform;
+    }
+
+    // Adds a node under a random earlier node, or at the top one time in eight
+    uint32_t UAddRandomNode(SceneGraph& graph, ReferenceTree& tree, mt19937& random)
+    {
+        uint32_t parent = SCENE_NODE_NONE;
+        if (!tree.parent.empty() && random() % 8 != 0)
+            parent = uint32_t(random() % tree.parent.size());
+        SceneTransform local = URandomTransform(random);
+        tree.parent.push_back(parent);
+        tree.local.push_back(local);
+        return UAddSceneNode(graph, local, parent);
+    }
+
+    void UMarkNodeDirty(SceneGraph& graph, size_t index)
+    {
+        graph.dirty[index] = 1;
+        graph.firstDirty = min(graph.firstDirty, index);
+    }
+
+    // Puts the nodes in breadth-first order: the top-level nodes, then their children, then the
+    // grandchildren, and so on. Siblings keep their relative order.
+    void USortSceneGraph(SceneGraph& graph)
+    {
+        const size_t count = graph.parent.size();
+
+        // Children of each node, bucketed by parent with a counting sort
+        vector<size_t> order;
+        order.reserve(count);
+        vector<uint32_t> childStart(count + 1, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (graph.parent[i] == SCENE_NODE_NONE)
+                order.push_back(i);
+            else
+                childStart[graph.parent[i] + 1]++;
+        }
+        for (size_t i = 0; i < count; i++)
+            childStart[i + 1] += childStart[i];
+        vector<uint32_t> children(count);
+        vector<uint32_t> cursor(childStart.begin(), childStart.end() - 1);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (graph.parent[i] != SCENE_NODE_NONE)
+                children[cursor[graph.parent[i]]++] = uint32_t(i);
+        }
+        for (size_t head = 0; head < order.size(); head++)
+        {
+            size_t node = order[head];
+            order.insert(order.end(), children.begin() + childStart[node], children.begin() + childStart[node + 1]);
+        }
+
+        vector<uint32_t> newIndex(count);
+        for (size_t i = 0; i < count; i++)
+            newIndex[order[i]] = uint32_t(i);
+
+        UReorderTransforms(graph.local, order);
+        vector<uint32_t> parent(count), id(count);
+        vector<glm::mat4> world(count);
+        vector<uint8_t> dirty(count);
+        graph.firstDirty = SIZE_MAX;
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t old = order[i];
+            parent[i] = graph.parent[old] == SCENE_NODE_NONE ? SCENE_NODE_NONE : newIndex[graph.parent[old]];
+            id[i] = graph.id[old];
+            world[i] = graph.world[old];
+            dirty[i] = graph.dirty[old];
+            graph.index[id[i]] = uint32_t(i);
+            if (dirty[i])
+                graph.firstDirty = min(graph.firstDirty, i);
+        }
+        graph.parent.swap(parent);
+        graph.id.swap(id);
+        graph.world.swap(world);
+        graph.dirty.swap(dirty);
+        graph.sorted = true;
+    }
+}
+
+uint32_t UAddSceneNode(SceneGraph& graph, const SceneTransform& local, uint32_t parent)
+{
+    size_t index = UAddTransform(graph.local, local);
+    uint32_t node = uint32_t(graph.index.size());
+    graph.parent.push_back(parent == SCENE_NODE_NONE ? SCENE_NODE_NONE : graph.index[parent]);
+    graph.world.push_back(glm::mat4(1.0f));
+    graph.dirty.push_back(0);
+    graph.id.push_back(node);
+    graph.index.push_back(uint32_t(index));
+    UMarkNodeDirty(graph, index);
+    graph.sorted = false;
+    return node;
+}
+
+void USetSceneNodeParent(SceneGraph& graph, uint32_t node, uint32_t parent)
+{
+    size_t index = graph.index[node];
+    graph.parent[index] = parent == SCENE_NODE_NONE ? SCENE_NODE_NONE : graph.index[parent];
+    UMarkNodeDirty(graph, index);
+    graph.sorted = false;
+}
+
+SceneTransform USceneNodeTransform(const SceneGraph& graph, uint32_t node)
+{
+    return UGetTransform(graph.local, graph.index[node]);
+}
+
+void USetSceneNodeTransform(SceneGraph& graph, uint32_t node, const SceneTransform& local)
+{
+    size_t index = graph.index[node];
+    USetTransform(graph.local, index, local);
+    UMarkNodeDirty(graph, index);
+}
+
+void USetSceneNodePosition(SceneGraph& graph, uint32_t node, const glm::vec3& position)
+{
+    size_t index = graph.index[node];
+    USetTransformPosition(graph.local, index, position);
+    UMarkNodeDirty(graph, index);
+}
+
+size_t UUpdateSceneGraph(SceneGraph& graph)
+{
+    if (!graph.sorted)
+        USortSceneGraph(graph);
+    if (graph.firstDirty == SIZE_MAX)
+        return 0;
+
+    UUpdateTransforms(graph.local);
+
+    // A parent is always visited before its children, so its dirty flag has already been passed down
+    // to them by the time they are reached; nothing before the first dirty node can have changed
+    const size_t count = graph.parent.size();
+    size_t changed = 0;
+    for (size_t i = graph.firstDirty; i < count; i++)
+    {
+        uint32_t parent = graph.parent[i];
+        if (parent != SCENE_NODE_NONE && graph.dirty[parent])
+            graph.dirty[i] = 1;
+        if (!graph.dirty[i])
+            continue;
+        const glm::mat4& local = UWorldMatrix(graph.local, i);
+        graph.world[i] = parent == SCENE_NODE_NONE ? local : graph.world[parent] * local;
+        changed++;
+    }
+    memset(&graph.dirty[graph.firstDirty], 0, count - graph.firstDirty);
+    graph.firstDirty = SIZE_MAX;
+    return changed;
+}
+
+int USceneGraphBenchmarkMain(int argc, char* argv[])
+{
+    for (int i = 2; i < argc; i++)
+        UParseThreadsOption(argc, argv, i);
+
+    cout << fixed << setprecision(3);
+    cout << "INFO: Checking scene graph updates on a random " << SCENE_GRAPH_CHECK_NODES << "-node tree" << endl;
+
+    mt19937 random(BENCHMARK_SEED);
+    SceneGraph graph;
+    ReferenceTree tree;
+    for (size_t i = 0; i < SCENE_GRAPH_CHECK_NODES; i++)
+        UAddRandomNode(graph, tree, random);
+    UUpdateSceneGraph(graph);
+    float error = USceneGraphError(graph, tree);
+
+    // Each round moves, repositions, reparents or adds a node; reparenting and adding re-sort the arrays
+    const char* const editNames[] = { "move", "position", "reparent", "add" };
+    for (int round = 0; round < SCENE_GRAPH_CHECK_ROUNDS && error <= 1e-4f; round++)
+    {
+        const int edit = round % 4;
+        uint32_t node = uint32_t(random() % tree.parent.size());
+        size_t expected = 0;
+        if (edit == 0)
+        {
+            tree.local[node] = URandomTransform(random);
+            USetSceneNodeTransform(graph, node, tree.local[node]);
+        }
+        else if (edit == 1)
+        {
+            tree.local[node].position = URandomTransform(random).position;
+            USetSceneNodePosition(graph, node, tree.local[node].position);
+        }
+        else if (edit == 2)
+        {
+            // A node can't move below itself; those draws go to the top level instead
+            uint32_t parent = uint32_t(random() % tree.parent.size());
+            if (UIsBelow(tree, parent, node))
+                parent = SCENE_NODE_NONE;
+            tree.parent[node] = parent;
+            USetSceneNodeParent(graph, node, parent);
+        }
+        else
+            node = UAddRandomNode(graph, tree, random);
+
+        // Only the edited node and everything below it should be recomputed
+        for (uint32_t other = 0; other < tree.parent.size(); other++)
+            expected += UIsBelow(tree, other, node) ? 1 : 0;
+        size_t changed = UUpdateSceneGraph(graph);
+        error = USceneGraphError(graph, tree);
+        if (changed != expected)
+        {
+            cout << "ERROR::SCENE_GRAPH::WRONG_NODES_UPDATED after " << editNames[edit] << " in round " << round
+                << ": " << changed << " updated, " << expected << " in the subtree" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (error > 1e-4f)
+    {
+        cout << "ERROR::SCENE_GRAPH::MISMATCH with the recursive reference, off by " << error << endl;
+        return EXIT_FAILURE;
+    }
+    if (UUpdateSceneGraph(graph) != 0)
+    {
+        cout << "ERROR::SCENE_GRAPH::STATIC_UPDATE recomputed nodes with nothing moved" << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "INFO: " << SCENE_GRAPH_CHECK_ROUNDS << " edits matched the recursive reference" << endl;
+
+    // Wide, shallow trees like a scene's: 64 top-level groups, each node under a random earlier one
+    for (size_t count = 4096; count <= 262144; count *= 8)
+    {
+        SceneGraph large;
+        ReferenceTree largeTree;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t parent = i < 64 ? SCENE_NODE_NONE : uint32_t(random() % i);
+            SceneTransform local = URandomTransform(random);
+            largeTree.parent.push_back(parent);
+            largeTree.local.push_back(local);
+            UAddSceneNode(large, local, parent);
+        }
+        UUpdateSceneGraph(large);
+
+        const uint32_t leaf = uint32_t(count - 1);
+        const uint32_t group = 0;
+        double leafMilliseconds = UBenchmarkMilliseconds([&]()
+            {
+                USetSceneNodePosition(large, leaf, largeTree.local[leaf].position);
+                UUpdateSceneGraph(large);
+            });
+        double groupMilliseconds = UBenchmarkMilliseconds([&]()
+            {
+                USetSceneNodePosition(large, group, largeTree.local[group].position);
+                UUpdateSceneGraph(large);
+            });
+        double allMilliseconds = UBenchmarkMilliseconds([&]()
+            {
+                for (uint32_t root = 0; root < 64; root++)
+                    USetSceneNodePosition(large, root, largeTree.local[root].position);
+                UUpdateSceneGraph(large);
+            });
+        vector<glm::mat4> reference(count);
+        double referenceMilliseconds = UBenchmarkMilliseconds([&]()
+            {
+                for (uint32_t node = 0; node < count; node++)
+                    reference[node] = UReferenceWorld(largeTree, node);
+            });
+
+        cout << "INFO: " << setw(6) << count << " nodes: one leaf moved " << leafMilliseconds << " ms, one group "
+            << groupMilliseconds << " ms, every node " << allMilliseconds << " ms (recursive reference "
+            << referenceMilliseconds << " ms)" << endl;
+    }
+    return 0;
+}
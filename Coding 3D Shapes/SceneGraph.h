@@ -0,0 +1,54 @@
+#pragma once
+
+// Transform hierarchy. Every node has a transform relative to its parent; its world matrix is the
+// parent's world matrix times its own. Nodes are stored breadth first in flat arrays, so a parent
+// always comes before its children and one pass from front to back updates the whole tree.
+// Moving a node marks it dirty, and the pass recomputes only dirty nodes and everything below
+// them, starting from the first dirty node. Local matrices are composed in SIMD batches by the
+// TransformStore underneath (see TransformStore.h).
+//
+// Callers hold node ids, which never change. Adding or reparenting a node re-sorts the arrays on
+// the next update.
+
+#include "TransformStore.h"
+
+#include <cstdint>
+#include <vector>
+
+// Parent of a top-level node
+const uint32_t SCENE_NODE_NONE = UINT32_MAX;
+
+struct SceneGraph
+{
+    // In breadth-first order
+    TransformStore local;          // transform relative to the parent
+    std::vector<uint32_t> parent;  // index of the parent, SCENE_NODE_NONE at the top; below the node's own
+    std::vector<glm::mat4> world;
+    std::vector<uint8_t> dirty;    // world matrix out of date
+    std::vector<uint32_t> id;      // node id at each index
+    // By node id
+    std::vector<uint32_t> index;
+    size_t firstDirty = SIZE_MAX;  // no node before this one is dirty
+    bool sorted = true;
+};
+
+// Adds a node under `parent` (a node id, or SCENE_NODE_NONE) and returns its id. Ids count up from
+// 0 in the order nodes are added.
+uint32_t UAddSceneNode(SceneGraph& graph, const SceneTransform& local, uint32_t parent = SCENE_NODE_NONE);
+// Moves a node, with everything under it, beneath `parent`; `parent` must not be below the node
+void USetSceneNodeParent(SceneGraph& graph, uint32_t node, uint32_t parent);
+SceneTransform USceneNodeTransform(const SceneGraph& graph, uint32_t node);
+void USetSceneNodeTransform(SceneGraph& graph, uint32_t node, const SceneTransform& local);
+void USetSceneNodePosition(SceneGraph& graph, uint32_t node, const glm::vec3& position);
+// Brings every world matrix up to date; returns how many changed
+size_t UUpdateSceneGraph(SceneGraph& graph);
+
+inline const glm::mat4& USceneNodeWorld(const SceneGraph& graph, uint32_t node)
+{
+    return graph.world[graph.index[node]];
+}
+
+// Entry point for `--scene-graph-bench`: checks UUpdateSceneGraph against a recursive reference
+// through random adds, moves and reparents, then times updates of large trees with one node, one
+// subtree and every node moved
+int USceneGraphBenchmarkMain(int argc, char* argv[]);
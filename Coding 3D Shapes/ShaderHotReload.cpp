@@ -0,0 +1,317 @@
+#include "ShaderHotReload.h"
+#include "ShaderVariants.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <map>
+#endif
+
+using namespace std;
+
+namespace {
+#ifndef __linux__
+    // Without inotify the files' modification times are compared this often, in seconds
+    const double SHADER_POLL_INTERVAL = 0.25;
+#endif
+
+    // One variant set rebuilt from new sources
+    struct ShaderReload
+    {
+        ShaderVariants* variants = nullptr;
+        string sources[SHADER_STAGE_COUNT];
+        vector<string> dependencies;
+        vector<unsigned> features; // every variant the set had when the files changed
+        // Filled in by the worker
+        vector<GLuint> programs;   // same order as features; empty if any variant failed
+        double milliseconds = 0.0;
+    };
+
+    bool gHotReloadRunning = false;
+    GLFWwindow* gReloadContext = nullptr; // hidden window whose context the worker compiles in
+    thread gReloadThread;
+    mutex gReloadMutex;
+    condition_variable gReloadWake;
+    deque<ShaderReload> gReloadQueue; // waiting for the worker
+    vector<ShaderReload> gReloadDone; // built, waiting for a frame boundary
+    bool gReloadStopping = false;
+
+#ifdef __linux__
+    int gWatchFd = -1;
+#else
+    map<string, time_t> gFileTimes;
+    double gNextPoll = 0.0;
+#endif
+
+    // Names (relative to SHADER_DIRECTORY) of the files written since the last call
+    vector<string> UChangedShaderFiles()
+    {
+        vector<string> changed;
+#ifdef __linux__
+        // Non-blocking: returns at once with whatever events have queued up
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(gWatchFd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* p = buffer; p < buffer + length; )
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                if (event->len > 0)
+                    changed.push_back(event->name);
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+#else
+        double now = glfwGetTime();
+        if (now < gNextPoll)
+            return changed;
+        gNextPoll = now + SHADER_POLL_INTERVAL;
+
+        for (const ShaderVariants* variants : UShaderVariantSets())
+        {
+            for (const string& name : variants->dependencies)
+            {
+                struct stat info;
+                string path = string(SHADER_DIRECTORY) + "/" + name;
+                if (stat(path.c_str(), &info) != 0)
+                    continue;
+                map<string, time_t>::iterator known = gFileTimes.find(name);
+                if (known == gFileTimes.end())
+                    gFileTimes[name] = info.st_mtime; // first sight: nothing to compare with yet
+                else if (known->second != info.st_mtime)
+                {
+                    known->second = info.st_mtime;
+                    if (find(changed.begin(), changed.end(), name) == changed.end())
+                        changed.push_back(name);
+                }
+            }
+        }
+#endif
+        return changed;
+    }
+
+    // Runs on the worker; every variant is submitted before any is waited on
+    void UBuildReload(ShaderReload& reload)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        vector<PendingProgram> pending(reload.features.size());
+        for (size_t i = 0; i < reload.features.size(); i++)
+            UBeginShaderVariant(reload.sources, reload.features[i], pending[i]);
+
+        bool ok = true;
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            ok = UFinishShaderProgram(pending[i]) && ok;
+            reload.programs.push_back(pending[i].programId);
+        }
+        if (!ok)
+        {
+            for (GLuint programId : reload.programs)
+            {
+                if (programId != 0)
+                    UDestroyShaderProgram(programId);
+            }
+            reload.programs.clear();
+        }
+
+        // The window's context may use the programs as soon as they are swapped in
+        glFinish();
+        reload.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    void UReloadWorker()
+    {
+        glfwMakeContextCurrent(gReloadContext);
+        unique_lock<mutex> lock(gReloadMutex);
+        for (;;)
+        {
+            gReloadWake.wait(lock, [] { return gReloadStopping || !gReloadQueue.empty(); });
+            if (gReloadStopping)
+                break;
+
+            ShaderReload reload = move(gReloadQueue.front());
+            gReloadQueue.pop_front();
+            lock.unlock();
+            UBuildReload(reload);
+            lock.lock();
+            gReloadDone.push_back(move(reload));
+            glfwPostEmptyEvent(); // wakes the window loop if it is waiting for events
+        }
+        lock.unlock();
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    string UShaderSetName(const ShaderVariants& variants)
+    {
+        string name;
+        for (const char* file : variants.files)
+        {
+            if (file)
+                name += (name.empty() ? "" : ", ") + string(file);
+        }
+        return name;
+    }
+}
+
+bool UStartShaderHotReload(GLFWwindow* window)
+{
+#ifdef __linux__
+    // Editors either rewrite a file in place or write a new one and rename it over the old
+    gWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (gWatchFd < 0 || inotify_add_watch(gWatchFd, SHADER_DIRECTORY, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        if (gWatchFd >= 0)
+            close(gWatchFd);
+        gWatchFd = -1;
+        return false;
+    }
+#else
+    UChangedShaderFiles(); // records every file's current time
+#endif
+
+    // The window hints from UInitialize still hold, so the context matches the window's
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    gReloadContext = glfwCreateWindow(1, 1, "", NULL, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (gReloadContext == NULL)
+    {
+#ifdef __linux__
+        close(gWatchFd);
+        gWatchFd = -1;
+#endif
+        return false;
+    }
+
+    gReloadStopping = false;
+    gReloadThread = thread(UReloadWorker);
+    gHotReloadRunning = true;
+    return true;
+}
+
+bool UApplyShaderReloads()
+{
+    if (!gHotReloadRunning)
+        return false;
+
+    vector<string> changed = UChangedShaderFiles();
+    if (!changed.empty())
+    {
+        for (ShaderVariants* variants : UShaderVariantSets())
+        {
+            bool affected = false;
+            for (const string& name : changed)
+                affected = affected || find(variants->dependencies.begin(), variants->dependencies.end(), name) != variants->dependencies.end();
+            if (!affected)
+                continue;
+
+            ShaderReload reload;
+            reload.variants = variants;
+            if (!ULoadShaderSources(variants->files, reload.sources, reload.dependencies))
+            {
+                cout << "INFO: Keeping the previous " << UShaderSetName(*variants) << " programs" << endl;
+                continue;
+            }
+            for (const pair<const unsigned, GLuint>& variant : variants->programs)
+                reload.features.push_back(variant.first);
+
+            lock_guard<mutex> lock(gReloadMutex);
+            gReloadQueue.push_back(move(reload));
+            gReloadWake.notify_one();
+        }
+    }
+
+    bool swapped = false;
+    vector<ShaderReload> done;
+    {
+        lock_guard<mutex> lock(gReloadMutex);
+        done.swap(gReloadDone);
+    }
+    for (ShaderReload& reload : done)
+    {
+        ShaderVariants& variants = *reload.variants;
+        if (reload.programs.size() != reload.features.size())
+        {
+            cout << "INFO: Keeping the previous " << UShaderSetName(variants) << " programs" << endl;
+            continue;
+        }
+
+        // Between frames nothing is drawing with the old programs any more
+        for (size_t i = 0; i < reload.features.size(); i++)
+        {
+            GLuint& programId = variants.programs[reload.features[i]];
+            if (programId != 0)
+                UDiscardShaderProgram(programId);
+            programId = reload.programs[i];
+        }
+        // Variants built or requested since the files changed came from the old sources; they are
+        // dropped and built again from the new ones the next time they are used
+        for (map<unsigned, GLuint>::iterator variant = variants.programs.begin(); variant != variants.programs.end(); )
+        {
+            if (find(reload.features.begin(), reload.features.end(), variant->first) != reload.features.end())
+            {
+                ++variant;
+                continue;
+            }
+            if (variant->second != 0)
+                UDiscardShaderProgram(variant->second);
+            variant = variants.programs.erase(variant);
+        }
+        for (pair<const unsigned, PendingProgram>& request : variants.pending)
+        {
+            if (UFinishShaderProgram(request.second))
+                UDiscardShaderProgram(request.second.programId);
+        }
+        variants.pending.clear();
+        for (int stage = 0; stage < SHADER_STAGE_COUNT; stage++)
+            variants.sources[stage] = move(reload.sources[stage]);
+        variants.dependencies = move(reload.dependencies);
+        swapped = true;
+        cout << "INFO: Reloaded " << UShaderSetName(variants) << " (" << reload.features.size() << " variants) in "
+            << reload.milliseconds << " ms" << endl;
+    }
+    return swapped;
+}
+
+void UStopShaderHotReload()
+{
+    if (!gHotReloadRunning)
+        return;
+
+    {
+        lock_guard<mutex> lock(gReloadMutex);
+        gReloadStopping = true;
+        gReloadQueue.clear();
+    }
+    gReloadWake.notify_one();
+    gReloadThread.join();
+
+    for (const ShaderReload& reload : gReloadDone)
+    {
+        for (GLuint programId : reload.programs)
+        {
+            if (programId != 0)
+                UDestroyShaderProgram(programId);
+        }
+    }
+    gReloadDone.clear();
+    glfwDestroyWindow(gReloadContext);
+    gReloadContext = nullptr;
+#ifdef __linux__
+    close(gWatchFd);
+    gWatchFd = -1;
+#endif
+    gHotReloadRunning = false;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// Shader hot reload. SHADER_DIRECTORY is watched for changes (inotify on Linux, file times
+// elsewhere); when a file changes, every variant set that read it (see ShaderVariants.h) is
+// rebuilt from the new sources on a background thread with its own GL context, shared with the
+// window's, so the frame loop never waits on the compiler. Finished rebuilds are swapped in at
+// the start of a frame, every variant of a set at once. If any variant fails to build, the error
+// is printed and the set keeps the programs it had.
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// Needs `window`'s context current on the calling thread. Returns false, leaving the shaders as
+// loaded, if the files can't be watched or no shared context can be created.
+bool UStartShaderHotReload(GLFWwindow* window);
+// Call on the main thread between frames: starts rebuilds for changed files and swaps in the ones
+// that have finished. Returns whether any programs were swapped; does nothing unless hot reload is running.
+bool UApplyShaderReloads();
+// Waits for the rebuild in progress, if any, and drops the ones not swapped in yet
+void UStopShaderHotReload();
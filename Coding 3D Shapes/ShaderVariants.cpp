@@ -0,0 +1,189 @@
+#include "ShaderVariants.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+    const char* const SHADER_FEATURE_NAMES[SHADER_FEATURE_COUNT] =
+    {
+        "FEATURE_UNLIT",
+        "FEATURE_TEXTURED",
+        "FEATURE_LIGHTMAP",
+        "FEATURE_PROBES",
+        "FEATURE_SHADOWS",
+    };
+    // Deep enough for chunks including chunks, shallow enough to stop an include cycle
+    const int SHADER_MAX_INCLUDE_DEPTH = 8;
+
+    vector<ShaderVariants*> gShaderVariantSets;
+
+    bool ULoadShaderFile(const string& name, string& source, vector<string>& dependencies, int depth)
+    {
+        string path = string(SHADER_DIRECTORY) + "/" + name;
+        ifstream file(path);
+        if (!file || depth > SHADER_MAX_INCLUDE_DEPTH)
+        {
+            cout << "ERROR::SHADER::FILE_NOT_READ\n" << path << endl;
+            return false;
+        }
+        if (find(dependencies.begin(), dependencies.end(), name) == dependencies.end())
+            dependencies.push_back(name);
+
+        // `#include "chunk"` lines are replaced by the chunk, everything else is copied
+        string line;
+        while (getline(file, line))
+        {
+            size_t start = line.find_first_not_of(" \t");
+            if (start != string::npos && line.compare(start, 8, "#include") == 0)
+            {
+                size_t open = line.find('"', start);
+                size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+                if (close == string::npos)
+                {
+                    cout << "ERROR::SHADER::BAD_INCLUDE\n" << path << ": " << line << endl;
+                    return false;
+                }
+                if (!ULoadShaderFile(line.substr(open + 1, close - open - 1), source, dependencies, depth + 1))
+                    return false;
+                continue;
+            }
+            source += line;
+            source += '\n';
+        }
+        return true;
+    }
+}
+
+bool ULoadShaderSources(const char* const files[SHADER_STAGE_COUNT], string sources[SHADER_STAGE_COUNT],
+    vector<string>& dependencies)
+{
+    dependencies.clear();
+    for (int stage = 0; stage < SHADER_STAGE_COUNT; stage++)
+    {
+        sources[stage].clear();
+        if (files[stage] && !ULoadShaderFile(files[stage], sources[stage], dependencies, 0))
+            return false;
+    }
+    return true;
+}
+
+bool ULoadShaderVariants(ShaderVariants& variants, const char* vertexFile, const char* fragmentFile,
+    const char* tessControlFile, const char* tessEvalFile)
+{
+    variants.files[STAGE_VERTEX] = vertexFile;
+    variants.files[STAGE_FRAGMENT] = fragmentFile;
+    variants.files[STAGE_TESS_CONTROL] = tessControlFile;
+    variants.files[STAGE_TESS_EVALUATION] = tessEvalFile;
+    if (!ULoadShaderSources(variants.files, variants.sources, variants.dependencies))
+        return false;
+
+    if (find(gShaderVariantSets.begin(), gShaderVariantSets.end(), &variants) == gShaderVariantSets.end())
+        gShaderVariantSets.push_back(&variants);
+    return true;
+}
+
+const vector<ShaderVariants*>& UShaderVariantSets()
+{
+    return gShaderVariantSets;
+}
+
+string USpecializeShader(const string& source, unsigned features)
+{
+    string defines;
+    for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+        defines += string("#define ") + SHADER_FEATURE_NAMES[i] + ((features & (1u << i)) ? " 1\n" : " 0\n");
+
+    // Only comments and whitespace may come before #version, so the defines go after its line
+    string specialized = source;
+    size_t version = specialized.find("#version");
+    size_t lineEnd = version == string::npos ? string::npos : specialized.find('\n', version);
+    if (lineEnd == string::npos)
+        return defines + specialized;
+    specialized.insert(lineEnd + 1, defines);
+    return specialized;
+}
+
+void UBeginShaderVariant(const string sources[SHADER_STAGE_COUNT], unsigned features, PendingProgram& pending)
+{
+    // Every stage sees the same constants, so shared chunks can test them too
+    string specialized[SHADER_STAGE_COUNT];
+    for (int stage = 0; stage < SHADER_STAGE_COUNT; stage++)
+    {
+        if (!sources[stage].empty())
+            specialized[stage] = USpecializeShader(sources[stage], features);
+    }
+
+    if (!specialized[STAGE_TESS_CONTROL].empty())
+        UBeginShaderProgram(specialized[STAGE_VERTEX].c_str(), specialized[STAGE_TESS_CONTROL].c_str(),
+            specialized[STAGE_TESS_EVALUATION].c_str(), specialized[STAGE_FRAGMENT].c_str(), pending);
+    else
+        UBeginShaderProgram(specialized[STAGE_VERTEX].c_str(), specialized[STAGE_FRAGMENT].c_str(), pending);
+}
+
+void URequestShaderVariant(ShaderVariants& variants, unsigned features)
+{
+    if (variants.programs.count(features) || variants.pending.count(features))
+        return;
+    UBeginShaderVariant(variants.sources, features, variants.pending[features]);
+}
+
+size_t UPollShaderVariants(ShaderVariants& variants)
+{
+    map<unsigned, PendingProgram>::iterator it = variants.pending.begin();
+    while (it != variants.pending.end())
+    {
+        if (UPollShaderProgram(it->second) == PROGRAM_PENDING)
+        {
+            ++it;
+            continue;
+        }
+        variants.programs[it->first] = it->second.programId; // 0 if it failed
+        it = variants.pending.erase(it);
+    }
+    return variants.pending.size();
+}
+
+GLuint UShaderVariant(ShaderVariants& variants, unsigned features)
+{
+    map<unsigned, GLuint>::const_iterator found = variants.programs.find(features);
+    if (found != variants.programs.end())
+        return found->second;
+
+    URequestShaderVariant(variants, features);
+    PendingProgram& pending = variants.pending[features];
+    UFinishShaderProgram(pending);
+    GLuint programId = pending.programId;
+    variants.programs[features] = programId;
+    variants.pending.erase(features);
+    return programId;
+}
+
+bool UFindShaderVariant(const ShaderVariants& variants, unsigned features, GLuint& programId)
+{
+    map<unsigned, GLuint>::const_iterator found = variants.programs.find(features);
+    if (found == variants.programs.end())
+        return false;
+    programId = found->second;
+    return true;
+}
+
+void UDestroyShaderVariants(ShaderVariants& variants)
+{
+    for (pair<const unsigned, PendingProgram>& request : variants.pending)
+    {
+        if (UFinishShaderProgram(request.second))
+            UDestroyShaderProgram(request.second.programId);
+    }
+    variants.pending.clear();
+    gShaderVariantSets.erase(remove(gShaderVariantSets.begin(), gShaderVariantSets.end(), &variants), gShaderVariantSets.end());
+    for (const pair<const unsigned, GLuint>& variant : variants.programs)
+    {
+        if (variant.second != 0)
+            UDestroyShaderProgram(variant.second);
+    }
+    variants.programs.clear();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// Compile-time specialisation of the shaders. The GLSL lives in files under SHADER_DIRECTORY, one
+// source per stage serving every material: each feature key below becomes a `FEATURE_...`
+// constant (0 or 1) defined right after the #version line, and the source tests those constants
+// instead of uniforms, so the GLSL compiler drops the code of every feature a variant leaves out.
+// Sources may pull in shared chunks with `#include "file"`. Variants are compiled the first time
+// a material asks for them and kept until UDestroyShaderVariants. Variants known to be needed can
+// be requested up front instead, all at once, so the driver compiles them in parallel.
+
+#include "Shaders.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+const char* const SHADER_DIRECTORY = "shaders";
+
+enum ShaderFeature : unsigned
+{
+    SHADER_UNLIT = 1u << 0,    // flat uniformColor, no lighting at all (the light source cubes)
+    SHADER_TEXTURED = 1u << 1, // surface color times textureSampler
+    SHADER_LIGHTMAP = 1u << 2, // baked irradiance from the object's lightmap; baked lights are skipped
+    SHADER_PROBES = 1u << 3,   // baked irradiance from the probe grid instead of the flat ambient color
+    SHADER_SHADOWS = 1u << 4,  // shadowedLight is attenuated by the shadow map
+};
+const int SHADER_FEATURE_COUNT = 5;
+
+enum ShaderStage
+{
+    STAGE_VERTEX,
+    STAGE_FRAGMENT,
+    STAGE_TESS_CONTROL,
+    STAGE_TESS_EVALUATION,
+    SHADER_STAGE_COUNT
+};
+
+// A set of stage sources and the variants built from them so far
+struct ShaderVariants
+{
+    const char* files[SHADER_STAGE_COUNT] = {}; // under SHADER_DIRECTORY; null for unused tessellation stages
+    std::string sources[SHADER_STAGE_COUNT];
+    std::vector<std::string> dependencies;      // every file the sources were read from, includes too
+    std::map<unsigned, GLuint> programs;        // by feature mask; 0 marks a variant that failed to build
+    std::map<unsigned, PendingProgram> pending; // requested, not finished yet
+};
+
+// Reads the stage files into `variants` and registers it with UShaderVariantSets. Returns false
+// (the error is printed) if a file can't be read.
+bool ULoadShaderVariants(ShaderVariants& variants, const char* vertexFile, const char* fragmentFile,
+    const char* tessControlFile = nullptr, const char* tessEvalFile = nullptr);
+// Reads the files named in `files` (null entries stay empty), expanding #include lines
+bool ULoadShaderSources(const char* const files[SHADER_STAGE_COUNT], std::string sources[SHADER_STAGE_COUNT],
+    std::vector<std::string>& dependencies);
+// Every set loaded and not yet destroyed, for the hot reloader
+const std::vector<ShaderVariants*>& UShaderVariantSets();
+
+// `source` with a FEATURE_ constant for every key inserted after its #version line
+std::string USpecializeShader(const std::string& source, unsigned features);
+// Submits `sources` specialised for `features` to the driver without waiting for it
+void UBeginShaderVariant(const std::string sources[SHADER_STAGE_COUNT], unsigned features, PendingProgram& pending);
+// Submits the variant for `features` to the driver without waiting for it
+void URequestShaderVariant(ShaderVariants& variants, unsigned features);
+// Moves finished requests into `programs`; returns how many are still compiling
+size_t UPollShaderVariants(ShaderVariants& variants);
+// The program for `features`, compiled on first use (or waited for, if requested); 0 if it
+// failed (the error is printed once)
+GLuint UShaderVariant(ShaderVariants& variants, unsigned features);
+// Whether the variant for `features` has been built, and if so its program (0 if it failed).
+// Only reads `variants`, so any thread may call it while the GL thread leaves the set alone.
+bool UFindShaderVariant(const ShaderVariants& variants, unsigned features, GLuint& programId);
+void UDestroyShaderVariants(ShaderVariants& variants);
@@ -0,0 +1,328 @@
+#include "Shaders.h"
+#include "ImageIO.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const char SHADER_CACHE_MAGIC[8] = { 'G', 'L', 'P', 'R', 'O', 'G', '0', '1' };
+
+    string gShaderCacheDirectory; // empty while the cache is off
+    // Programs are also built on the hot reload thread, so the counts are atomic
+    atomic<int> gProgramsLoaded(0);
+    atomic<int> gProgramsCompiled(0);
+    // The key of every live program that is in the cache, so a replaced one can take its file along
+    mutex gProgramKeysMutex;
+    map<GLuint, uint64_t> gProgramKeys;
+
+    // 64-bit FNV-1a; `hash` carries on from an earlier call
+    uint64_t UHashString(const char* text, uint64_t hash = 14695981039346656037ull)
+    {
+        // The terminator goes in too, so moving text between two strings changes the hash
+        for (const char* c = text; ; c++)
+        {
+            hash ^= static_cast<unsigned char>(*c);
+            hash *= 1099511628211ull;
+            if (*c == 0)
+                break;
+        }
+        return hash;
+    }
+
+    uint64_t UShaderCacheKey(const char* const* sources, int sourceCount)
+    {
+        uint64_t hash = UHashString("");
+        const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : driverStrings)
+        {
+            const GLubyte* value = glGetString(name);
+            hash = UHashString(value ? reinterpret_cast<const char*>(value) : "", hash);
+        }
+        for (int i = 0; i < sourceCount; i++)
+            hash = UHashString(sources[i], hash);
+        return hash;
+    }
+
+    string UShaderCachePath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return gShaderCacheDirectory + "/" + name;
+    }
+
+    // Cache file: magic, key, binary format, binary length, binary
+    bool ULoadCachedProgram(uint64_t key, GLuint programId)
+    {
+        FILE* file = fopen(UShaderCachePath(key).c_str(), "rb");
+        if (!file)
+            return false;
+
+        char magic[sizeof(SHADER_CACHE_MAGIC)];
+        uint64_t fileKey = 0;
+        uint32_t format = 0;
+        uint32_t length = 0;
+        bool ok = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, SHADER_CACHE_MAGIC, sizeof(magic)) == 0 &&
+            fread(&fileKey, sizeof(fileKey), 1, file) == 1 && fileKey == key &&
+            fread(&format, sizeof(format), 1, file) == 1 && fread(&length, sizeof(length), 1, file) == 1 && length > 0;
+        vector<unsigned char> binary(ok ? length : 0);
+        ok = ok && fread(binary.data(), 1, binary.size(), file) == binary.size();
+        fclose(file);
+        if (!ok)
+            return false;
+
+        glProgramBinary(programId, format, binary.data(), static_cast<GLsizei>(binary.size()));
+        int success = 0;
+        glGetProgramiv(programId, GL_LINK_STATUS, &success);
+        if (!success)
+            cout << "INFO: Cached shader program rejected by the driver, recompiling" << endl;
+        return success != 0;
+    }
+
+    void USaveCachedProgram(uint64_t key, GLuint programId)
+    {
+        int length = 0;
+        glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        vector<unsigned char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(programId, length, &length, &format, binary.data());
+
+        string path = UShaderCachePath(key);
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            cout << "ERROR::SHADER::CACHE_WRITE_FAILED\n" << path << endl;
+            return;
+        }
+        uint32_t format32 = format;
+        uint32_t length32 = static_cast<uint32_t>(length);
+        fwrite(SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC), 1, file);
+        fwrite(&key, sizeof(key), 1, file);
+        fwrite(&format32, sizeof(format32), 1, file);
+        fwrite(&length32, sizeof(length32), 1, file);
+        fwrite(binary.data(), 1, length32, file);
+        bool ok = ferror(file) == 0;
+        fclose(file);
+        if (!ok)
+        {
+            cout << "ERROR::SHADER::CACHE_WRITE_FAILED\n" << path << endl;
+            remove(path.c_str()); // a truncated binary would only be rejected next run
+        }
+    }
+
+    void URememberCacheKey(GLuint programId, uint64_t key)
+    {
+        lock_guard<mutex> lock(gProgramKeysMutex);
+        gProgramKeys[programId] = key;
+    }
+
+    bool gParallelCompile = false;
+
+    // Starts one stage compiling and attaches it; its status is only read once the program is done
+    void UStartShader(GLenum type, const char* source, const char* stageName, PendingProgram& pending)
+    {
+        GLuint shaderId = glCreateShader(type);
+        glShaderSource(shaderId, 1, &source, NULL);
+        glCompileShader(shaderId);
+        glAttachShader(pending.programId, shaderId);
+        pending.shaders[pending.shaderCount] = shaderId;
+        pending.stageNames[pending.shaderCount] = stageName;
+        pending.shaderCount++;
+    }
+
+    // Prints why a program failed: the first stage that didn't compile, or else the link
+    void UPrintProgramErrors(const PendingProgram& pending)
+    {
+        char infoLog[512];
+        for (int i = 0; i < pending.shaderCount; i++)
+        {
+            int success = 0;
+            glGetShaderiv(pending.shaders[i], GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(pending.shaders[i], sizeof(infoLog), NULL, infoLog);
+                cout << "ERROR::SHADER::" << pending.stageNames[i] << "::COMPILATION_FAILED\n" << infoLog << endl;
+                return;
+            }
+        }
+        glGetProgramInfoLog(pending.programId, sizeof(infoLog), NULL, infoLog);
+        cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
+    }
+
+    // Reads the link status, waiting for the driver if it is still busy, and settles the program
+    void UCompleteProgram(PendingProgram& pending)
+    {
+        int success = 0;
+        glGetProgramiv(pending.programId, GL_LINK_STATUS, &success);
+        if (success)
+        {
+            pending.status = PROGRAM_READY;
+            gProgramsCompiled++;
+            if (pending.cacheKey != 0)
+            {
+                USaveCachedProgram(pending.cacheKey, pending.programId);
+                URememberCacheKey(pending.programId, pending.cacheKey);
+            }
+        }
+        else
+        {
+            UPrintProgramErrors(pending);
+            pending.status = PROGRAM_FAILED;
+            glDeleteProgram(pending.programId);
+            pending.programId = 0;
+        }
+
+        // The program keeps its own copy of what it needs from the shaders
+        for (int i = 0; i < pending.shaderCount; i++)
+            glDeleteShader(pending.shaders[i]);
+        pending.shaderCount = 0;
+    }
+
+    void UBeginShaderProgram(const char* const* sources, PendingProgram& pending)
+    {
+        // Vertex, fragment, then the optional tessellation stages
+        const bool tessellated = sources[2] != nullptr;
+        const int sourceCount = tessellated ? 4 : 2;
+        pending = PendingProgram();
+        pending.cacheKey = gShaderCacheDirectory.empty() ? 0 : UShaderCacheKey(sources, sourceCount);
+
+        pending.programId = glCreateProgram();
+        if (pending.cacheKey != 0)
+        {
+            if (ULoadCachedProgram(pending.cacheKey, pending.programId))
+            {
+                pending.status = PROGRAM_READY;
+                gProgramsLoaded++;
+                URememberCacheKey(pending.programId, pending.cacheKey);
+                return;
+            }
+            // A rejected binary can leave the program in any state, so start over
+            glDeleteProgram(pending.programId);
+            pending.programId = glCreateProgram();
+            glProgramParameteri(pending.programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+
+        // No status queries in between: with parallel compilation every call here returns at once
+        UStartShader(GL_VERTEX_SHADER, sources[0], "VERTEX", pending);
+        if (tessellated)
+        {
+            UStartShader(GL_TESS_CONTROL_SHADER, sources[2], "TESS_CONTROL", pending);
+            UStartShader(GL_TESS_EVALUATION_SHADER, sources[3], "TESS_EVALUATION", pending);
+        }
+        UStartShader(GL_FRAGMENT_SHADER, sources[1], "FRAGMENT", pending);
+        glLinkProgram(pending.programId);
+    }
+}
+
+bool UEnableShaderCache(const char* directory)
+{
+    int formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount <= 0 || !UMakeDirectory(directory))
+        return false;
+
+    gShaderCacheDirectory = directory;
+    return true;
+}
+
+ShaderCacheStats UShaderCacheStats()
+{
+    ShaderCacheStats stats;
+    stats.loaded = gProgramsLoaded;
+    stats.compiled = gProgramsCompiled;
+    return stats;
+}
+
+bool UEnableParallelShaderCompile()
+{
+    // 0xFFFFFFFF leaves the number of compiler threads to the driver
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+    else
+        return false;
+
+    gParallelCompile = true;
+    return true;
+}
+
+void UBeginShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, PendingProgram& pending)
+{
+    const char* sources[] = { vtxShaderSource, fragShaderSource, nullptr, nullptr };
+    UBeginShaderProgram(sources, pending);
+}
+
+void UBeginShaderProgram(const char* vtxShaderSource, const char* tessControlSource, const char* tessEvalSource,
+    const char* fragShaderSource, PendingProgram& pending)
+{
+    const char* sources[] = { vtxShaderSource, fragShaderSource, tessControlSource, tessEvalSource };
+    UBeginShaderProgram(sources, pending);
+}
+
+ShaderProgramStatus UPollShaderProgram(PendingProgram& pending)
+{
+    if (pending.status != PROGRAM_PENDING)
+        return pending.status;
+
+    // Without the extension there is nothing to ask; the link status query waits instead
+    if (gParallelCompile)
+    {
+        int done = 0;
+        glGetProgramiv(pending.programId, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done)
+            return PROGRAM_PENDING;
+    }
+    UCompleteProgram(pending);
+    return pending.status;
+}
+
+bool UFinishShaderProgram(PendingProgram& pending)
+{
+    if (pending.status == PROGRAM_PENDING)
+        UCompleteProgram(pending);
+    return pending.status == PROGRAM_READY;
+}
+
+void UDestroyShaderProgram(GLuint programId)
+{
+    {
+        lock_guard<mutex> lock(gProgramKeysMutex);
+        gProgramKeys.erase(programId);
+    }
+    glDeleteProgram(programId);
+}
+
+void UDiscardShaderProgram(GLuint programId)
+{
+    uint64_t key = 0;
+    {
+        lock_guard<mutex> lock(gProgramKeysMutex);
+        map<GLuint, uint64_t>::iterator found = gProgramKeys.find(programId);
+        if (found != gProgramKeys.end())
+        {
+            key = found->second;
+            gProgramKeys.erase(found);
+            // A replacement built from unchanged sources shares the file
+            for (const pair<const GLuint, uint64_t>& other : gProgramKeys)
+            {
+                if (other.second == key)
+                    key = 0;
+            }
+        }
+    }
+    if (key != 0)
+        remove(UShaderCachePath(key).c_str());
+    glDeleteProgram(programId);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Compiling and linking GLSL programs. Once UEnableShaderCache has been called, every linked
+// program is also saved to disk as the driver's own binary, keyed by a hash of its sources and
+// of the GL vendor, renderer and version strings, so later runs on the same driver skip the
+// GLSL compiler. A binary the driver rejects (after a driver update, say) is recompiled from
+// source and replaced, and a program discarded after a hot reload takes its binary with it.
+//
+// Programs are built asynchronously: UBeginShaderProgram hands every stage and the link to
+// the driver without reading back any status, and UPollShaderProgram checks on it later. With
+// KHR_parallel_shader_compile the driver compiles on its own threads meanwhile, so submitting a
+// batch of programs before polling any of them keeps all those threads busy.
+
+#include <GL/glew.h>
+
+#include <cstdint>
+
+const char* const SHADER_CACHE_DIRECTORY = "shadercache";
+
+struct ShaderCacheStats
+{
+    int loaded = 0;   // programs created from a cached binary
+    int compiled = 0; // programs compiled from source
+};
+
+// Needs a current context. Returns false, leaving the cache off, if the driver offers no
+// binary formats or `directory` can't be created.
+bool UEnableShaderCache(const char* directory);
+ShaderCacheStats UShaderCacheStats();
+
+enum ShaderProgramStatus
+{
+    PROGRAM_PENDING,
+    PROGRAM_READY,
+    PROGRAM_FAILED, // the error has been printed and the program deleted
+};
+
+// A program handed to the driver whose compile and link may still be running
+struct PendingProgram
+{
+    GLuint programId = 0;
+    ShaderProgramStatus status = PROGRAM_PENDING;
+    GLuint shaders[4] = {}; // kept until the program is done, for their compile logs
+    const char* stageNames[4] = {};
+    int shaderCount = 0;
+    uint64_t cacheKey = 0; // 0 when the cache is off
+};
+
+// Asks the driver to compile on background threads (KHR or ARB_parallel_shader_compile). Returns
+// false if it can't, in which case polling blocks like a plain compile.
+bool UEnableParallelShaderCompile();
+// Submits the program without waiting; a cached binary is ready at once. The sources are copied
+// by the driver, so they only need to live through the call.
+void UBeginShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, PendingProgram& pending);
+void UBeginShaderProgram(const char* vtxShaderSource, const char* tessControlSource, const char* tessEvalSource,
+    const char* fragShaderSource, PendingProgram& pending);
+// Never blocks while parallel compilation is on
+ShaderProgramStatus UPollShaderProgram(PendingProgram& pending);
+// Waits for the program; true if it is ready
+bool UFinishShaderProgram(PendingProgram& pending);
+
+void UDestroyShaderProgram(GLuint programId);
+// Destroys a program whose sources have changed since it was built, deleting its cache file too,
+// so edited shaders don't leave a binary behind for every version
+void UDiscardShaderProgram(GLuint programId);
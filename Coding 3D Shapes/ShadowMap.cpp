@@ -0,0 +1,247 @@
+#include "ShadowMap.h"
+#include "Lod.h"
+#include "ShaderVariants.h"
+
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+    // shaders/depth.*, a single variant; the locations belong to gDepthProgramId, which changes
+    // when the shaders are reloaded
+    ShaderVariants gDepthShaders;
+    GLuint gDepthProgramId = 0;
+    GLint gModelLoc = -1;
+    GLint gPositionScaleLoc = -1;
+    GLint gPositionOffsetLoc = -1;
+}
+
+bool UCreateShadowMap(ShadowMap& map, int size)
+{
+    if (gDepthShaders.programs.empty())
+    {
+        if (!ULoadShaderVariants(gDepthShaders, "depth.vert", "depth.frag") || UShaderVariant(gDepthShaders, 0) == 0)
+        {
+            UDestroyShaderVariants(gDepthShaders);
+            return false;
+        }
+    }
+
+    map.size = size;
+    glGenTextures(1, &map.depthTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, map.depthTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, SHADOW_CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // Hardware depth comparison with bilinear filtering gives a little free PCF on top of the shader's
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &map.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, map.framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, map.depthTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cout << "ERROR::SHADOW::FRAMEBUFFER_INCOMPLETE\n" << status << endl;
+        UDestroyShadowMap(map);
+        return false;
+    }
+    for (ShadowCascade& cascade : map.cascades)
+        cascade.valid = false;
+    return true;
+}
+
+void UDestroyShadowMap(ShadowMap& map)
+{
+    glDeleteFramebuffers(1, &map.framebuffer);
+    glDeleteTextures(1, &map.depthTexture);
+    map.framebuffer = 0;
+    map.depthTexture = 0;
+    for (ShadowCascade& cascade : map.cascades)
+        cascade.valid = false;
+
+    UDestroyShaderVariants(gDepthShaders);
+    gDepthProgramId = 0;
+}
+
+void USpotShadowView(const glm::vec3& position, const glm::vec3& target, glm::mat4& view, glm::mat4& projection)
+{
+    // Any up vector works as long as it isn't parallel to the light's direction
+    glm::vec3 direction = glm::normalize(target - position);
+    glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    view = glm::lookAt(position, target, up);
+    projection = glm::perspective(glm::radians(SHADOW_SPOT_FOV_DEGREES), 1.0f, SHADOW_SPOT_NEAR, SHADOW_SPOT_FAR);
+}
+
+float UShadowSplitDepth(int cascade)
+{
+    const float nearDepth = SCENE_NEAR_PLANE;
+    const float farDepth = min(SHADOW_DISTANCE, SCENE_FAR_PLANE);
+    float fraction = float(cascade + 1) / SHADOW_CASCADE_COUNT;
+    float logarithmic = nearDepth * pow(farDepth / nearDepth, fraction);
+    float even = nearDepth + (farDepth - nearDepth) * fraction;
+    return SHADOW_SPLIT_LAMBDA * logarithmic + (1.0f - SHADOW_SPLIT_LAMBDA) * even;
+}
+
+void UFitShadowCascades(const glm::mat4& lightView, const glm::mat4& lightProjection, const glm::mat4& cameraView,
+    const glm::mat4& cameraProjection, ShadowMap& map)
+{
+    const glm::mat4 inverseProjection = glm::inverse(cameraProjection);
+    const glm::mat4 cameraToLight = lightView * glm::inverse(cameraView);
+    const float lightNearZ = -SHADOW_SPOT_NEAR;
+
+    float nearDepth = SCENE_NEAR_PLANE;
+    for (int c = 0; c < SHADOW_CASCADE_COUNT; c++)
+    {
+        const float farDepth = UShadowSplitDepth(c);
+
+        // Corners of the camera's slice in light view space; bit 0 picks x, bit 1 y, bit 2 near or far
+        glm::vec3 corners[8];
+        for (int k = 0; k < 8; k++)
+        {
+            glm::vec3 p = UPointAtViewDepth(inverseProjection, (k & 1) ? 1.0f : -1.0f, (k & 2) ? 1.0f : -1.0f,
+                (k & 4) ? farDepth : nearDepth);
+            corners[k] = glm::vec3(cameraToLight * glm::vec4(p, 1.0f));
+        }
+
+        // Footprint in the light's NDC. Only the part in front of the light's near plane projects
+        // sensibly, so the slice's edges are clipped against it first.
+        glm::vec2 lo(INFINITY), hi(-INFINITY);
+        auto addPoint = [&](const glm::vec3& p)
+        {
+            glm::vec4 clip = lightProjection * glm::vec4(p, 1.0f);
+            glm::vec2 ndc = glm::vec2(clip) / clip.w;
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        };
+        for (int k = 0; k < 8; k++)
+        {
+            if (corners[k].z <= lightNearZ)
+                addPoint(corners[k]);
+            for (int axis = 1; axis < 8; axis <<= 1)
+            {
+                if (k & axis)
+                    continue;
+                const glm::vec3& a = corners[k];
+                const glm::vec3& b = corners[k | axis];
+                if ((a.z <= lightNearZ) != (b.z <= lightNearZ))
+                    addPoint(a + (b - a) * ((lightNearZ - a.z) / (b.z - a.z)));
+            }
+        }
+        lo = glm::max(lo, glm::vec2(-1.0f));
+        hi = glm::min(hi, glm::vec2(1.0f));
+        if (lo.x >= hi.x || lo.y >= hi.y)
+        {
+            // Slice entirely outside the cone: nothing there is shadowed, keep the whole cone
+            lo = glm::vec2(-1.0f);
+            hi = glm::vec2(1.0f);
+        }
+
+        // Square crop with a texel of slack, its size rounded up to quarter-octave steps so it only
+        // changes now and then, and its center snapped to that size's texel grid
+        float extent = max(hi.x - lo.x, hi.y - lo.y) * (1.0f + 2.0f / map.size);
+        extent = min(pow(2.0f, ceil(log2(extent) * 4.0f) / 4.0f), 2.0f);
+        float texel = extent / map.size;
+        glm::vec2 center = extent >= 2.0f ? glm::vec2(0.0f) : glm::round((lo + hi) * 0.5f / texel) * texel;
+
+        glm::mat4 crop = glm::scale(glm::vec3(2.0f / extent, 2.0f / extent, 1.0f)) * glm::translate(glm::vec3(-center, 0.0f));
+        map.cascades[c].viewProjection = crop * lightProjection * lightView;
+        map.cascades[c].splitDepth = farDepth;
+        nearDepth = farDepth;
+    }
+}
+
+void UShadowHash(uint64_t& hash, const void* data, size_t bytes)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+bool UBeginShadowPass(ShadowMap& map, int cascade, uint64_t contentHash)
+{
+    ShadowCascade& target = map.cascades[cascade];
+    if (target.valid && target.contentHash == contentHash)
+        return false;
+
+    target.contentHash = contentHash;
+    target.valid = true;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, map.framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, map.depthTexture, 0, cascade);
+    glViewport(0, 0, map.size, map.size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    // Slope-scaled bias keeps surfaces from shadowing themselves at grazing angles
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    GLuint programId = UShaderVariant(gDepthShaders, 0);
+    if (programId != gDepthProgramId)
+    {
+        gDepthProgramId = programId;
+        gModelLoc = glGetUniformLocation(programId, "model");
+        gPositionScaleLoc = glGetUniformLocation(programId, "positionScale");
+        gPositionOffsetLoc = glGetUniformLocation(programId, "positionOffset");
+    }
+    glUseProgram(gDepthProgramId);
+    glUniformMatrix4fv(glGetUniformLocation(gDepthProgramId, "lightViewProjection"), 1, GL_FALSE, glm::value_ptr(target.viewProjection));
+    return true;
+}
+
+void USetShadowCasterUniforms(const glm::mat4& model, const VertexQuantization& quantization)
+{
+    glUniformMatrix4fv(gModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    glUniform3fv(gPositionScaleLoc, 1, glm::value_ptr(quantization.scale));
+    glUniform3fv(gPositionOffsetLoc, 1, glm::value_ptr(quantization.offset));
+}
+
+void UEndShadowPass()
+{
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void USetShadowUniforms(GLuint programId, const ShadowMap* map, int lightIndex)
+{
+    bool ready = map != nullptr;
+    for (int c = 0; ready && c < SHADOW_CASCADE_COUNT; c++)
+        ready = map->cascades[c].valid;
+
+    glUniform1i(glGetUniformLocation(programId, "shadowMap"), SHADOW_TEXTURE_UNIT);
+    glUniform1i(glGetUniformLocation(programId, "shadowedLight"), ready ? lightIndex : -1);
+    if (!ready)
+        return;
+
+    // Clip space to [0, 1] texture coordinates and depth
+    const glm::mat4 bias = glm::translate(glm::vec3(0.5f)) * glm::scale(glm::vec3(0.5f));
+    glm::mat4 matrices[SHADOW_CASCADE_COUNT];
+    float splits[SHADOW_CASCADE_COUNT];
+    for (int c = 0; c < SHADOW_CASCADE_COUNT; c++)
+    {
+        matrices[c] = bias * map->cascades[c].viewProjection;
+        splits[c] = map->cascades[c].splitDepth;
+    }
+    glUniformMatrix4fv(glGetUniformLocation(programId, "shadowMatrices"), SHADOW_CASCADE_COUNT, GL_FALSE, glm::value_ptr(matrices[0]));
+    glUniform1fv(glGetUniformLocation(programId, "shadowSplits"), SHADOW_CASCADE_COUNT, splits);
+    glUniform1f(glGetUniformLocation(programId, "shadowNormalOffset"), SHADOW_NORMAL_OFFSET);
+
+    glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, map->depthTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// Cascaded depth-map shadows. A shadowed light gets a ShadowMap: one depth layer per cascade,
+// each cropped from the light's projection to fit one slice of the camera's view, so nearby
+// receivers get dense texels and far ones share a coarser layer. Every cascade is cached on its
+// own: the caller hashes the cascade's matrix and the casters inside it, and only layers whose
+// hash changed are re-rendered, so a static scene seen from a still camera pays nothing.
+
+#include "Scene.h"
+#include "VertexFormat.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+
+// shaders/scene.frag declares this too, to size its cascade uniforms; keep them in step.
+const int SHADOW_CASCADE_COUNT = 4;
+// Size of each cascade's layer; four 1024 layers hold as many texels as one 2048 map
+const int SHADOW_MAP_SIZE = 1024;
+// Receivers further than this from the camera are left unshadowed
+const float SHADOW_DISTANCE = 30.0f;
+// Blend between logarithmic (1) and even (0) split distances. Pure logarithmic splits
+// spend a whole cascade on the first few centimetres in front of the camera.
+const float SHADOW_SPLIT_LAMBDA = 0.75f;
+// Spot cone of the key light's shadow, wide enough to cover the floor from where the light sits
+const float SHADOW_SPOT_FOV_DEGREES = 110.0f;
+const float SHADOW_SPOT_NEAR = 0.5f;
+const float SHADOW_SPOT_FAR = 25.0f;
+// Receivers look up the map this far along their normal, which hides acne on surfaces facing away from the light
+const float SHADOW_NORMAL_OFFSET = 0.03f;
+// Texture unit the scene shaders read the shadow map from; unit 0 holds the surface texture
+const int SHADOW_TEXTURE_UNIT = 1;
+
+struct ShadowCascade
+{
+    glm::mat4 viewProjection = glm::mat4(1.0f); // world to this cascade's clip space
+    float splitDepth = 0.0f;                    // view depth where this cascade ends
+    uint64_t contentHash = 0;                   // what the layer was last rendered from
+    bool valid = false;                         // false until rendered once
+};
+
+struct ShadowMap
+{
+    GLuint framebuffer = 0;
+    GLuint depthTexture = 0; // GL_TEXTURE_2D_ARRAY, one layer per cascade
+    int size = 0;
+    ShadowCascade cascades[SHADOW_CASCADE_COUNT];
+};
+
+bool UCreateShadowMap(ShadowMap& map, int size);
+void UDestroyShadowMap(ShadowMap& map);
+
+// View and projection of a spot light at `position` looking at `target`
+void USpotShadowView(const glm::vec3& position, const glm::vec3& target, glm::mat4& view, glm::mat4& projection);
+// View depth where each cascade ends, SHADOW_SPLIT_LAMBDA between logarithmic and even spacing
+float UShadowSplitDepth(int cascade);
+// Points each cascade at its slice of the camera's view: the light's projection is cropped to the
+// slice's footprint, with the crop's size rounded to fixed steps and its position snapped to whole
+// texels, so the shadow edges stay put while the camera moves or turns
+void UFitShadowCascades(const glm::mat4& lightView, const glm::mat4& lightProjection, const glm::mat4& cameraView,
+    const glm::mat4& cameraProjection, ShadowMap& map);
+
+// FNV-1a, for building the content hash a cascade is cached against
+const uint64_t SHADOW_HASH_SEED = 14695981039346656037ull;
+void UShadowHash(uint64_t& hash, const void* data, size_t bytes);
+
+// Starts re-rendering one cascade if `contentHash` differs from what its layer holds.
+// Returns false when the cached layer is still good and nothing needs drawing.
+bool UBeginShadowPass(ShadowMap& map, int cascade, uint64_t contentHash);
+// Per-caster uniforms for the depth-only program, between UBeginShadowPass and UEndShadowPass
+void USetShadowCasterUniforms(const glm::mat4& model, const VertexQuantization& quantization);
+// Restores the default framebuffer; the caller restores its viewport
+void UEndShadowPass();
+
+// Binds `map` and sets the receiver uniforms of a scene program, which must be current.
+// `lightIndex` is the light in the light buffer the map belongs to; pass a null map for no shadows.
+void USetShadowUniforms(GLuint programId, const ShadowMap* map, int lightIndex);
@@ -0,0 +1,82 @@
+#pragma once
+
+// Four-wide float vector used by the CPU-side loops: SSE2 where the compiler targets it,
+// otherwise a plain C++ fallback with the same interface. Masks are all-ones / all-zero lanes.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_USE_SSE 1
+#endif
+
+#ifdef SIMD_USE_SSE
+struct Float4
+{
+    __m128 v;
+    Float4() {}
+    Float4(__m128 value) : v(value) {}
+    Float4(float s) : v(_mm_set1_ps(s)) {}
+    Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+};
+
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+inline Float4 USqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+inline Float4 UMin(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+inline Float4 UMax(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+inline Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+inline Float4 operator|(Float4 a, Float4 b) { return _mm_or_ps(a.v, b.v); }
+inline Float4 operator>(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline Float4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline Float4 operator==(Float4 a, Float4 b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline int UMoveMask(Float4 a) { return _mm_movemask_ps(a.v); }
+inline Float4 ULoad4(const float* p) { return _mm_loadu_ps(p); }
+inline void UStore4(float* p, Float4 a) { _mm_storeu_ps(p, a.v); }
+inline Float4 USelect(Float4 mask, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+inline Float4 UTrueMask(bool value) { return _mm_castsi128_ps(_mm_set1_epi32(value ? -1 : 0)); }
+// Swaps rows and columns: afterwards `a` holds the first lane of each input, `b` the second, and so on
+inline void UTranspose4(Float4& a, Float4& b, Float4& c, Float4& d) { _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v); }
+#else
+struct Float4
+{
+    float v[4];
+    Float4() {}
+    Float4(float s) { v[0] = v[1] = v[2] = v[3] = s; }
+    Float4(float a, float b, float c, float d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+};
+
+inline uint32_t UBits(float f) { uint32_t u; std::memcpy(&u, &f, 4); return u; }
+inline float UFromBits(uint32_t u) { float f; std::memcpy(&f, &u, 4); return f; }
+inline float ULaneMask(bool value) { return UFromBits(value ? 0xFFFFFFFFu : 0u); }
+
+inline Float4 operator+(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline Float4 operator*(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline Float4 operator-(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline Float4 operator/(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+inline Float4 USqrt(Float4 a) { for (int i = 0; i < 4; i++) a.v[i] = std::sqrt(a.v[i]); return a; }
+inline Float4 UMin(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+inline Float4 UMax(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+inline Float4 operator&(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = UFromBits(UBits(a.v[i]) & UBits(b.v[i])); return a; }
+inline Float4 operator|(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = UFromBits(UBits(a.v[i]) | UBits(b.v[i])); return a; }
+inline Float4 operator>(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = ULaneMask(a.v[i] > b.v[i]); return a; }
+inline Float4 operator<(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = ULaneMask(a.v[i] < b.v[i]); return a; }
+inline Float4 operator==(Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = ULaneMask(a.v[i] == b.v[i]); return a; }
+inline int UMoveMask(Float4 a) { int m = 0; for (int i = 0; i < 4; i++) m |= (UBits(a.v[i]) >> 31) << i; return m; }
+inline Float4 ULoad4(const float* p) { return Float4(p[0], p[1], p[2], p[3]); }
+inline void UStore4(float* p, Float4 a) { std::memcpy(p, a.v, sizeof(a.v)); }
+inline Float4 USelect(Float4 mask, Float4 a, Float4 b) { for (int i = 0; i < 4; i++) a.v[i] = UBits(mask.v[i]) ? a.v[i] : b.v[i]; return a; }
+inline Float4 UTrueMask(bool value) { return Float4(ULaneMask(value)); }
+inline void UTranspose4(Float4& a, Float4& b, Float4& c, Float4& d)
+{
+    Float4* rows[4] = { &a, &b, &c, &d };
+    for (int i = 0; i < 4; i++)
+        for (int j = i + 1; j < 4; j++)
+            std::swap(rows[i]->v[j], rows[j]->v[i]);
+}
+#endif
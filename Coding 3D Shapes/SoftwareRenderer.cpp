@@ -0,0 +1,545 @@
+#include "SoftwareRenderer.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const int TILE_SIZE = 64;
+    const int TILE_STRIDE = TILE_SIZE + 4; // room for the last 4-wide step to run past the tile edge
+    const int TRIANGLES_PER_CHUNK = 256;
+    const int DEFAULT_WIDTH = 800;
+    const int DEFAULT_HEIGHT = 600;
+
+    // Per-vertex values carried to the fragment stage: vertex color, world position, texture coordinate, world normal
+    enum { ATTR_R, ATTR_G, ATTR_B, ATTR_WX, ATTR_WY, ATTR_WZ, ATTR_U, ATTR_V, ATTR_NX, ATTR_NY, ATTR_NZ, ATTR_COUNT };
+
+    struct SoftwareTexture
+    {
+        int width = 1;
+        int height = 1;
+        vector<unsigned char> texels = { 255, 255, 255 };
+    };
+
+    struct ClipVertex
+    {
+        glm::vec4 position;
+        float attributes[ATTR_COUNT];
+    };
+
+    // Screen-space plane equation: value(x, y) = a * x + b * y + c
+    struct Plane
+    {
+        float a, b, c;
+    };
+
+    struct RasterTriangle
+    {
+        Plane edges[3];
+        bool topLeft[3];
+        Plane depth;
+        Plane inverseW;
+        Plane attributes[ATTR_COUNT]; // attribute / w, which is linear in screen space
+        int minX, minY, maxX, maxY;
+        int texture; // -1 for the unlit light source cubes
+    };
+
+    struct DrawCall
+    {
+        const SceneMeshData* mesh;
+        int stride;
+        int texture;
+        glm::mat4 model;
+    };
+
+    struct TriangleChunk
+    {
+        vector<RasterTriangle> triangles;
+        vector<vector<unsigned int>> bins; // triangle indices per tile, in submission order
+    };
+
+    SceneMeshData gSoftwareMeshes[MESH_COUNT][SCENE_LOD_COUNT];
+    SceneMeshData gSoftwareLightMesh;
+    SoftwareTexture gSoftwareTextures[TEXTURE_COUNT];
+    bool gSoftwareReady = false;
+
+    Plane UMakePlane(const float x[3], const float y[3], const float v[3], float inverseArea)
+    {
+        Plane plane;
+        plane.a = ((v[1] - v[0]) * (y[2] - y[0]) - (v[2] - v[0]) * (y[1] - y[0])) * inverseArea;
+        plane.b = ((v[2] - v[0]) * (x[1] - x[0]) - (v[1] - v[0]) * (x[2] - x[0])) * inverseArea;
+        plane.c = v[0] - plane.a * x[0] - plane.b * y[0];
+        return plane;
+    }
+
+    inline float UEvaluate(const Plane& plane, float x, float y)
+    {
+        return plane.a * x + plane.b * y + plane.c;
+    }
+
+    ClipVertex ULerp(const ClipVertex& a, const ClipVertex& b, float t)
+    {
+        ClipVertex result;
+        result.position = a.position + (b.position - a.position) * t;
+        for (int i = 0; i < ATTR_COUNT; i++)
+            result.attributes[i] = a.attributes[i] + (b.attributes[i] - a.attributes[i]) * t;
+        return result;
+    }
+
+    // Clips a triangle against the near plane (z >= -w); returns the number of output vertices (0, 3 or 4)
+    int UClipNear(const ClipVertex* in[3], ClipVertex out[4])
+    {
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const ClipVertex& a = *in[i];
+            const ClipVertex& b = *in[(i + 1) % 3];
+            float da = a.position.z + a.position.w;
+            float db = b.position.z + b.position.w;
+            if (da >= 0.0f)
+                out[count++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                out[count++] = ULerp(a, b, da / (da - db));
+        }
+        return count;
+    }
+
+    void USetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int texture,
+        int width, int height, int tilesX, TriangleChunk& chunk)
+    {
+        const ClipVertex* verts[3] = { &v0, &v1, &v2 };
+        float x[3], y[3], z[3], inverseW[3];
+        for (int i = 0; i < 3; i++)
+        {
+            inverseW[i] = 1.0f / verts[i]->position.w;
+            x[i] = (verts[i]->position.x * inverseW[i] * 0.5f + 0.5f) * width;
+            y[i] = (0.5f - verts[i]->position.y * inverseW[i] * 0.5f) * height; // row 0 is the top of the image
+            z[i] = verts[i]->position.z * inverseW[i] * 0.5f + 0.5f;
+        }
+
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f || !std::isfinite(area))
+            return;
+
+        RasterTriangle tri;
+        tri.minX = max(0, static_cast<int>(floor(min({ x[0], x[1], x[2] }))));
+        tri.minY = max(0, static_cast<int>(floor(min({ y[0], y[1], y[2] }))));
+        tri.maxX = min(width - 1, static_cast<int>(ceil(max({ x[0], x[1], x[2] }))));
+        tri.maxY = min(height - 1, static_cast<int>(ceil(max({ y[0], y[1], y[2] }))));
+        if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+            return;
+
+        // Edge functions are positive inside the triangle whatever the winding (GL doesn't cull here either)
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            int a = (i + 1) % 3;
+            int b = (i + 2) % 3;
+            Plane& edge = tri.edges[i];
+            edge.a = -(y[b] - y[a]) * sign;
+            edge.b = (x[b] - x[a]) * sign;
+            edge.c = -edge.a * x[a] - edge.b * y[a];
+            // Pixels exactly on an edge belong to the triangle only for top and left edges
+            tri.topLeft[i] = edge.a > 0.0f || (edge.a == 0.0f && edge.b > 0.0f);
+        }
+
+        float inverseArea = 1.0f / area;
+        tri.depth = UMakePlane(x, y, z, inverseArea);
+        tri.inverseW = UMakePlane(x, y, inverseW, inverseArea);
+        for (int k = 0; k < ATTR_COUNT; k++)
+        {
+            float values[3];
+            for (int i = 0; i < 3; i++)
+                values[i] = verts[i]->attributes[k] * inverseW[i];
+            tri.attributes[k] = UMakePlane(x, y, values, inverseArea);
+        }
+        tri.texture = texture;
+
+        unsigned int index = static_cast<unsigned int>(chunk.triangles.size());
+        chunk.triangles.push_back(tri);
+        for (int ty = tri.minY / TILE_SIZE; ty <= tri.maxY / TILE_SIZE; ty++)
+            for (int tx = tri.minX / TILE_SIZE; tx <= tri.maxX / TILE_SIZE; tx++)
+                chunk.bins[ty * tilesX + tx].push_back(index);
+    }
+
+    glm::vec3 USampleTexture(const SoftwareTexture& texture, float u, float v)
+    {
+        // Bilinear filtering with GL_REPEAT wrapping
+        float fx = u * texture.width - 0.5f;
+        float fy = v * texture.height - 0.5f;
+        float flx = floor(fx);
+        float fly = floor(fy);
+        float tx = fx - flx;
+        float ty = fy - fly;
+        int x0 = static_cast<int>(flx) % texture.width;
+        int y0 = static_cast<int>(fly) % texture.height;
+        if (x0 < 0) x0 += texture.width;
+        if (y0 < 0) y0 += texture.height;
+        int x1 = (x0 + 1) % texture.width;
+        int y1 = (y0 + 1) % texture.height;
+
+        auto texel = [&](int tx, int ty)
+        {
+            const unsigned char* p = &texture.texels[(ty * texture.width + tx) * 3];
+            return glm::vec3(p[0], p[1], p[2]) * (1.0f / 255.0f);
+        };
+        glm::vec3 top = texel(x0, y0) * (1.0f - tx) + texel(x1, y0) * tx;
+        glm::vec3 bottom = texel(x0, y1) * (1.0f - tx) + texel(x1, y1) * tx;
+        return top * (1.0f - ty) + bottom * ty;
+    }
+
+    // Port of shaders/scene.frag: Phong lighting from the scene lights plus ambient, modulated by the texture
+    glm::vec3 UShadeFragment(const RasterTriangle& tri, const float* attributes, const glm::vec3& viewPosition)
+    {
+        if (tri.texture < 0)
+            return LIGHT_SOURCE_COLOR;
+
+        glm::vec3 vertexColor(attributes[ATTR_R], attributes[ATTR_G], attributes[ATTR_B]);
+        glm::vec3 fragPos(attributes[ATTR_WX], attributes[ATTR_WY], attributes[ATTR_WZ]);
+
+        glm::vec3 normal = glm::normalize(glm::vec3(attributes[ATTR_NX], attributes[ATTR_NY], attributes[ATTR_NZ]));
+        glm::vec3 viewDir = glm::normalize(viewPosition - fragPos);
+
+        // Only the key and fill lights, so there's no cluster lookup to port
+        glm::vec3 finalColor = AMBIENT_LIGHT_COLOR * vertexColor;
+        for (const PointLight& light : USceneLights())
+        {
+            glm::vec3 toLight = light.position - fragPos;
+            float distance = glm::length(toLight);
+            float falloff = ULightFalloff(distance, light.radius);
+            if (falloff <= 0.0f)
+                continue;
+
+            glm::vec3 lightDir = toLight / distance;
+            float diff = max(glm::dot(lightDir, normal), 0.0f);
+            glm::vec3 reflectDir = glm::reflect(-lightDir, normal);
+            float spec = pow(max(glm::dot(viewDir, reflectDir), 0.0f), SHININESS);
+            finalColor += light.color * (diff + spec) * falloff * vertexColor;
+        }
+
+        return USampleTexture(gSoftwareTextures[tri.texture], attributes[ATTR_U], attributes[ATTR_V]) * finalColor;
+    }
+
+    void URasterizeTile(int tileX, int tileY, const vector<TriangleChunk>& chunks, int tilesX,
+        const glm::vec3& viewPosition, ImageRgb& frame)
+    {
+        float depthBuffer[TILE_SIZE * TILE_STRIDE];
+        fill(depthBuffer, depthBuffer + TILE_SIZE * TILE_STRIDE, 1.0f);
+
+        const int x0Tile = tileX * TILE_SIZE;
+        const int y0Tile = tileY * TILE_SIZE;
+        const int x1Tile = min(x0Tile + TILE_SIZE, frame.width) - 1;
+        const int y1Tile = min(y0Tile + TILE_SIZE, frame.height) - 1;
+        const int tile = tileY * tilesX + tileX;
+
+        // Clear to the same black as glClearColor
+        for (int y = y0Tile; y <= y1Tile; y++)
+            memset(&frame.pixels[(y * frame.width + x0Tile) * 3], 0, (x1Tile - x0Tile + 1) * 3);
+
+        const Float4 laneOffsets(0.5f, 1.5f, 2.5f, 3.5f);
+        const Float4 zero(0.0f);
+
+        for (const TriangleChunk& chunk : chunks)
+        {
+            for (unsigned int index : chunk.bins[tile])
+            {
+                const RasterTriangle& tri = chunk.triangles[index];
+                int xStart = max(tri.minX, x0Tile);
+                int xEnd = min(tri.maxX, x1Tile);
+                int yStart = max(tri.minY, y0Tile);
+                int yEnd = min(tri.maxY, y1Tile);
+
+                Float4 topLeft[3];
+                for (int e = 0; e < 3; e++)
+                    topLeft[e] = UTrueMask(tri.topLeft[e]);
+
+                for (int y = yStart; y <= yEnd; y++)
+                {
+                    float py = y + 0.5f;
+                    float* depthRow = &depthBuffer[(y - y0Tile) * TILE_STRIDE];
+
+                    for (int x = xStart; x <= xEnd; x += 4)
+                    {
+                        Float4 px = Float4(static_cast<float>(x)) + laneOffsets;
+                        Float4 inside = px < Float4(xEnd + 1.0f);
+                        for (int e = 0; e < 3; e++)
+                        {
+                            const Plane& edge = tri.edges[e];
+                            Float4 value = Float4(edge.a) * px + Float4(edge.b * py + edge.c);
+                            inside = inside & ((value > zero) | ((value == zero) & topLeft[e]));
+                        }
+                        if (UMoveMask(inside) == 0)
+                            continue;
+
+                        float* depthPtr = depthRow + (x - x0Tile);
+                        Float4 depth = Float4(tri.depth.a) * px + Float4(tri.depth.b * py + tri.depth.c);
+                        Float4 stored = ULoad4(depthPtr);
+                        Float4 pass = inside & (depth < stored);
+                        int mask = UMoveMask(pass);
+                        if (mask == 0)
+                            continue;
+                        UStore4(depthPtr, USelect(pass, depth, stored));
+
+                        for (int lane = 0; lane < 4; lane++)
+                        {
+                            if (!(mask & (1 << lane)))
+                                continue;
+
+                            float fx = x + lane + 0.5f;
+                            float w = 1.0f / UEvaluate(tri.inverseW, fx, py);
+                            float attributes[ATTR_COUNT];
+                            for (int k = 0; k < ATTR_COUNT; k++)
+                                attributes[k] = UEvaluate(tri.attributes[k], fx, py) * w;
+
+                            glm::vec3 color = UShadeFragment(tri, attributes, viewPosition);
+                            unsigned char* pixel = &frame.pixels[(y * frame.width + x + lane) * 3];
+                            for (int c = 0; c < 3; c++)
+                                pixel[c] = static_cast<unsigned char>(min(max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    bool ULoadSoftwareTexture(SceneTextureId id)
+    {
+        int width, height, numComponents;
+        unsigned char* data = stbi_load(USceneTexturePath(id), &width, &height, &numComponents, 3);
+        if (!data)
+            return false;
+
+        SoftwareTexture& texture = gSoftwareTextures[id];
+        texture.width = width;
+        texture.height = height;
+        texture.texels.assign(data, data + width * height * 3);
+        stbi_image_free(data);
+        return true;
+    }
+}
+
+bool USoftwareInitialize()
+{
+    if (gSoftwareReady)
+        return true;
+
+    UBuildSceneMeshes(gSoftwareMeshes);
+    UBuildLightSourceMesh(gSoftwareLightMesh);
+
+    // Missing textures stay plain white so the lighting is still visible
+    for (int i = 0; i < TEXTURE_COUNT; i++)
+    {
+        if (!ULoadSoftwareTexture(static_cast<SceneTextureId>(i)))
+            cout << "Failed to load " << USceneTexturePath(static_cast<SceneTextureId>(i)) << endl;
+    }
+
+    gSoftwareReady = true;
+    return true;
+}
+
+void USoftwareRender(const SceneCamera& camera, ImageRgb& frame, SoftwareRenderStats& stats, vector<LodSelection>* lodSelections)
+{
+    auto start = chrono::steady_clock::now();
+
+    frame.pixels.resize(static_cast<size_t>(frame.width) * frame.height * 3);
+    const glm::mat4 view = USceneView(camera);
+    const glm::mat4 projection = USceneProjection(camera.isPerspective, (float)frame.width / (float)frame.height);
+    const glm::mat4 viewProjection = projection * view;
+    const ViewFrustum frustum = UExtractFrustum(viewProjection);
+
+    // Same draw order and LOD choice as URender: the scene objects, then the two light cubes
+    const vector<SceneObject>& objects = USceneObjects();
+    vector<LodSelection> freshSelections;
+    if (!lodSelections)
+        lodSelections = &freshSelections;
+    lodSelections->resize(objects.size());
+
+    vector<DrawCall> draws;
+    stats.objectsCulled = 0;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const SceneObject& object = objects[i];
+        const SceneMeshData* lods = gSoftwareMeshes[object.mesh];
+        glm::vec3 center;
+        float radius;
+        UWorldBounds(lods[0], object.model, center, radius);
+        if (!USphereInFrustum(frustum, center, radius))
+        {
+            stats.objectsCulled++;
+            continue;
+        }
+
+        float diameter = UProjectedDiameter(center, radius, view, projection, camera.isPerspective, (float)frame.height);
+        int lod = USelectLod(lods, USceneLodCount(object.mesh), diameter, (*lodSelections)[i]);
+        draws.push_back({ &lods[lod], SCENE_VERTEX_FLOATS, object.texture, object.model });
+    }
+    draws.push_back({ &gSoftwareLightMesh, 3, -1, ULightSourceModel(KEY_LIGHT_POSITION) });
+    draws.push_back({ &gSoftwareLightMesh, 3, -1, ULightSourceModel(FILL_LIGHT_POSITION) });
+
+    // Vertex stage
+    vector<vector<ClipVertex>> clipVertices(draws.size());
+    UParallelFor(draws.size(), [&](size_t d)
+        {
+            const DrawCall& draw = draws[d];
+            const vector<float>& v = draw.mesh->vertices;
+            const size_t count = v.size() / draw.stride;
+            const glm::mat4 mvp = viewProjection * draw.model;
+            const glm::mat3 normalMatrix = UNormalMatrix(draw.model);
+            clipVertices[d].resize(count);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                const float* src = &v[i * draw.stride];
+                glm::vec4 position(src[0], src[1], src[2], 1.0f);
+                ClipVertex& out = clipVertices[d][i];
+                out.position = mvp * position;
+
+                glm::vec4 world = draw.model * position;
+                out.attributes[ATTR_WX] = world.x;
+                out.attributes[ATTR_WY] = world.y;
+                out.attributes[ATTR_WZ] = world.z;
+
+                if (draw.stride == SCENE_VERTEX_FLOATS)
+                {
+                    out.attributes[ATTR_R] = src[SCENE_COLOR_OFFSET];
+                    out.attributes[ATTR_G] = src[SCENE_COLOR_OFFSET + 1];
+                    out.attributes[ATTR_B] = src[SCENE_COLOR_OFFSET + 2];
+                    out.attributes[ATTR_U] = src[SCENE_TEXCOORD_OFFSET];
+                    out.attributes[ATTR_V] = src[SCENE_TEXCOORD_OFFSET + 1];
+
+                    glm::vec3 normal = normalMatrix * glm::vec3(src[SCENE_NORMAL_OFFSET], src[SCENE_NORMAL_OFFSET + 1], src[SCENE_NORMAL_OFFSET + 2]);
+                    out.attributes[ATTR_NX] = normal.x;
+                    out.attributes[ATTR_NY] = normal.y;
+                    out.attributes[ATTR_NZ] = normal.z;
+                }
+                else
+                {
+                    for (int k : { ATTR_R, ATTR_G, ATTR_B, ATTR_U, ATTR_V, ATTR_NX, ATTR_NY, ATTR_NZ })
+                        out.attributes[k] = 0.0f;
+                }
+            }
+        });
+
+    // Triangle list across every draw, cut into fixed chunks so setup and binning run in parallel
+    // while each tile still sees its triangles in submission order
+    vector<pair<unsigned int, unsigned int>> triangles;
+    for (size_t d = 0; d < draws.size(); d++)
+        for (size_t t = 0; t + 2 < draws[d].mesh->indices.size(); t += 3)
+            triangles.emplace_back(static_cast<unsigned int>(d), static_cast<unsigned int>(t));
+
+    const int tilesX = (frame.width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tilesY = (frame.height + TILE_SIZE - 1) / TILE_SIZE;
+    vector<TriangleChunk> chunks((triangles.size() + TRIANGLES_PER_CHUNK - 1) / TRIANGLES_PER_CHUNK);
+
+    UParallelFor(chunks.size(), [&](size_t c)
+        {
+            TriangleChunk& chunk = chunks[c];
+            chunk.bins.resize(tilesX * tilesY);
+            size_t end = min(triangles.size(), (c + 1) * TRIANGLES_PER_CHUNK);
+            for (size_t t = c * TRIANGLES_PER_CHUNK; t < end; t++)
+            {
+                const DrawCall& draw = draws[triangles[t].first];
+                const vector<unsigned short>& indices = draw.mesh->indices;
+                const vector<ClipVertex>& verts = clipVertices[triangles[t].first];
+                const ClipVertex* in[3];
+                for (int i = 0; i < 3; i++)
+                    in[i] = &verts[indices[triangles[t].second + i]];
+
+                ClipVertex clipped[4];
+                int count = UClipNear(in, clipped);
+                for (int i = 1; i + 1 < count; i++)
+                    USetupTriangle(clipped[0], clipped[i], clipped[i + 1], draw.texture,
+                        frame.width, frame.height, tilesX, chunk);
+            }
+        });
+
+    // Fragment stage, one tile per task
+    UParallelFor(static_cast<size_t>(tilesX * tilesY), [&](size_t tile)
+        {
+            URasterizeTile(static_cast<int>(tile % tilesX), static_cast<int>(tile / tilesX), chunks, tilesX,
+                camera.position, frame);
+        });
+
+    stats.trianglesSubmitted = triangles.size();
+    stats.trianglesRasterized = 0;
+    for (const TriangleChunk& chunk : chunks)
+        stats.trianglesRasterized += chunk.triangles.size();
+    stats.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int USoftwareMain(int argc, char* argv[])
+{
+    const char* outputPath = "software_frame.png";
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    int frames = 1;
+    SceneCamera camera = UDefaultSceneCamera();
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (UParseThreadsOption(argc, argv, i))
+            continue;
+        if (strcmp(argv[i], "--size") == 0 && i + 2 < argc)
+        {
+            width = atoi(argv[++i]);
+            height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--ortho") == 0)
+            camera.isPerspective = false;
+        else
+            outputPath = argv[i];
+    }
+
+    if (width <= 0 || height <= 0)
+    {
+        cout << "ERROR::SOFTWARE::INVALID_SIZE " << width << "x" << height << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!USoftwareInitialize())
+        return EXIT_FAILURE;
+
+    ImageRgb frame;
+    frame.width = width;
+    frame.height = height;
+
+    SoftwareRenderStats stats;
+    vector<LodSelection> lodSelections;
+    double totalMs = 0.0;
+    double bestMs = 0.0;
+    for (int i = 0; i < frames; i++)
+    {
+        USoftwareRender(camera, frame, stats, &lodSelections);
+        totalMs += stats.milliseconds;
+        bestMs = i == 0 ? stats.milliseconds : min(bestMs, stats.milliseconds);
+    }
+
+    double averageMs = totalMs / frames;
+    cout << "INFO: Software renderer " << width << "x" << height << " on " << UParallelThreadCount() << " threads" << endl;
+    cout << "INFO: " << stats.trianglesSubmitted << " triangles/frame (" << stats.trianglesRasterized << " after clipping, "
+        << stats.objectsCulled << " objects culled), "
+        << averageMs << " ms average, " << bestMs << " ms best over " << frames << " frames" << endl;
+    cout << "INFO: Throughput " << (averageMs > 0.0 ? stats.trianglesSubmitted / (averageMs / 1000.0) : 0.0)
+        << " triangles/s" << endl;
+
+    if (!UWritePng(outputPath, frame))
+    {
+        cout << "ERROR::SOFTWARE::PNG_WRITE_FAILED " << outputPath << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "INFO: Wrote " << outputPath << endl;
+    return EXIT_SUCCESS;
+}
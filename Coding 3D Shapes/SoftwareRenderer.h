@@ -0,0 +1,28 @@
+#pragma once
+
+// CPU rasterizer that draws the same scene as the OpenGL path, for machines without a GPU.
+// Frames are split into tiles that are shaded in parallel, 4 pixels at a time.
+
+#include "Scene.h"
+#include "ImageIO.h"
+#include "Lod.h"
+
+#include <cstddef>
+#include <vector>
+
+struct SoftwareRenderStats
+{
+    size_t trianglesSubmitted = 0;  // triangles handed to the renderer
+    size_t trianglesRasterized = 0; // triangles left after clipping and degenerate rejection
+    size_t objectsCulled = 0;       // scene objects skipped because their bounds are off screen
+    double milliseconds = 0.0;
+};
+
+// Loads the scene meshes and textures; call once before USoftwareRender
+bool USoftwareInitialize();
+// Renders one frame into `frame`, which must already have its width and height set.
+// Pass the same `lodSelections` every frame to get LOD hysteresis; without it each frame picks fresh levels.
+void USoftwareRender(const SceneCamera& camera, ImageRgb& frame, SoftwareRenderStats& stats,
+    std::vector<LodSelection>* lodSelections = nullptr);
+// Entry point for `--software`: renders frames to a PNG and prints triangle throughput
+int USoftwareMain(int argc, char* argv[]);
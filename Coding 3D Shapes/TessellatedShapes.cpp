@@ -0,0 +1,99 @@
+#include "TessellatedShapes.h"
+#include "Shaders.h"
+#include "ShaderVariants.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <string>
+
+using namespace std;
+
+namespace {
+    // Patches around (u) and along (v) each shape; every patch is subdivided further on the GPU
+    const int PATCH_GRID_U = 16;
+    const int PATCH_GRID_V = 8;
+
+    // The patch stages in front of every variant of the scene fragment shader
+    ShaderVariants gTessShaders;
+    GLuint gEmptyVao = 0;
+    glm::vec3 gShapeColors[MESH_COUNT];
+
+    // Shape id as the shaders know it
+    int UShapeType(SceneMeshId mesh)
+    {
+        switch (mesh)
+        {
+        case MESH_SPHERE: return 0;
+        case MESH_TORUS: return 1;
+        default: return 2;
+        }
+    }
+}
+
+bool UCreateTessellatedShapes(const char* fragmentFile, const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT])
+{
+    if (!ULoadShaderVariants(gTessShaders, "tess.vert", fragmentFile, "tess.tesc", "tess.tese"))
+        return false;
+
+    for (int i = 0; i < MESH_COUNT; i++)
+    {
+        const vector<float>& vertices = meshes[i][0].vertices;
+        if (vertices.size() >= SCENE_VERTEX_FLOATS)
+        {
+            const float* color = &vertices[SCENE_COLOR_OFFSET];
+            gShapeColors[i] = glm::vec3(color[0], color[1], color[2]);
+        }
+    }
+
+    // Core profile needs a VAO bound to draw, even one with no attributes
+    glGenVertexArrays(1, &gEmptyVao);
+    return true;
+}
+
+void UDestroyTessellatedShapes()
+{
+    glDeleteVertexArrays(1, &gEmptyVao);
+    UDestroyShaderVariants(gTessShaders);
+    gEmptyVao = 0;
+}
+
+bool UIsTessellatedMesh(SceneMeshId mesh)
+{
+    return mesh == MESH_SPHERE || mesh == MESH_TORUS || mesh == MESH_CYLINDER;
+}
+
+void URequestTessellationProgram(unsigned features)
+{
+    URequestShaderVariant(gTessShaders, features);
+}
+
+size_t UPollTessellationPrograms()
+{
+    return UPollShaderVariants(gTessShaders);
+}
+
+GLuint UTessellationProgram(unsigned features)
+{
+    return UShaderVariant(gTessShaders, features);
+}
+
+bool UFindTessellationProgram(unsigned features, GLuint& programId)
+{
+    return UFindShaderVariant(gTessShaders, features, programId);
+}
+
+void UDrawTessellated(GLuint programId, SceneMeshId mesh, const glm::mat4& model, float viewportHeight)
+{
+    glUniform1i(glGetUniformLocation(programId, "shapeType"), UShapeType(mesh));
+    glUniform2i(glGetUniformLocation(programId, "patchGrid"), PATCH_GRID_U, PATCH_GRID_V);
+    glUniform3fv(glGetUniformLocation(programId, "surfaceColor"), 1, glm::value_ptr(gShapeColors[mesh]));
+    glUniform1f(glGetUniformLocation(programId, "viewportHeight"), viewportHeight);
+    glUniform1f(glGetUniformLocation(programId, "targetPixels"), TESSELLATION_TARGET_PIXELS);
+    glUniform1f(glGetUniformLocation(programId, "maxLevel"), TESSELLATION_MAX_LEVEL);
+    glUniformMatrix4fv(glGetUniformLocation(programId, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix3fv(glGetUniformLocation(programId, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(UNormalMatrix(model)));
+
+    glBindVertexArray(gEmptyVao);
+    glPatchParameteri(GL_PATCH_VERTICES, 1);
+    glDrawArrays(GL_PATCHES, 0, PATCH_GRID_U * PATCH_GRID_V);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// GPU tessellation path for the analytic shapes (sphere, torus, cylinder).
+// Each shape is a grid of single-vertex patches generated from gl_PrimitiveID, so it
+// needs no vertex or index buffers; the tessellation shaders evaluate the surface and
+// pick per-edge factors from each edge's length on screen.
+
+#include "Scene.h"
+
+#include <GL/glew.h>
+
+// Target length, in pixels, of one tessellated edge
+const float TESSELLATION_TARGET_PIXELS = 6.0f;
+// Upper bound on the per-edge factor (GL guarantees at least 64)
+const float TESSELLATION_MAX_LEVEL = 64.0f;
+
+// Loads the patch stages (shaders/tess.*) in front of the scene fragment shader in `fragmentFile`;
+// programs are built per variant below. The colors come from `meshes`.
+bool UCreateTessellatedShapes(const char* fragmentFile, const SceneMeshData meshes[MESH_COUNT][SCENE_LOD_COUNT]);
+void UDestroyTessellatedShapes();
+bool UIsTessellatedMesh(SceneMeshId mesh);
+// Submits a variant without waiting for it (see URequestShaderVariant)
+void URequestTessellationProgram(unsigned features);
+// Returns how many requested variants are still compiling
+size_t UPollTessellationPrograms();
+// The patch program for a variant of the scene fragment shader (see ShaderVariants.h), compiled
+// on first use; 0 if it failed
+GLuint UTessellationProgram(unsigned features);
+// As UFindShaderVariant, for the patch programs
+bool UFindTessellationProgram(unsigned features, GLuint& programId);
+// Draws one shape; `programId` must be current with its scene uniforms set
+void UDrawTessellated(GLuint programId, SceneMeshId mesh, const glm::mat4& model, float viewportHeight);
@@ -0,0 +1,239 @@
+#include "TransformStore.h"
+#include "Benchmark.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+namespace {
+    // Fewest batches per job: enough that composing them outweighs scheduling the job
+    const size_t TRANSFORM_PARALLEL_GRAIN = 256;
+    // Share of the transforms changed between frames in the benchmark's sparse case
+    const double TRANSFORM_BENCH_CHANGED = 0.01;
+
+    void UMarkDirty(TransformStore& store, size_t index)
+    {
+        if (!store.dirty[index])
+        {
+            store.dirty[index] = 1;
+            store.dirtyCount++;
+        }
+    }
+
+    // Composes the four world matrices starting at `first`. Each Float4 below holds one element of
+    // the matrix for all four transforms; the results are transposed back to one matrix per transform.
+    void UComposeBatch(TransformStore& store, size_t first)
+    {
+        const Float4 x = ULoad4(&store.rotationX[first]);
+        const Float4 y = ULoad4(&store.rotationY[first]);
+        const Float4 z = ULoad4(&store.rotationZ[first]);
+        const Float4 w = ULoad4(&store.rotationW[first]);
+        const Float4 sx = ULoad4(&store.scaleX[first]);
+        const Float4 sy = ULoad4(&store.scaleY[first]);
+        const Float4 sz = ULoad4(&store.scaleZ[first]);
+        const Float4 one(1.0f), two(2.0f), zero(0.0f);
+
+        const Float4 xx = x * x, yy = y * y, zz = z * z;
+        const Float4 xy = x * y, xz = x * z, yz = y * z;
+        const Float4 wx = w * x, wy = w * y, wz = w * z;
+
+        // Columns of the unit quaternion's rotation, each scaled by its axis' scale (as glm::mat3_cast)
+        Float4 m[16] =
+        {
+            (one - two * (yy + zz)) * sx, two * (xy + wz) * sx, two * (xz - wy) * sx, zero,
+            two * (xy - wz) * sy, (one - two * (xx + zz)) * sy, two * (yz + wx) * sy, zero,
+            two * (xz + wy) * sz, two * (yz - wx) * sz, (one - two * (xx + yy)) * sz, zero,
+            ULoad4(&store.positionX[first]), ULoad4(&store.positionY[first]), ULoad4(&store.positionZ[first]), one,
+        };
+
+        for (int column = 0; column < 4; column++)
+        {
+            Float4* elements = &m[column * 4];
+            UTranspose4(elements[0], elements[1], elements[2], elements[3]);
+            for (size_t lane = 0; lane < TRANSFORM_BATCH; lane++)
+                UStore4(glm::value_ptr(store.world[first + lane]) + column * 4, elements[lane]);
+        }
+    }
+
+    void UUpdateBatch(TransformStore& store, size_t batch)
+    {
+        size_t first = batch * TRANSFORM_BATCH;
+        uint32_t lanes;
+        memcpy(&lanes, &store.dirty[first], sizeof(lanes));
+        if (lanes == 0)
+            return;
+        UComposeBatch(store, first);
+        memset(&store.dirty[first], 0, TRANSFORM_BATCH);
+    }
+}
+
+size_t UAddTransform(TransformStore& store, const SceneTransform& transform)
+{
+    // Grow a whole batch at a time; the padding stays identity and never dirty
+    if (store.count % TRANSFORM_BATCH == 0)
+    {
+        size_t size = store.count + TRANSFORM_BATCH;
+        for (vector<float>* component : { &store.positionX, &store.positionY, &store.positionZ,
+            &store.rotationX, &store.rotationY, &store.rotationZ })
+            component->resize(size, 0.0f);
+        for (vector<float>* component : { &store.rotationW, &store.scaleX, &store.scaleY, &store.scaleZ })
+            component->resize(size, 1.0f);
+        store.dirty.resize(size, 0);
+        store.world.resize(size, glm::mat4(1.0f));
+    }
+
+    size_t index = store.count++;
+    USetTransform(store, index, transform);
+    return index;
+}
+
+SceneTransform UGetTransform(const TransformStore& store, size_t index)
+{
+    SceneTransform transform;
+    transform.position = glm::vec3(store.positionX[index], store.positionY[index], store.positionZ[index]);
+    transform.rotation = glm::quat(store.rotationW[index], store.rotationX[index], store.rotationY[index], store.rotationZ[index]);
+    transform.scale = glm::vec3(store.scaleX[index], store.scaleY[index], store.scaleZ[index]);
+    return transform;
+}
+
+void USetTransform(TransformStore& store, size_t index, const SceneTransform& transform)
+{
+    store.positionX[index] = transform.position.x;
+    store.positionY[index] = transform.position.y;
+    store.positionZ[index] = transform.position.z;
+    store.rotationX[index] = transform.rotation.x;
+    store.rotationY[index] = transform.rotation.y;
+    store.rotationZ[index] = transform.rotation.z;
+    store.rotationW[index] = transform.rotation.w;
+    store.scaleX[index] = transform.scale.x;
+    store.scaleY[index] = transform.scale.y;
+    store.scaleZ[index] = transform.scale.z;
+    UMarkDirty(store, index);
+}
+
+void USetTransformPosition(TransformStore& store, size_t index, const glm::vec3& position)
+{
+    store.positionX[index] = position.x;
+    store.positionY[index] = position.y;
+    store.positionZ[index] = position.z;
+    UMarkDirty(store, index);
+}
+
+size_t UUpdateTransforms(TransformStore& store)
+{
+    size_t changed = store.dirtyCount;
+    if (changed == 0)
+        return 0;
+
+    size_t batches = store.dirty.size() / TRANSFORM_BATCH;
+    if (store.count >= TRANSFORM_PARALLEL_COUNT)
+        UParallelFor(batches, [&store](size_t batch) { UUpdateBatch(store, batch); }, TRANSFORM_PARALLEL_GRAIN);
+    else
+    {
+        for (size_t batch = 0; batch < batches; batch++)
+            UUpdateBatch(store, batch);
+    }
+    store.dirtyCount = 0;
+    return changed;
+}
+
+void UReorderTransforms(TransformStore& store, const vector<size_t>& order)
+{
+    for (vector<float>* component : { &store.positionX, &store.positionY, &store.positionZ, &store.rotationX,
+        &store.rotationY, &store.rotationZ, &store.rotationW, &store.scaleX, &store.scaleY, &store.scaleZ })
+    {
+        vector<float> reordered(*component);
+        for (size_t i = 0; i < order.size(); i++)
+            reordered[i] = (*component)[order[i]];
+        component->swap(reordered);
+    }
+
+    vector<uint8_t> dirty(store.dirty);
+    vector<glm::mat4> world(store.world);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        dirty[i] = store.dirty[order[i]];
+        world[i] = store.world[order[i]];
+    }
+    store.dirty.swap(dirty);
+    store.world.swap(world);
+}
+
+int UTransformBenchmarkMain(int argc, char* argv[])
+{
+    for (int i = 2; i < argc; i++)
+        UParseThreadsOption(argc, argv, i);
+
+    cout << fixed << setprecision(3);
+    cout << "INFO: Composing world matrices, " << TRANSFORM_BATCH << " per batch, on up to "
+        << UParallelThreadCount() << " threads" << endl;
+
+    mt19937 random(BENCHMARK_SEED);
+    uniform_real_distribution<float> spread(-100.0f, 100.0f), component(-1.0f, 1.0f), size(0.1f, 4.0f);
+    for (size_t count = 1024; count <= 1048576; count *= 4)
+    {
+        TransformStore store;
+        vector<SceneTransform> transforms(count);
+        for (SceneTransform& transform : transforms)
+        {
+            transform.position = glm::vec3(spread(random), spread(random), spread(random));
+            transform.rotation = glm::normalize(glm::quat(component(random), component(random), component(random), component(random)));
+            transform.scale = glm::vec3(size(random), size(random), size(random));
+            UAddTransform(store, transform);
+        }
+
+        // Reference: one glm composition per object, as a flat list of transforms would be drawn
+        vector<glm::mat4> reference(count);
+        double referenceMilliseconds = UBenchmarkMilliseconds([&transforms, &reference]()
+            {
+                for (size_t i = 0; i < transforms.size(); i++)
+                    reference[i] = UComposeTransform(transforms[i]);
+            });
+
+        UUpdateTransforms(store);
+        float worst = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int column = 0; column < 4; column++)
+                for (int row = 0; row < 4; row++)
+                    worst = max(worst, fabs(UWorldMatrix(store, i)[column][row] - reference[i][column][row]));
+        }
+        if (worst > 1e-4f)
+        {
+            cout << "ERROR::TRANSFORMS::MISMATCH with " << count << " transforms, off by " << worst << endl;
+            return EXIT_FAILURE;
+        }
+
+        double allMilliseconds = UBenchmarkMilliseconds([&store]()
+            {
+                memset(store.dirty.data(), 1, store.count);
+                store.dirtyCount = store.count;
+                UUpdateTransforms(store);
+            });
+        // The same transforms change every run, as a few moving objects would
+        double sparseMilliseconds = UBenchmarkMilliseconds([&store]()
+            {
+                size_t stride = size_t(1.0 / TRANSFORM_BENCH_CHANGED);
+                for (size_t i = 0; i < store.count; i += stride)
+                    USetTransformPosition(store, i, glm::vec3(store.positionX[i] + 0.001f, store.positionY[i], store.positionZ[i]));
+                UUpdateTransforms(store);
+            });
+        double staticMilliseconds = UBenchmarkMilliseconds([&store]() { UUpdateTransforms(store); });
+
+        cout << "INFO: " << setw(7) << count << " transforms: all changed " << allMilliseconds << " ms (reference "
+            << referenceMilliseconds << " ms, " << setprecision(1) << referenceMilliseconds / allMilliseconds << "x), "
+            << setprecision(3) << TRANSFORM_BENCH_CHANGED * 100.0 << "% changed " << sparseMilliseconds << " ms, none "
+            << staticMilliseconds << " ms" << endl;
+    }
+    return 0;
+}
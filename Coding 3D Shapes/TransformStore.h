@@ -0,0 +1,48 @@
+#pragma once
+
+// Structure-of-arrays transform storage. Every component of the positions, rotations and scales
+// has an array of its own, so four neighbouring transforms load straight into the lanes of a
+// Float4 (see Simd.h) and their world matrices are composed together. Only transforms changed since
+// the last update are composed again: the dirty flags of a batch of four are tested at once, so
+// static objects cost one compare per four each frame.
+
+#include "Scene.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Transforms composed together; the arrays are always a whole number of batches long
+const size_t TRANSFORM_BATCH = 4;
+// From this many transforms on, UUpdateTransforms spreads the batches over UParallelFor's threads
+const size_t TRANSFORM_PARALLEL_COUNT = 16384;
+
+struct TransformStore
+{
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+    std::vector<uint8_t> dirty;    // 1 where the world matrix is out of date
+    std::vector<glm::mat4> world;  // translate * rotate * scale, as of the last UUpdateTransforms
+    size_t count = 0;              // transforms added; the arrays are padded past it with identities
+    size_t dirtyCount = 0;
+};
+
+// Returns the new transform's index; its world matrix is composed by the next UUpdateTransforms
+size_t UAddTransform(TransformStore& store, const SceneTransform& transform);
+SceneTransform UGetTransform(const TransformStore& store, size_t index);
+void USetTransform(TransformStore& store, size_t index, const SceneTransform& transform);
+void USetTransformPosition(TransformStore& store, size_t index, const glm::vec3& position);
+// Composes the world matrix of every transform changed since the last call; returns how many
+size_t UUpdateTransforms(TransformStore& store);
+// Rearranges the transforms so the one at order[i] moves to i; `order` is a permutation of [0, count)
+void UReorderTransforms(TransformStore& store, const std::vector<size_t>& order);
+
+inline const glm::mat4& UWorldMatrix(const TransformStore& store, size_t index)
+{
+    return store.world[index];
+}
+
+// Entry point for `--transform-bench`: times UUpdateTransforms for 1K to 1M random transforms, all
+// of them changed and a few, and checks the matrices against one glm composition per object
+int UTransformBenchmarkMain(int argc, char* argv[]);
@@ -0,0 +1,240 @@
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+    // Where each semantic starts in a scene vertex
+    int USourceOffset(VertexSemantic semantic)
+    {
+        switch (semantic)
+        {
+        case SEMANTIC_POSITION: return SCENE_POSITION_OFFSET;
+        case SEMANTIC_COLOR: return SCENE_COLOR_OFFSET;
+        case SEMANTIC_TEXCOORD: return SCENE_TEXCOORD_OFFSET;
+        case SEMANTIC_NORMAL: return SCENE_NORMAL_OFFSET;
+        case SEMANTIC_LIGHTMAP_UV: return SCENE_LIGHTMAP_UV_OFFSET;
+        default: return SCENE_TANGENT_OFFSET;
+        }
+    }
+
+    // Value used when the source vertex is too short to have the channel
+    glm::vec4 UDefaultValue(VertexSemantic semantic)
+    {
+        switch (semantic)
+        {
+        case SEMANTIC_COLOR: return glm::vec4(1.0f);
+        case SEMANTIC_NORMAL: return glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+        case SEMANTIC_TANGENT: return glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+        default: return glm::vec4(0.0f);
+        }
+    }
+
+    int USourceComponents(VertexSemantic semantic)
+    {
+        switch (semantic)
+        {
+        case SEMANTIC_COLOR:
+        case SEMANTIC_TANGENT: return 4;
+        case SEMANTIC_TEXCOORD:
+        case SEMANTIC_LIGHTMAP_UV: return 2;
+        default: return 3;
+        }
+    }
+
+    template <typename T>
+    void UStore(uint8_t* destination, T value)
+    {
+        memcpy(destination, &value, sizeof(T));
+    }
+
+    int16_t UToSnorm16(float value)
+    {
+        return static_cast<int16_t>(lround(min(max(value, -1.0f), 1.0f) * 32767.0f));
+    }
+
+    int8_t UToSnorm8(float value)
+    {
+        return static_cast<int8_t>(lround(min(max(value, -1.0f), 1.0f) * 127.0f));
+    }
+
+    uint8_t UToUnorm8(float value)
+    {
+        return static_cast<uint8_t>(lround(min(max(value, 0.0f), 1.0f) * 255.0f));
+    }
+
+    VertexFormat UMakeFormat(const vector<VertexAttribute>& attributes, int stride)
+    {
+        VertexFormat format;
+        format.attributes = attributes;
+        format.stride = stride;
+        return format;
+    }
+}
+
+VertexEncodingInfo UEncodingInfo(VertexEncoding encoding)
+{
+    switch (encoding)
+    {
+    case ENCODING_FLOAT3: return { 3, COMPONENT_FLOAT32, false, 12 };
+    case ENCODING_HALF2: return { 2, COMPONENT_HALF, false, 4 };
+    case ENCODING_SNORM16X3: return { 3, COMPONENT_SNORM16, true, 6 };
+    case ENCODING_UNORM8X4: return { 4, COMPONENT_UNORM8, true, 4 };
+    default: return { 2, COMPONENT_SNORM8, true, 2 }; // ENCODING_OCT_SNORM8X2
+    }
+}
+
+const VertexFormat& UCompactVertexFormat()
+{
+    static const VertexFormat format = UMakeFormat({
+        { 0, SEMANTIC_POSITION, ENCODING_SNORM16X3, 0 },
+        { 3, SEMANTIC_NORMAL, ENCODING_OCT_SNORM8X2, 6 },
+        { 1, SEMANTIC_COLOR, ENCODING_UNORM8X4, 8 },
+        { 2, SEMANTIC_TEXCOORD, ENCODING_HALF2, 12 } }, 16);
+    return format;
+}
+
+const VertexFormat& ULightmappedVertexFormat()
+{
+    static const VertexFormat format = UMakeFormat({
+        { 0, SEMANTIC_POSITION, ENCODING_SNORM16X3, 0 },
+        { 3, SEMANTIC_NORMAL, ENCODING_OCT_SNORM8X2, 6 },
+        { 1, SEMANTIC_COLOR, ENCODING_UNORM8X4, 8 },
+        { 2, SEMANTIC_TEXCOORD, ENCODING_HALF2, 12 },
+        { 4, SEMANTIC_LIGHTMAP_UV, ENCODING_HALF2, 16 } }, 20);
+    return format;
+}
+
+const VertexFormat& UPositionVertexFormat()
+{
+    static const VertexFormat format = UMakeFormat({ { 0, SEMANTIC_POSITION, ENCODING_FLOAT3, 0 } }, 12);
+    return format;
+}
+
+void UPackVertices(const SceneMeshData& mesh, int sourceStride, const VertexFormat& format,
+    vector<uint8_t>& packed, VertexQuantization& quantization)
+{
+    const size_t vertexCount = mesh.vertices.size() / sourceStride;
+    packed.assign(vertexCount * format.stride, 0);
+    quantization = VertexQuantization();
+
+    // snorm16 positions cover the mesh's bounding box; other encodings store positions as they are
+    bool quantized = false;
+    for (const VertexAttribute& attribute : format.attributes)
+        quantized = quantized || (attribute.semantic == SEMANTIC_POSITION && attribute.encoding == ENCODING_SNORM16X3);
+    if (quantized && vertexCount > 0)
+    {
+        glm::vec3 lo(mesh.vertices[0], mesh.vertices[1], mesh.vertices[2]);
+        glm::vec3 hi = lo;
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            const float* p = &mesh.vertices[v * sourceStride + SCENE_POSITION_OFFSET];
+            lo = glm::min(lo, glm::vec3(p[0], p[1], p[2]));
+            hi = glm::max(hi, glm::vec3(p[0], p[1], p[2]));
+        }
+        quantization.offset = (lo + hi) * 0.5f;
+        quantization.scale = glm::max((hi - lo) * 0.5f, glm::vec3(1e-6f));
+    }
+
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        const float* source = &mesh.vertices[v * sourceStride];
+        uint8_t* vertex = &packed[v * format.stride];
+
+        for (const VertexAttribute& attribute : format.attributes)
+        {
+            glm::vec4 value = UDefaultValue(attribute.semantic);
+            int sourceOffset = USourceOffset(attribute.semantic);
+            int components = USourceComponents(attribute.semantic);
+            if (sourceOffset >= 0 && sourceOffset + components <= sourceStride)
+            {
+                for (int c = 0; c < components; c++)
+                    value[c] = source[sourceOffset + c];
+            }
+
+            uint8_t* out = vertex + attribute.offset;
+            switch (attribute.encoding)
+            {
+            case ENCODING_FLOAT3:
+                for (int c = 0; c < 3; c++)
+                    UStore(out + c * 4, value[c]);
+                break;
+            case ENCODING_HALF2:
+                for (int c = 0; c < 2; c++)
+                    UStore(out + c * 2, UFloatToHalf(value[c]));
+                break;
+            case ENCODING_SNORM16X3:
+            {
+                glm::vec3 p = (glm::vec3(value) - quantization.offset) / quantization.scale;
+                for (int c = 0; c < 3; c++)
+                    UStore(out + c * 2, UToSnorm16(p[c]));
+                break;
+            }
+            case ENCODING_UNORM8X4:
+                for (int c = 0; c < 4; c++)
+                    out[c] = UToUnorm8(value[c]);
+                break;
+            case ENCODING_OCT_SNORM8X2:
+            {
+                glm::vec2 e = UOctEncode(glm::vec3(value));
+                UStore(out, UToSnorm8(e.x));
+                UStore(out + 1, UToSnorm8(e.y));
+                break;
+            }
+            }
+        }
+    }
+}
+
+uint16_t UFloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t floatExponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    const int exponent = int(floatExponent) - 127 + 15;
+
+    if (floatExponent == 0xff)
+        return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0)); // infinity or NaN
+    if (exponent >= 31)
+        return uint16_t(sign | 0x7c00); // too big: infinity
+    if (exponent <= 0)
+    {
+        // Subnormal half, or zero if it's too small even for that
+        if (exponent < -10)
+            return uint16_t(sign);
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            half++;
+        return uint16_t(sign | half);
+    }
+
+    // Round to nearest even; a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+    const uint32_t remainder = mantissa & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        half++;
+    return uint16_t(sign | half);
+}
+
+glm::vec2 UOctEncode(const glm::vec3& n)
+{
+    // Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half over the diagonals
+    glm::vec3 p = n * (1.0f / (fabs(n.x) + fabs(n.y) + fabs(n.z)));
+    glm::vec2 e(p.x, p.y);
+    if (p.z < 0.0f)
+    {
+        e = glm::vec2((1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return e;
+}
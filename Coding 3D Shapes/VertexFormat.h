@@ -0,0 +1,89 @@
+#pragma once
+
+// Packed GPU vertex layouts built from the float scene vertices. A VertexFormat lists each
+// attribute's shader location, where its data comes from and how it is encoded; UCreateMesh
+// takes its attribute pointers from the format instead of hard-coded offsets.
+// Nothing in here touches GL: the renderer maps VertexComponentType to GL types itself.
+
+#include "Scene.h"
+
+#include <cstdint>
+#include <vector>
+
+enum VertexComponentType
+{
+    COMPONENT_FLOAT32,
+    COMPONENT_HALF,
+    COMPONENT_SNORM16,
+    COMPONENT_UNORM8,
+    COMPONENT_SNORM8
+};
+
+// Which scene vertex channel an attribute is packed from
+enum VertexSemantic
+{
+    SEMANTIC_POSITION,
+    SEMANTIC_COLOR,
+    SEMANTIC_TEXCOORD,
+    SEMANTIC_NORMAL,
+    SEMANTIC_TANGENT,
+    SEMANTIC_LIGHTMAP_UV
+};
+
+enum VertexEncoding
+{
+    ENCODING_FLOAT3,
+    ENCODING_HALF2,
+    ENCODING_SNORM16X3,    // positions scaled into the mesh's bounding box
+    ENCODING_UNORM8X4,     // colors
+    ENCODING_OCT_SNORM8X2  // unit vectors folded onto an octahedron
+};
+
+struct VertexAttribute
+{
+    int location;
+    VertexSemantic semantic;
+    VertexEncoding encoding;
+    int offset; // in bytes from the start of the vertex
+};
+
+struct VertexFormat
+{
+    std::vector<VertexAttribute> attributes;
+    int stride = 0; // in bytes
+};
+
+// How one encoding is laid out and read by the vertex shader
+struct VertexEncodingInfo
+{
+    int components;
+    VertexComponentType type;
+    bool normalized;
+    int bytes;
+};
+
+// Maps a packed snorm16 position back to model space: position * scale + offset
+struct VertexQuantization
+{
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 offset = glm::vec3(0.0f);
+};
+
+VertexEncodingInfo UEncodingInfo(VertexEncoding encoding);
+
+// 16 bytes: snorm16 position, octahedral snorm8 normal, unorm8 color, half texture coordinate.
+// Tangents stay on the CPU side until something samples a normal map.
+const VertexFormat& UCompactVertexFormat();
+// 20 bytes: the compact layout plus a half lightmap coordinate, for lightmapped meshes
+const VertexFormat& ULightmappedVertexFormat();
+// 12 bytes: float position only, for the light cubes
+const VertexFormat& UPositionVertexFormat();
+
+// Packs `mesh` (with `sourceStride` floats per vertex; channels past the stride read as
+// white, +Y or zero) into `packed`. `quantization` says how to undo ENCODING_SNORM16X3 positions.
+void UPackVertices(const SceneMeshData& mesh, int sourceStride, const VertexFormat& format,
+    std::vector<uint8_t>& packed, VertexQuantization& quantization);
+
+uint16_t UFloatToHalf(float value);
+// Octahedral mapping of a unit vector to [-1, 1]^2; the scene vertex shader's octDecode undoes it
+glm::vec2 UOctEncode(const glm::vec3& n);
@@ -0,0 +1,6 @@
+#version 440 core
+
+// Depth is all the shadow pass writes
+void main()
+{
+}
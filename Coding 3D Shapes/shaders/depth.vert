@@ -0,0 +1,15 @@
+#version 440 core
+
+// Depth-only pass of the shadow maps: only the packed position is read
+
+layout(location = 0) in vec3 position;
+
+uniform mat4 model;
+uniform mat4 lightViewProjection;
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+void main()
+{
+    gl_Position = lightViewProjection * model * vec4(position * positionScale + positionOffset, 1.0);
+}
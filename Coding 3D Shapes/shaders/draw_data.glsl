@@ -0,0 +1,11 @@
+// Per-draw values of the scene shaders, one std140 slot per draw in a uniform buffer recorded with
+// the draw (see CommandBuffer.h). Laid out as SceneDrawData in Coding 3D Shapes.cpp.
+
+layout(std140, binding = 0) uniform DrawData
+{
+    mat4 model;
+    mat4 normalMatrix;   // inverse transpose of the model matrix's upper 3x3, in the upper 3x3
+    vec4 positionScale;  // packed positions are in [-1, 1] across the mesh's bounds
+    vec4 positionOffset;
+    vec4 uniformColor;   // the whole color of unlit variants
+} draw;
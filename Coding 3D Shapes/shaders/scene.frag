@@ -0,0 +1,170 @@
+#version 440 core
+
+// Scene fragment shader, specialised per material by the FEATURE_ constants (see ShaderVariants.h):
+// baked light from a lightmap, the probe grid or the flat ambient color, plus clustered point lights
+
+in vec4 vertexColor;
+in vec2 fragTexCoord;
+in vec3 fragPos;
+in vec3 fragNormal;
+in vec2 fragLightmapCoord;
+
+out vec4 fragmentColor;
+
+#include "draw_data.glsl"
+
+uniform sampler2D textureSampler; // Added texture
+
+// Baked irradiance of a static object: ambient, bounced light and every light flagged as baked (see Lightmap.h)
+uniform sampler2D lightmap;
+
+// Irradiance probes for everything else (see LightProbes.h): PROBE_SH_COEFFICIENTS RGB spherical
+// harmonic coefficients per probe in PROBE_TEXTURE_SLOTS RGBA slots, each slot a block of
+// probeGridSize.z layers further along z. Both constants are derived as in LightProbes.h.
+const int PROBE_SH_COEFFICIENTS = 9;
+const int PROBE_TEXTURE_SLOTS = (PROBE_SH_COEFFICIENTS * 3 + 3) / 4;
+uniform sampler3D probeTexture;
+uniform vec3 probeGridMin;
+uniform vec3 probeGridMax;
+uniform ivec3 probeGridSize;
+
+// Every light in the scene, plus each cluster's slice of the light index list (see ClusteredLighting.h)
+struct PointLight
+{
+    vec4 positionRadius;
+    vec4 color;
+};
+layout(std430, binding = 0) readonly buffer LightBuffer { PointLight lights[]; };
+layout(std430, binding = 1) readonly buffer ClusterRangeBuffer { uvec2 clusterRanges[]; };
+layout(std430, binding = 2) readonly buffer ClusterIndexBuffer { uint clusterLightIndices[]; };
+
+uniform uvec3 clusterGrid;       // tiles across, tiles down, depth slices
+uniform vec2 clusterTileSize;    // in pixels
+uniform vec2 clusterSliceScaleBias;
+uniform mat4 view;
+
+// Cascaded shadow map of one light, a layer per cascade, sampled with hardware depth comparison
+// SHADOW_CASCADE_COUNT is ShadowMap.h's; keep the two in step.
+const int SHADOW_CASCADE_COUNT = 4;
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[SHADOW_CASCADE_COUNT]; // world space to each layer's texture coordinates and depth
+uniform float shadowSplits[SHADOW_CASCADE_COUNT];  // view depth where each cascade ends
+uniform int shadowedLight;                         // index of the light the map belongs to, -1 for none
+uniform float shadowNormalOffset;
+
+uniform vec3 ambientLightColor;
+uniform vec3 viewPosition;
+uniform float shininess;
+
+// Same curve as ULightFalloff
+float lightFalloff(float lightDistance, float radius)
+{
+    float ratio = lightDistance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window;
+}
+
+// Fraction of the shadowed light reaching this fragment, 3x3 PCF in the cascade covering `depth`
+float shadowFactor(vec3 normal, float depth)
+{
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADE_COUNT && depth > shadowSplits[cascade])
+        cascade++;
+    if (cascade == SHADOW_CASCADE_COUNT)
+        return 1.0; // beyond the shadow distance
+
+    vec4 coord = shadowMatrices[cascade] * vec4(fragPos + normal * shadowNormalOffset, 1.0);
+    if (coord.w <= 0.0)
+        return 1.0;
+    coord.xyz /= coord.w;
+    if (any(lessThan(coord.xyz, vec3(0.0))) || any(greaterThan(coord.xyz, vec3(1.0))))
+        return 1.0; // outside the light's cone: lit
+
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+    return lit / 9.0;
+}
+
+// Trilinear blend of the probes around this fragment, evaluated for `normal`
+vec3 probeIrradiance(vec3 normal)
+{
+    vec3 cell = clamp((fragPos - probeGridMin) / (probeGridMax - probeGridMin), 0.0, 1.0) * vec3(probeGridSize - 1);
+    vec2 coordXY = (cell.xy + 0.5) / vec2(probeGridSize.xy);
+    float depth = float(probeGridSize.z * PROBE_TEXTURE_SLOTS);
+
+    // Staying between the slot's first and last layer centers keeps filtering inside the slot
+    vec4 slots[PROBE_TEXTURE_SLOTS];
+    for (int slot = 0; slot < PROBE_TEXTURE_SLOTS; slot++)
+        slots[slot] = texture(probeTexture, vec3(coordXY, (cell.z + 0.5 + float(slot * probeGridSize.z)) / depth));
+
+    vec3 sh[PROBE_SH_COEFFICIENTS];
+    for (int k = 0; k < PROBE_SH_COEFFICIENTS; k++)
+        sh[k] = vec3(slots[(3 * k) / 4][(3 * k) % 4], slots[(3 * k + 1) / 4][(3 * k + 1) % 4], slots[(3 * k + 2) / 4][(3 * k + 2) % 4]);
+
+    vec3 n = normal;
+    vec3 irradiance = sh[0] * 0.282095
+        + (sh[1] * n.y + sh[2] * n.z + sh[3] * n.x) * 0.488603
+        + (sh[4] * (n.x * n.y) + sh[5] * (n.y * n.z) + sh[7] * (n.x * n.z)) * 1.092548
+        + sh[6] * (0.315392 * (3.0 * n.z * n.z - 1.0))
+        + sh[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+    return max(irradiance, vec3(0.0)); // L2 can ring slightly negative behind strong lights
+}
+
+uint clusterIndex(float depth)
+{
+    uint slice = min(uint(max(log(depth) * clusterSliceScaleBias.x + clusterSliceScaleBias.y, 0.0)), clusterGrid.z - 1u);
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / clusterTileSize), clusterGrid.xy - 1u);
+    return tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice);
+}
+
+// The FEATURE_ constants are defined per variant (see ShaderVariants.h), so every test of one
+// is resolved when the variant compiles
+void main()
+{
+    if (FEATURE_UNLIT == 1) {
+        fragmentColor = vec4(draw.uniformColor.rgb, 1.0);
+        return;
+    }
+
+    vec3 normal = normalize(fragNormal);
+    vec3 viewDir = normalize(viewPosition - fragPos);
+
+    vec3 baked = ambientLightColor;
+    if (FEATURE_LIGHTMAP == 1)
+        baked = texture(lightmap, fragLightmapCoord).rgb;
+    else if (FEATURE_PROBES == 1)
+        baked = probeIrradiance(normal);
+    vec3 finalColor = baked * vertexColor.rgb;
+
+    // Phong diffuse and specular from each light touching this fragment's cluster,
+    // minus the ones the lightmap already holds
+    float depth = max(-(view * vec4(fragPos, 1.0)).z, 1e-4);
+    uvec2 range = clusterRanges[clusterIndex(depth)];
+    for (uint i = 0u; i < range.y; i++)
+    {
+        uint lightIndex = clusterLightIndices[range.x + i];
+        PointLight light = lights[lightIndex];
+        if (FEATURE_LIGHTMAP == 1 && light.color.w > 0.0)
+            continue;
+        vec3 toLight = light.positionRadius.xyz - fragPos;
+        float lightDistance = length(toLight);
+        float falloff = lightFalloff(lightDistance, light.positionRadius.w);
+        if (FEATURE_SHADOWS == 1 && int(lightIndex) == shadowedLight)
+            falloff *= shadowFactor(normal, depth);
+        if (falloff <= 0.0)
+            continue;
+
+        vec3 lightDir = toLight / lightDistance;
+        float diff = max(dot(lightDir, normal), 0.0);
+        vec3 reflectDir = reflect(-lightDir, normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+        finalColor += light.color.rgb * (diff + spec) * falloff * vertexColor.rgb;
+    }
+
+    fragmentColor = vec4(finalColor, 1.0);
+    if (FEATURE_TEXTURED == 1)
+        fragmentColor *= texture(textureSampler, fragTexCoord);
+}
@@ -0,0 +1,39 @@
+#version 440 core
+
+// Scene vertex shader: unpacks the compact vertex format (see VertexFormat.h)
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 texCoord; // Added texture coordinate
+layout(location = 3) in vec2 octNormal; // unit normal folded onto an octahedron
+layout(location = 4) in vec2 lightmapCoord; // only lightmapped meshes have one
+
+out vec4 vertexColor;
+out vec2 fragTexCoord; // Added fragment texture coordinate
+out vec3 fragPos;
+out vec3 fragNormal;
+out vec2 fragLightmapCoord;
+
+#include "draw_data.glsl"
+
+uniform mat4 view;
+uniform mat4 projection;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main()
+{
+    vec3 localPosition = position * draw.positionScale.xyz + draw.positionOffset.xyz;
+    gl_Position = projection * view * draw.model * vec4(localPosition, 1.0f);
+    vertexColor = color;
+    fragTexCoord = texCoord; // Pass texture coordinate to fragment shader
+    fragPos = vec3(draw.model * vec4(localPosition, 1.0));
+    fragNormal = mat3(draw.normalMatrix) * octDecode(octNormal);
+    fragLightmapCoord = lightmapCoord;
+}
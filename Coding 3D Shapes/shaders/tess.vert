@@ -0,0 +1,7 @@
+#version 440 core
+
+// Vertex stage has nothing to do: patches carry no attributes
+void main()
+{
+    gl_Position = vec4(0.0);
+}
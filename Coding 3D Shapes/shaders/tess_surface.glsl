@@ -0,0 +1,65 @@
+// Surface evaluation shared by the control and evaluation stages. Dimensions match
+// UBuildSphere, UBuildTorus and UBuildCylinder in Scene.cpp.
+
+uniform int shapeType; // 0 sphere, 1 torus, 2 cylinder
+uniform ivec2 patchGrid;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+const float PI = 3.14159265;
+
+// u runs around the shape and wraps, so u = 1 lands exactly on u = 0
+vec3 surfacePoint(vec2 uv)
+{
+    float theta = fract(uv.x) * 2.0 * PI;
+    if (shapeType == 0)
+    {
+        float phi = uv.y * PI;
+        return 0.5 * vec3(sin(phi) * cos(theta), cos(phi), sin(phi) * sin(theta));
+    }
+    if (shapeType == 1)
+    {
+        float phi = fract(uv.y) * 2.0 * PI;
+        float ring = 1.0 + 0.25 * cos(phi);
+        return vec3(ring * cos(theta), 0.25 * sin(phi), ring * sin(theta));
+    }
+
+    // Cylinder profile: top cap for v in [0, 0.25], side in [0.25, 0.75], bottom cap in [0.75, 1]
+    float radius = 0.5 * clamp(min(uv.y, 1.0 - uv.y) * 4.0, 0.0, 1.0);
+    float y = 0.5 - 2.0 * clamp(uv.y - 0.25, 0.0, 0.5);
+    return vec3(radius * cos(theta), y, radius * sin(theta));
+}
+
+// Texture coordinates laid out as the prebuilt meshes' in Scene.cpp, so a texture stays put when
+// tessellation is switched on or off: the sphere's v runs bottom to top, the torus's matches uv,
+// the cylinder's side wraps u around with v from bottom to top, and its caps are mapped flat
+// from above. patchV picks the cap or side at the rims, as in surfaceNormal.
+vec2 surfaceTexCoord(vec2 uv, float patchV)
+{
+    if (shapeType == 0)
+        return vec2(uv.x, 1.0 - uv.y);
+    if (shapeType == 1)
+        return uv;
+    vec3 point = surfacePoint(uv);
+    if (patchV < 0.25 || patchV > 0.75)
+        return point.xz + 0.5;
+    return vec2(uv.x, point.y + 0.5);
+}
+
+// patchV is the middle of the patch's v range, so vertices on the cylinder's rims take
+// the normal of the patch they belong to and the edge stays sharp
+vec3 surfaceNormal(vec2 uv, float patchV)
+{
+    float theta = fract(uv.x) * 2.0 * PI;
+    vec3 radial = vec3(cos(theta), 0.0, sin(theta));
+    if (shapeType == 0)
+        return normalize(surfacePoint(uv));
+    if (shapeType == 1)
+        return normalize(surfacePoint(uv) - radial);
+    if (patchV < 0.25)
+        return vec3(0.0, 1.0, 0.0);
+    if (patchV > 0.75)
+        return vec3(0.0, -1.0, 0.0);
+    return radial;
+}